@@ -0,0 +1,394 @@
+#include "BatchEvaluator.h"
+#include <algorithm>
+#include <bitset>
+
+// --- dual-rail の三値論理演算 (KnowledgeBase の applyOperator と同じ真理値表) ---
+
+static LaneState laneNot(LaneState a) {
+    return {a.is_false, a.is_true};
+}
+
+static LaneState laneApply(ExprNode::OpCode op, LaneState l, LaneState r) {
+    if (op == ExprNode::OpCode::AND) {
+        return {l.is_true & r.is_true, l.is_false | r.is_false};
+    }
+    if (op == ExprNode::OpCode::OR) {
+        return {l.is_true | r.is_true, l.is_false & r.is_false};
+    }
+    // XOR: どちらかが未決定なら未決定
+    uint64_t determined = (l.is_true | l.is_false) & (r.is_true | r.is_false);
+    uint64_t differ = l.is_true ^ r.is_true;
+    return {determined & differ, determined & ~differ};
+}
+
+static uint64_t laneCount(uint64_t mask) {
+    return std::bitset<64>(mask).count();
+}
+
+// active のレーンだけ src の値で dst を上書き
+static void laneMerge(LaneState& dst, LaneState src, uint64_t active) {
+    dst.is_true = (dst.is_true & ~active) | (src.is_true & active);
+    dst.is_false = (dst.is_false & ~active) | (src.is_false & active);
+}
+
+BatchEvaluator::BatchEvaluator(const RuleBase& rule_base, size_t fact_count)
+    : rule_base(rule_base), fact_count(fact_count), states(fact_count), proven_false(fact_count), known(fact_count) {
+    component_resolved.resize(rule_base.componentCount());
+    dirty_fact_lanes.resize(rule_base.component_facts.size());
+    dirty_facts.resize(rule_base.component_facts.size());
+    dirty_elimination_lanes.resize(rule_base.component_eliminations.size());
+    dirty_eliminations.resize(rule_base.component_eliminations.size());
+    single_open.resize(rule_base.component_eliminations.size());
+    node_values.resize(rule_base.expressions.size());
+    node_epochs.resize(rule_base.expressions.size(), 0);
+    guard_values.resize(rule_base.expressions.size());
+    guard_internal.resize(rule_base.expressions.size(), 0);
+    guard_epochs.resize(rule_base.expressions.size(), 0);
+}
+
+void BatchEvaluator::rulesChanged(size_t new_fact_count) {
+    // 成分と索引が変わったため、次のブロックで影響範囲を求め直す (範囲外の状態は読まないため他は古いままでよい)
+    fact_count = new_fact_count;
+    states.resize(fact_count);
+    proven_false.resize(fact_count);
+    known.resize(fact_count);
+    component_resolved.resize(rule_base.componentCount());
+    dirty_fact_lanes.resize(rule_base.component_facts.size());
+    dirty_facts.resize(rule_base.component_facts.size());
+    dirty_elimination_lanes.resize(rule_base.component_eliminations.size());
+    dirty_eliminations.resize(rule_base.component_eliminations.size());
+    single_open.resize(rule_base.component_eliminations.size());
+    node_values.resize(rule_base.expressions.size());
+    node_epochs.resize(rule_base.expressions.size(), 0);
+    guard_values.resize(rule_base.expressions.size());
+    guard_internal.resize(rule_base.expressions.size(), 0);
+    guard_epochs.resize(rule_base.expressions.size(), 0);
+    epoch++;
+    slice.queries.clear();
+}
+
+void BatchEvaluator::evaluate(const std::vector<std::vector<FactId>>& scenarios,
+                              const std::vector<FactId>& query_ids,
+                              std::vector<FactState>& results) {
+    results.assign(scenarios.size() * query_ids.size(), FactState::FALSE);
+
+    for (size_t first = 0; first < scenarios.size(); first += LANES) {
+        size_t count = std::min(LANES, scenarios.size() - first);
+        evaluateBlock(scenarios, first, count, query_ids, results);
+    }
+}
+
+void BatchEvaluator::evaluateBlock(const std::vector<std::vector<FactId>>& scenarios, size_t first, size_t count,
+                                   const std::vector<FactId>& query_ids, std::vector<FactState>& results) {
+    const uint64_t lanes = (count == LANES) ? ~uint64_t(0) : ((uint64_t(1) << count) - 1);
+
+    // 1. クエリの影響範囲 (同じクエリの間は使い回す) の事実と成分だけを、初期事実を各レーンに設定した
+    //    resetFacts と同じ状態にする (範囲外の事実はクエリの結果に影響しないため読まない)
+    //    範囲が変わったときは、前の範囲で評価済みの成分が残らないよう全成分を未評価に戻す
+    if (slice.queries != query_ids) {
+        rule_base.buildSlice(query_ids, slice);
+        component_resolved.clear();
+    } else {
+        for (uint32_t component : slice.components) component_resolved.reset(component);
+    }
+    if (collect_stats) stats.slice_facts = std::max<uint64_t>(stats.slice_facts, slice.facts.size());
+
+    for (size_t lane = 0; lane < count; ++lane) {
+        for (FactId id : scenarios[first + lane]) {
+            known[id] |= uint64_t(1) << lane;
+        }
+    }
+    for (FactId id : slice.facts) {
+        states[id] = {known[id], lanes & ~known[id]};
+        proven_false[id] = 0;
+    }
+    for (size_t lane = 0; lane < count; ++lane) {
+        for (FactId id : scenarios[first + lane]) known[id] = 0;
+    }
+    epoch++;
+
+    // 2. クエリ (必要な成分だけを全レーン同時に評価する)
+    for (size_t q = 0; q < query_ids.size(); ++q) {
+        if (collect_stats) stats.queries += count;
+        LaneState result = isFactTrue(query_ids[q], lanes);
+        for (size_t lane = 0; lane < count; ++lane) {
+            uint64_t bit = uint64_t(1) << lane;
+            FactState state = FactState::UNDETERMINED;
+            if (result.is_true & bit) state = FactState::TRUE;
+            else if (result.is_false & bit) state = FactState::FALSE;
+            results[(first + lane) * query_ids.size() + q] = state;
+        }
+    }
+}
+
+// KnowledgeBase::isFactTrue と同じ手順
+// 成分の依存関係はシナリオによらないため、評価する成分の順序は全レーンで共通になる
+LaneState BatchEvaluator::isFactTrue(FactId id, uint64_t lanes) {
+    if (collect_stats) stats.fact_calls += laneCount(lanes);
+    if (id < rule_base.fact_component.size()) {
+        const uint32_t component = rule_base.fact_component[id];
+        if (!component_resolved.test(component)) {
+            resolveComponents(component, lanes);
+        } else if (collect_stats) {
+            stats.cache_hits += laneCount(lanes);
+        }
+    }
+    return states[id];
+}
+
+void BatchEvaluator::resolveComponents(uint32_t root, uint64_t lanes) {
+    component_stack.clear();
+    component_stack.emplace_back(root, rule_base.dependency_begin[root]);
+    while (!component_stack.empty()) {
+        const uint32_t component = component_stack.back().first;
+        const uint32_t next = component_stack.back().second;
+        if (next < rule_base.dependency_end[component]) {
+            component_stack.back().second++;
+            const uint32_t dependency = rule_base.component_dependencies[next];
+            if (!component_resolved.test(dependency)) {
+                component_stack.emplace_back(dependency, rule_base.dependency_begin[dependency]);
+                if (collect_stats) stats.max_depth = std::max<uint64_t>(stats.max_depth, component_stack.size());
+            }
+            continue;
+        }
+        resolveComponent(component, lanes);
+        component_resolved.set(component);
+        component_stack.pop_back();
+    }
+    if (collect_stats) stats.max_depth = std::max<uint64_t>(stats.max_depth, 1);
+}
+
+// KnowledgeBase::resolveComponent と同じ手順
+// 再評価待ちの印はレーンごとに付け、パスは印の残っているレーンだけで続ける
+void BatchEvaluator::resolveComponent(uint32_t component, uint64_t lanes) {
+    const bool cyclic = rule_base.cyclic_components.test(component);
+    if (collect_stats) {
+        stats.components_resolved += laneCount(lanes);
+        if (cyclic) stats.cyclic_components += laneCount(lanes);
+    }
+
+    const uint32_t fact_begin = rule_base.component_begin[component];
+    const uint32_t fact_end = rule_base.component_begin[component + 1];
+    const uint32_t slot_begin = rule_base.elimination_begin[component];
+    const uint32_t slot_end = rule_base.elimination_end[component];
+    for (uint32_t m = fact_begin; m < fact_end; ++m) {
+        dirty_fact_lanes[m] = lanes;
+        dirty_facts.set(m);
+    }
+    for (uint32_t e = slot_begin; e < slot_end; ++e) {
+        if (rule_base.rules[rule_base.component_eliminations[e]].removed) continue; // 実行時に取り除いたルールの位置
+        single_open[e] = singleOpenLanes(rule_base.rules[rule_base.component_eliminations[e]], lanes);
+        dirty_elimination_lanes[e] = lanes;
+        dirty_eliminations.set(e);
+    }
+
+    uint64_t alive = lanes;
+    while (alive != 0) {
+        if (collect_stats && cyclic) stats.fixpoint_iterations += laneCount(alive);
+
+        // 1. 再評価待ちの事実について、それを否定の結論とするルール (偽の rail、証明済みのレーンは確定済み) と
+        //    結論とするルール (TRUE の rail、TRUE のレーンは確定済み) を試行
+        for (size_t m = dirty_facts.findNext(fact_begin, fact_end); m < fact_end; m = dirty_facts.findNext(m + 1, fact_end)) {
+            dirty_facts.reset(m);
+            const FactId id = rule_base.component_facts[m];
+            const uint64_t dirty = dirty_fact_lanes[m];
+            dirty_fact_lanes[m] = 0;
+
+            const uint64_t unproven = dirty & ~proven_false[id];
+            if (unproven != 0 && rule_base.negation_begin[id] < rule_base.negation_end[id]) {
+                uint64_t fired = 0;
+                for (uint32_t i = rule_base.negation_begin[id]; i < rule_base.negation_end[id]; ++i) {
+                    const Rule& rule = rule_base.rules[rule_base.negated_rules[i]];
+                    if (cyclic && rule_base.readsComponent(rule, component)) continue; // 不動点の後で評価する
+                    fired |= evaluateRule(rule, unproven).is_true;
+                }
+                fired &= unproven;
+                proven_false[id] |= fired;
+                // 矛盾の判定はレーンごとの AND 1 つ: TRUE のレーンは TRUE のまま、UNDETERMINED のレーンは FALSE に下がる
+                LaneState& state = states[id];
+                if (collect_stats) stats.contradictions += laneCount(fired & state.is_true);
+                const uint64_t lowered = fired & ~state.is_true & ~state.is_false;
+                if (lowered != 0) {
+                    state.is_false |= lowered;
+                    epoch++;
+                    markDependents(id, lowered, 0);
+                }
+            }
+
+            const uint64_t go = dirty & ~states[id].is_true;
+            if (go == 0 || id >= rule_base.rules_by_conclusion.size()) continue;
+
+            // FALSE < UNDETERMINED < TRUE の最大は dual-rail では OR と同じ
+            LaneState best = states[id];
+            for (size_t rule_index : rule_base.rules_by_conclusion[id]) {
+                best = laneApply(ExprNode::OpCode::OR, best, evaluateRule(rule_base.rules[rule_index], go, component));
+            }
+            LaneState& state = states[id];
+            const LaneState before = state;
+            laneMerge(state, best, go);
+            state.is_false |= proven_false[id] & ~state.is_true;
+            if (collect_stats) stats.contradictions += laneCount(state.is_true & ~before.is_true & proven_false[id]);
+            const uint64_t changed = (state.is_true ^ before.is_true) | (state.is_false ^ before.is_false);
+            if (changed == 0) continue;
+            epoch++;
+            markDependents(id, changed, state.is_true & ~before.is_true);
+        }
+
+        // 2. OR/XOR 結論の消去法: この成分の UNDETERMINED/FALSE の結論がちょうど 1 つのレーンでそれを TRUE に確定する
+        for (size_t e = dirty_eliminations.findNext(slot_begin, slot_end); e < slot_end;
+             e = dirty_eliminations.findNext(e + 1, slot_end)) {
+            dirty_eliminations.reset(e);
+            const uint64_t candidates = dirty_elimination_lanes[e] & single_open[e];
+            dirty_elimination_lanes[e] = 0;
+            if (candidates == 0) continue;
+            const Rule& rule = rule_base.rules[rule_base.component_eliminations[e]];
+            const uint64_t fired = evaluateRule(rule, candidates, component).is_true & candidates;
+            if (fired == 0) continue;
+
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                const FactId id = rule_base.fact_pool[i];
+                if (rule_base.fact_component[id] != component) continue;
+                const uint64_t promote = fired & ~states[id].is_true;
+                if (promote == 0) continue;
+                laneMerge(states[id], {~uint64_t(0), 0}, promote);
+                epoch++;
+                if (collect_stats) {
+                    stats.eliminations += laneCount(promote);
+                    stats.contradictions += laneCount(promote & proven_false[id]);
+                }
+                markDependents(id, promote, promote);
+            }
+        }
+
+        // 印の残っているレーンだけ次のパスへ
+        alive = 0;
+        for (size_t m = dirty_facts.findNext(fact_begin, fact_end); m < fact_end; m = dirty_facts.findNext(m + 1, fact_end)) {
+            alive |= dirty_fact_lanes[m];
+        }
+        for (size_t e = dirty_eliminations.findNext(slot_begin, slot_end); e < slot_end;
+             e = dirty_eliminations.findNext(e + 1, slot_end)) {
+            alive |= dirty_elimination_lanes[e];
+        }
+    }
+
+    // 3. 循環を含む成分で、成分内の事実を読む否定の結論 (すべての前提部を評価してから偽と証明する)
+    if (!cyclic) return;
+    deferred_false.clear();
+    for (uint32_t m = fact_begin; m < fact_end; ++m) {
+        const FactId id = rule_base.component_facts[m];
+        const uint64_t unproven = lanes & ~proven_false[id];
+        if (unproven == 0) continue;
+        uint64_t fired = 0;
+        for (uint32_t i = rule_base.negation_begin[id]; i < rule_base.negation_end[id]; ++i) {
+            const Rule& rule = rule_base.rules[rule_base.negated_rules[i]];
+            if (rule_base.readsComponent(rule, component)) fired |= evaluateRule(rule, unproven).is_true;
+        }
+        if ((fired & unproven) != 0) deferred_false.emplace_back(id, fired & unproven);
+    }
+    for (const std::pair<FactId, uint64_t>& entry : deferred_false) {
+        const FactId id = entry.first;
+        const uint64_t fired = entry.second;
+        proven_false[id] |= fired;
+        LaneState& state = states[id];
+        if (collect_stats) stats.contradictions += laneCount(fired & state.is_true);
+        const uint64_t lowered = fired & ~state.is_true & ~state.is_false;
+        if (lowered == 0) continue;
+        state.is_false |= lowered;
+        epoch++;
+    }
+}
+
+void BatchEvaluator::markDependents(FactId id, uint64_t changed, uint64_t became_true) {
+    // KnowledgeBase::markDependents と同じ規則をレーンごとに適用する
+    for (uint32_t i = rule_base.dependent_begin[id]; i < rule_base.dependent_end[id]; ++i) {
+        dirty_fact_lanes[rule_base.fact_dependents[i]] |= changed;
+        dirty_facts.set(rule_base.fact_dependents[i]);
+    }
+    for (uint32_t i = rule_base.premise_watch_begin[id]; i < rule_base.premise_watch_end[id]; ++i) {
+        const uint32_t e = rule_base.premise_watches[i];
+        if ((changed & single_open[e]) == 0) continue;
+        dirty_elimination_lanes[e] |= changed & single_open[e];
+        dirty_eliminations.set(e);
+    }
+    if (became_true == 0) return;
+    // 選言肢の数はレーンごとに数える代わりに、TRUE になったレーンについて結論部を数え直す
+    // (結論部は数個の事実なので、レーンごとのカウンタを更新するより速い)
+    for (uint32_t i = rule_base.disjunct_begin[id]; i < rule_base.disjunct_end[id]; ++i) {
+        const uint32_t e = rule_base.disjunct_watches[i];
+        if (i > rule_base.disjunct_begin[id] && e == rule_base.disjunct_watches[i - 1]) continue; // X | X
+        const uint64_t single = singleOpenLanes(rule_base.rules[rule_base.component_eliminations[e]], became_true);
+        single_open[e] = (single_open[e] & ~became_true) | single;
+        if (single == 0) continue;
+        dirty_elimination_lanes[e] |= single;
+        dirty_eliminations.set(e);
+    }
+}
+
+uint64_t BatchEvaluator::singleOpenLanes(const Rule& rule, uint64_t lanes) const {
+    // lanes のうち、結論部の (ルールを登録した先頭の事実と同じ成分の) TRUE でない事実 (重複も数える) がちょうど 1 つのレーン
+    const uint32_t component = rule_base.fact_component[rule_base.fact_pool[rule.conclusion_facts_begin]];
+    uint64_t one = 0;
+    uint64_t more = 0;
+    for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+        if (rule_base.fact_component[rule_base.fact_pool[i]] != component) continue;
+        const uint64_t open = lanes & ~states[rule_base.fact_pool[i]].is_true;
+        more |= one & open;
+        one = (one | open) & ~more;
+    }
+    return one;
+}
+
+LaneState BatchEvaluator::nodeValue(ExprId id) const {
+    const ExprNode& node = rule_base.expressions[id];
+    if (node.op == ExprNode::OpCode::LOAD) return states[node.left];
+    if (node.op == ExprNode::OpCode::LOAD_NOT) return laneNot(states[node.left]);
+    return node_values[id];
+}
+
+// 全レーンについて評価する (active は計測にだけ使う)。共有された部分式は状態が変わるまで再利用する
+LaneState BatchEvaluator::evaluateRule(const Rule& rule, uint64_t active) {
+    if (collect_stats) stats.rule_evaluations += laneCount(active);
+    rule_base.expressions.evaluate(rule.premise, expression_stack,
+                                   [&](ExprId id) { return node_epochs[id] == epoch; },
+                                   [&](ExprId id) {
+                                       const ExprNode& node = rule_base.expressions[id];
+                                       node_values[id] = laneApply(node.op, nodeValue(node.left), nodeValue(node.right));
+                                       node_epochs[id] = epoch;
+                                   });
+    return nodeValue(rule.premise);
+}
+
+// KnowledgeBase::evaluateRule (成分の評価中) と同じ
+LaneState BatchEvaluator::evaluateRule(const Rule& rule, uint64_t active, uint32_t component) {
+    if (rule_base.expressions.isMonotone(rule.premise) || !rule_base.cyclic_components.test(component)) {
+        return evaluateRule(rule, active);
+    }
+    if (collect_stats) stats.rule_evaluations += laneCount(active);
+    return evaluateGuarded(rule.premise, component);
+}
+
+// KnowledgeBase::evaluateGuarded と同じく、否定や XOR を通して成分内の事実を読む部分式を全レーンで UNDETERMINED とする
+LaneState BatchEvaluator::evaluateGuarded(ExprId root, uint32_t component) {
+    const uint64_t current = ++guard_epoch;
+    auto internal = [&](ExprId id) {
+        if (!rule_base.expressions.isFact(id)) return guard_internal[id] != 0;
+        return rule_base.fact_component[rule_base.expressions[id].left] == component;
+    };
+    auto value = [&](ExprId id) {
+        const ExprNode& node = rule_base.expressions[id];
+        if (node.op == ExprNode::OpCode::LOAD) return states[node.left];
+        if (node.op == ExprNode::OpCode::LOAD_NOT) return internal(id) ? LaneState{} : laneNot(states[node.left]);
+        return guard_values[id];
+    };
+    rule_base.expressions.evaluate(root, expression_stack,
+                                   [&](ExprId id) { return guard_epochs[id] == current; },
+                                   [&](ExprId id) {
+                                       const ExprNode& node = rule_base.expressions[id];
+                                       guard_internal[id] = internal(node.left) || internal(node.right);
+                                       guard_values[id] = (node.op == ExprNode::OpCode::XOR && guard_internal[id])
+                                                              ? LaneState{}
+                                                              : laneApply(node.op, value(node.left), value(node.right));
+                                       guard_epochs[id] = current;
+                                   });
+    return value(root);
+}
@@ -0,0 +1,94 @@
+#ifndef BATCHEVALUATOR_H
+#define BATCHEVALUATOR_H
+
+#include "Fact.h"
+#include "InferenceStats.h"
+#include "RuleBase.h"
+#include <cstdint>
+#include <vector>
+
+// 64 個のシナリオの三値状態を 2 本のビット列で表す (dual-rail)
+// TRUE = (1, 0), FALSE = (0, 1), UNDETERMINED = (0, 0)
+struct LaneState {
+    uint64_t is_true = 0;
+    uint64_t is_false = 0;
+};
+
+// 同じルールベースを多数の初期事実の組み合わせ (シナリオ) で評価するバッチエンジン
+// 1 語 = 64 シナリオとして KnowledgeBase::runQueries と同じ手順 (リセット -> 強連結成分ごとの評価 -> クエリ) を
+// ビット演算で同時に実行する。分岐はレーンごとの有効マスクで表し、結果は各レーンで逐次版と一致する。
+// ルールベースは読み取るだけなので、スレッドごとに評価器を作れば同じ RuleBase を共有して並列に評価できる。
+class BatchEvaluator {
+    public:
+        static constexpr size_t LANES = 64;
+
+        // fact_count は評価で使う事実 ID の上限 (KnowledgeBase::facts.size())
+        BatchEvaluator(const RuleBase& rule_base, size_t fact_count);
+
+        // 推論の計測 (回数はレーン単位で数える)
+        bool collect_stats = false;
+        InferenceStats stats;
+
+        // scenarios[s] は シナリオ s で TRUE にする初期事実の ID
+        // 結果は results[s * query_ids.size() + q] に書き込む
+        void evaluate(const std::vector<std::vector<FactId>>& scenarios,
+                      const std::vector<FactId>& query_ids,
+                      std::vector<FactState>& results);
+
+        // scenarios[first, first + count) (count は LANES 以下) だけを評価する
+        // results は scenarios.size() * query_ids.size() 要素を確保済みで、対象シナリオの位置だけに書き込む
+        void evaluateBlock(const std::vector<std::vector<FactId>>& scenarios, size_t first, size_t count,
+                           const std::vector<FactId>& query_ids, std::vector<FactState>& results);
+
+        // ルールベースが実行時に変更された (KnowledgeBase::updateRules) 後に、評価の前に呼ぶ
+        void rulesChanged(size_t new_fact_count);
+
+    private:
+        const RuleBase& rule_base;
+        size_t fact_count;
+
+        // 事実ごとのレーン状態 (事実 ID で引く、有効なのはクエリの影響範囲の事実だけ)
+        std::vector<LaneState> states;
+        // 偽の rail (否定の結論で偽と証明されたレーン)。states の is_true と両方立ったレーンが矛盾
+        // 偽と証明されたレーンは TRUE にならない限り FALSE (is_false) のまま
+        std::vector<uint64_t> proven_false;
+        std::vector<uint64_t> known; // 初期事実 (ブロックの設定中だけ使い、終わったら 0 に戻す)
+        QuerySlice slice; // 直前のブロックのクエリの影響範囲
+
+        // 評価済みの成分 (全レーン共通) と resolveComponents の探索スタック
+        Bitset component_resolved;
+        std::vector<std::pair<uint32_t, uint32_t>> component_stack;
+
+        // 成分内の差分評価: 再評価待ちのレーン (component_facts / component_eliminations の位置ごと) と
+        // それが 0 でない位置、OR/XOR ルールごとの TRUE でない選言肢がちょうど 1 つのレーン
+        std::vector<uint64_t> dirty_fact_lanes;
+        Bitset dirty_facts;
+        std::vector<uint64_t> dirty_elimination_lanes;
+        Bitset dirty_eliminations;
+        std::vector<uint64_t> single_open;
+
+        // 式の節点ごとの評価結果のメモ (node_epochs[e] == epoch の間だけ有効) と作業領域
+        // epoch はどのレーンかの事実の状態が変わるたびに進める
+        std::vector<LaneState> node_values;
+        std::vector<uint64_t> node_epochs;
+        uint64_t epoch = 1;
+        std::vector<ExprId> expression_stack;
+        // evaluateGuarded の作業領域 (guard_epochs[e] == guard_epoch の間だけ有効、呼び出しごとに進める)
+        std::vector<LaneState> guard_values;
+        std::vector<uint8_t> guard_internal;
+        std::vector<uint64_t> guard_epochs;
+        uint64_t guard_epoch = 0;
+        std::vector<std::pair<FactId, uint64_t>> deferred_false; // 循環を含む成分で、不動点の後に偽と証明する (事実, レーン)
+
+        LaneState isFactTrue(FactId id, uint64_t lanes);
+        void resolveComponents(uint32_t root, uint64_t lanes);
+        void resolveComponent(uint32_t component, uint64_t lanes);
+        void markDependents(FactId id, uint64_t changed, uint64_t became_true);
+        uint64_t singleOpenLanes(const Rule& rule, uint64_t lanes) const;
+        LaneState evaluateRule(const Rule& rule, uint64_t active);
+        LaneState evaluateRule(const Rule& rule, uint64_t active, uint32_t component); // KnowledgeBase と同じ
+        LaneState evaluateGuarded(ExprId root, uint32_t component);
+        LaneState nodeValue(ExprId id) const;
+};
+
+#endif
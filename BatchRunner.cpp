@@ -0,0 +1,281 @@
+#include "BatchRunner.h"
+#include <algorithm>
+#include <chrono>
+
+// ワーカー 1 つあたりにまとめて評価するシナリオ数 (BatchEvaluator の 64 レーンの倍数)
+static constexpr size_t BLOCK_RECORDS = 4096;
+// 出力バッファをこのサイズごとに書き出す
+static constexpr size_t OUTPUT_FLUSH_BYTES = 1 << 20;
+
+BatchRunner::BatchRunner(KnowledgeBase& kb, size_t threads) : kb(kb), pool(threads) {
+    for (size_t w = 0; w < pool.size(); ++w) {
+        evaluators.push_back(std::make_unique<BatchEvaluator>(kb, kb.facts.size()));
+        evaluators.back()->collect_stats = kb.collect_stats;
+    }
+    if (kb.mode == InferenceMode::BDD) {
+        bdd = std::make_unique<BddEvaluator>(kb, kb.facts.size(), kb.bdd_order, kb.bdd_node_limit);
+        scenario_known.resize(pool.size());
+        for (Bitset& known : scenario_known) known.resize(kb.facts.size());
+    }
+}
+
+void BatchRunner::rulesChanged(const RuleUpdate& update) {
+    for (std::unique_ptr<BatchEvaluator>& evaluator : evaluators) evaluator->rulesChanged(kb.facts.size());
+    for (Bitset& known : scenario_known) known.resize(kb.facts.size());
+    if (bdd && update.reset) {
+        bdd = std::make_unique<BddEvaluator>(kb, kb.facts.size(), kb.bdd_order, kb.bdd_node_limit);
+    } else if (bdd) {
+        bdd->rulesChanged(kb.facts.size(), update.cone);
+    }
+}
+
+InferenceStats BatchRunner::stats() const {
+    InferenceStats total = kb.stats;
+    for (const std::unique_ptr<BatchEvaluator>& evaluator : evaluators) total.merge(evaluator->stats);
+    total.merge(bdd_stats);
+    total.inference_seconds += inference_seconds;
+    return total;
+}
+
+size_t BatchRunner::run(std::istream& in, std::ostream& out) {
+    std::string line;
+    size_t count = 0;
+
+    while (std::getline(in, line)) {
+        if (!addScenario(line, count + 1)) continue;
+        count++;
+        if (records.size() == BLOCK_RECORDS * pool.size()) flushRecords(out);
+    }
+    flushRecords(out);
+
+    out.write(output.data(), static_cast<std::streamsize>(output.size()));
+    output.clear();
+    out.flush();
+    return count;
+}
+
+bool BatchRunner::addScenario(std::string_view line, size_t number) {
+    Record record;
+    record.number = number;
+    if (!parseRecord(line, record)) return false;
+    records.push_back(std::move(record));
+    return true;
+}
+
+void BatchRunner::evaluatePending(std::vector<std::string>& replies) {
+    std::vector<Group> groups;
+    std::vector<size_t> group_begin;
+    evaluateRecords(groups, group_begin);
+
+    replies.clear();
+    for (size_t g = 0; g < groups.size(); ++g) {
+        for (size_t r = group_begin[g]; r < group_begin[g + 1]; ++r) {
+            replies.emplace_back();
+            appendResults(records[r], groups[g].results.data() + (r - group_begin[g]) * groups[g].known_queries.size(),
+                          replies.back());
+        }
+    }
+    records.clear();
+}
+
+bool BatchRunner::parseRecord(std::string_view line, Record& record) const {
+    size_t comment_pos = line.find('#');
+    if (comment_pos != std::string_view::npos) line = line.substr(0, comment_pos);
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) return false; // 空行・コメント行
+    line.remove_prefix(start);
+
+    // "=<初期事実>" と "?<クエリ>" に分ける (先頭の '=' は省略可)
+    size_t query_pos = line.find('?');
+    std::string_view initial_str = line.substr(0, query_pos);
+    if (!initial_str.empty() && initial_str.front() == '=') initial_str.remove_prefix(1);
+
+    // 初期事実: ルールに現れない (未登録の) 事実は他の事実に影響しないため、クエリの結果用に名前だけ残す
+    std::vector<FactId> ids;
+    std::vector<std::string_view> names;
+    kb.lookupFactList(initial_str, ids, names);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] != NO_FACT) {
+            record.initial.push_back(ids[i]);
+        } else {
+            record.unknown_initial.append(names[i]);
+            record.unknown_initial.push_back('\0');
+        }
+    }
+
+    // クエリ: 省略時は入力ファイルの '?' 行
+    if (query_pos == std::string_view::npos) {
+        record.queries = kb.queries;
+        for (FactId id : record.queries) {
+            record.query_names.append(kb.facts.name(id));
+            record.query_names.push_back('\0');
+        }
+    } else {
+        names.clear();
+        kb.lookupFactList(line.substr(query_pos + 1), record.queries, names);
+        for (std::string_view name : names) {
+            record.query_names.append(name);
+            record.query_names.push_back('\0');
+        }
+    }
+    return true;
+}
+
+void BatchRunner::flushRecords(std::ostream& out) {
+    std::vector<Group> groups;
+    std::vector<size_t> group_begin;
+    evaluateRecords(groups, group_begin);
+
+    for (size_t g = 0; g < groups.size(); ++g) {
+        for (size_t r = group_begin[g]; r < group_begin[g + 1]; ++r) {
+            appendResults(records[r], groups[g].results.data() + (r - group_begin[g]) * groups[g].known_queries.size(), output);
+            output += '\n';
+            if (output.size() >= OUTPUT_FLUSH_BYTES) {
+                out.write(output.data(), static_cast<std::streamsize>(output.size()));
+                output.clear();
+            }
+        }
+    }
+    records.clear();
+}
+
+void BatchRunner::evaluateRecords(std::vector<Group>& groups, std::vector<size_t>& group_begin) {
+    // 同じクエリを持つ連続したシナリオをまとめる
+    // (クエリの評価順で結果が変わりうるため、クエリの並びが異なるシナリオは混ぜない)
+    for (size_t r = 0; r < records.size(); ++r) {
+        if (r == 0 || records[r].queries != records[r - 1].queries) {
+            groups.emplace_back();
+            group_begin.push_back(r);
+            for (FactId id : records[r].queries) {
+                if (id != NO_FACT) groups.back().known_queries.push_back(id);
+            }
+        }
+        groups.back().scenarios.push_back(std::move(records[r].initial));
+    }
+    group_begin.push_back(records.size());
+
+    auto start = std::chrono::steady_clock::now();
+    if (kb.mode == InferenceMode::BDD) {
+        evaluateBdd(groups);
+    } else if (kb.mode == InferenceMode::BACKWARD) {
+        // 後向き連鎖: 64 シナリオのブロックを 1 タスクとしてワーカーに分配
+        std::vector<std::pair<size_t, size_t>> tasks; // (グループ, 先頭シナリオ)
+        for (size_t g = 0; g < groups.size(); ++g) {
+            groups[g].results.assign(groups[g].scenarios.size() * groups[g].known_queries.size(), FactState::FALSE);
+            for (size_t first = 0; first < groups[g].scenarios.size(); first += BatchEvaluator::LANES) {
+                tasks.emplace_back(g, first);
+            }
+        }
+        pool.run(tasks.size(), [&](size_t task, size_t worker) {
+            Group& group = groups[tasks[task].first];
+            const size_t first = tasks[task].second;
+            const size_t count = std::min(BatchEvaluator::LANES, group.scenarios.size() - first);
+            evaluators[worker]->evaluateBlock(group.scenarios, first, count, group.known_queries, group.results);
+        });
+    } else {
+        // 前向き連鎖と SAT モードは KnowledgeBase の推論状態 (SAT ではソルバの学習節) を使うため、
+        // 呼び出し元のスレッドで逐次に評価
+        std::vector<FactState> scenario_results;
+        for (Group& group : groups) {
+            for (const std::vector<FactId>& initial : group.scenarios) {
+                kb.evaluateScenario(initial, group.known_queries, scenario_results);
+                group.results.insert(group.results.end(), scenario_results.begin(), scenario_results.end());
+            }
+        }
+    }
+    if (kb.collect_stats) {
+        inference_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void BatchRunner::evaluateBdd(std::vector<Group>& groups) {
+    // 1. 各グループのクエリを (未コンパイルなら) コンパイルし、できなかったものは後向き連鎖で評価する
+    std::vector<std::pair<size_t, size_t>> tasks; // (グループ, 先頭シナリオ)
+    for (size_t g = 0; g < groups.size(); ++g) {
+        Group& group = groups[g];
+        for (size_t q = 0; q < group.known_queries.size(); ++q) {
+            if (bdd->compile(group.known_queries[q])) continue;
+            group.fallback_positions.push_back(q);
+            group.fallback_queries.push_back(group.known_queries[q]);
+        }
+        group.results.assign(group.scenarios.size() * group.known_queries.size(), FactState::FALSE);
+        group.fallback_results.assign(group.scenarios.size() * group.fallback_queries.size(), FactState::FALSE);
+        for (size_t first = 0; first < group.scenarios.size(); first += BatchEvaluator::LANES) {
+            tasks.emplace_back(g, first);
+        }
+        if (kb.collect_stats) {
+            const size_t walked = group.known_queries.size() - group.fallback_queries.size();
+            bdd_stats.queries += group.scenarios.size() * walked;
+            bdd_stats.bdd_fallbacks += group.scenarios.size() * group.fallback_queries.size();
+        }
+    }
+    if (kb.collect_stats) bdd_stats.bdd_nodes = std::max<uint64_t>(bdd_stats.bdd_nodes, bdd->nodeCount());
+
+    // 2. 64 シナリオのブロックごとに、図をたどって答える (図は読み取るだけなのでワーカー間で共有する)
+    pool.run(tasks.size(), [&](size_t task, size_t worker) {
+        Group& group = groups[tasks[task].first];
+        const size_t first = tasks[task].second;
+        const size_t count = std::min(BatchEvaluator::LANES, group.scenarios.size() - first);
+        if (!group.fallback_queries.empty()) {
+            evaluators[worker]->evaluateBlock(group.scenarios, first, count, group.fallback_queries, group.fallback_results);
+        }
+
+        Bitset& known = scenario_known[worker];
+        const size_t query_count = group.known_queries.size();
+        for (size_t s = first; s < first + count; ++s) {
+            for (FactId id : group.scenarios[s]) known.set(id);
+            FactState* results = group.results.data() + s * query_count;
+            for (size_t q = 0; q < query_count; ++q) {
+                if (bdd->compiled(group.known_queries[q])) results[q] = bdd->evaluate(group.known_queries[q], known);
+            }
+            for (size_t f = 0; f < group.fallback_queries.size(); ++f) {
+                results[group.fallback_positions[f]] = group.fallback_results[s * group.fallback_queries.size() + f];
+            }
+            for (FactId id : group.scenarios[s]) known.reset(id);
+        }
+    });
+}
+
+// '\0' 区切りの識別子の並び list に name が含まれるか
+static bool isListed(std::string_view list, std::string_view name) {
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find('\0', start);
+        if (list.substr(start, end - start) == name) return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+void BatchRunner::appendResults(const Record& record, const FactState* results, std::string& out) const {
+    // 識別子は英数字と '_' のみなので JSON のエスケープは不要
+    out += "{\"scenario\":";
+    out += std::to_string(record.number);
+    out += ",\"results\":{";
+
+    size_t name_start = 0;
+    for (size_t q = 0; q < record.queries.size(); ++q) {
+        size_t name_end = record.query_names.find('\0', name_start);
+        std::string_view name(record.query_names.data() + name_start, name_end - name_start);
+        FactState state;
+        if (record.queries[q] != NO_FACT) {
+            state = *results++;
+        } else {
+            state = isListed(record.unknown_initial, name) ? FactState::TRUE : FactState::FALSE;
+        }
+
+        if (q > 0) out += ',';
+        out += '"';
+        out.append(name);
+        out += "\":";
+        if (state == FactState::TRUE) {
+            out += "\"true\"";
+        } else if (state == FactState::FALSE) {
+            out += "\"false\"";
+        } else {
+            out += "\"undetermined\"";
+        }
+        name_start = name_end + 1;
+    }
+    out += "}}";
+}
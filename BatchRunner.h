@@ -0,0 +1,82 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include "BatchEvaluator.h"
+#include "BddEvaluator.h"
+#include "KnowledgeBase.h"
+#include "ThreadPool.h"
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 非対話のバッチモード (--batch)
+// 入力は 1 行 1 シナリオ: "=<初期事実> ?<クエリ>" (例: "=A B ?C D"、"?" 以降を省略するとファイルのクエリ)
+// 出力は 1 行 1 シナリオの JSON Lines: {"scenario":1,"results":{"C":"true","D":"undetermined"}}
+// 後向き連鎖では 64 シナリオずつのブロックをスレッドプールで並列に評価する
+// (ルールベースは const で共有し、推論の状態はワーカーごとの BatchEvaluator が持つ)
+// BDD モードではクエリの図を先にコンパイルし、各シナリオは図をたどるだけで並列に答える
+class BatchRunner {
+    public:
+        // threads == 0 ならハードウェアのスレッド数
+        explicit BatchRunner(KnowledgeBase& kb, size_t threads = 0);
+
+        // in の全シナリオを評価して out に書き込み、処理したシナリオ数を返す
+        size_t run(std::istream& in, std::ostream& out);
+
+        // 1 行のシナリオを評価待ちに加える (空行・コメント行なら加えずに false を返す)
+        // number は結果の "scenario" に書く番号
+        bool addScenario(std::string_view line, size_t number);
+
+        // 評価待ちのシナリオをまとめて評価し、加えた順に結果の JSON (改行なし) を replies に書き込む
+        // (デーモンモードで複数のクライアントの要求を 1 度に評価する)
+        void evaluatePending(std::vector<std::string>& replies);
+
+        // kb.updateRules でルールを変更した後に呼ぶ (評価待ちのシナリオは変更の前に評価しておく)
+        void rulesChanged(const RuleUpdate& update);
+
+        // 全ワーカーと KnowledgeBase の計測値の合計 (kb.collect_stats が true の場合のみ収集される)
+        InferenceStats stats() const;
+
+    private:
+        struct Record {
+            size_t number; // 入力中のシナリオ番号 (1 から)
+            std::vector<FactId> initial;
+            std::vector<FactId> queries; // 未登録の事実は NO_FACT (初期事実に含まれれば TRUE、それ以外は FALSE)
+            std::string query_names; // クエリの識別子を '\0' 区切りで連結したもの
+            std::string unknown_initial; // 未登録の初期事実の識別子 (同じ形式)
+        };
+
+        // 同じクエリを持つ連続したシナリオ (まとめて評価する単位)
+        struct Group {
+            std::vector<FactId> known_queries; // 評価するクエリ (未登録の事実を除く)
+            std::vector<std::vector<FactId>> scenarios;
+            std::vector<FactState> results;
+            // BDD モードでコンパイルできなかったクエリ (known_queries の添字) と、その後向き連鎖の結果
+            std::vector<size_t> fallback_positions;
+            std::vector<FactId> fallback_queries;
+            std::vector<FactState> fallback_results;
+        };
+
+        KnowledgeBase& kb;
+        ThreadPool pool;
+        std::vector<std::unique_ptr<BatchEvaluator>> evaluators; // ワーカーごと
+        std::unique_ptr<BddEvaluator> bdd; // BDD モードのみ (コンパイルは呼び出し元のスレッドで行い、評価は共有する)
+        std::vector<Bitset> scenario_known; // ワーカーごとの、BDD をたどるためのシナリオの初期事実
+        InferenceStats bdd_stats; // BDD でたどったクエリの計測値
+
+        std::vector<Record> records; // 読み込み済みで未評価のシナリオ
+        std::string output; // 出力バッファ (一定量たまったらまとめて書き出す)
+        double inference_seconds = 0; // 評価にかかった時間 (計測中のみ)
+
+        bool parseRecord(std::string_view line, Record& record) const;
+        void flushRecords(std::ostream& out);
+        // records を同じクエリの連続ごとにまとめて評価する (group_begin[g] はグループ g の先頭の records の位置、末尾に番兵)
+        void evaluateRecords(std::vector<Group>& groups, std::vector<size_t>& group_begin);
+        void evaluateBdd(std::vector<Group>& groups);
+        void appendResults(const Record& record, const FactState* results, std::string& out) const; // JSON 1 行 (改行なし)
+};
+
+#endif
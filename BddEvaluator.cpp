@@ -0,0 +1,359 @@
+#include "BddEvaluator.h"
+#include <algorithm>
+#include <numeric>
+
+BddEvaluator::BddEvaluator(const RuleBase& rule_base, size_t fact_count, BddOrder order, size_t node_limit)
+    : rule_base(rule_base), fact_count(fact_count), order(order), manager(node_limit),
+      fact_level(fact_count, NO_LEVEL), roots(fact_count, NO_ROOT), is_true(fact_count), is_false(fact_count),
+      proven_false(fact_count) {
+    failed.resize(fact_count);
+    initialized.resize(fact_count);
+    component_resolved.resize(rule_base.componentCount());
+    node_values.resize(rule_base.expressions.size());
+    node_epochs.resize(rule_base.expressions.size(), 0);
+    guard_values.resize(rule_base.expressions.size());
+    guard_internal.resize(rule_base.expressions.size(), 0);
+    guard_epochs.resize(rule_base.expressions.size(), 0);
+
+    if (order == BddOrder::DEPTH_FIRST) return; // クエリごとに assignLevels で決める
+
+    level_fact.resize(fact_count);
+    std::iota(level_fact.begin(), level_fact.end(), 0);
+    if (order == BddOrder::FREQUENCY) {
+        std::vector<uint32_t> occurrences(fact_count, 0);
+        std::vector<FactId> premise;
+        for (const Rule& rule : rule_base.rules) {
+            if (rule.removed) continue;
+            premise.clear();
+            rule_base.expressions.collectFacts(rule.premise, premise);
+            for (FactId f : premise) {
+                if (f < fact_count) occurrences[f]++;
+            }
+        }
+        std::stable_sort(level_fact.begin(), level_fact.end(),
+                         [&](FactId a, FactId b) { return occurrences[a] > occurrences[b]; });
+    }
+    for (uint32_t level = 0; level < fact_count; ++level) fact_level[level_fact[level]] = level;
+}
+
+void BddEvaluator::assignLevels(FactId root) {
+    // 依存グラフ (RuleBase::buildComponents と同じ辺) を深さ優先の先行順でたどる
+    // 既に順位のある事実 (以前のクエリで使ったもの) はそのままにし、新しい事実は末尾 (下) に追加する
+    order_stack.assign(1, root);
+    while (!order_stack.empty()) {
+        const FactId f = order_stack.back();
+        order_stack.pop_back();
+        if (fact_level[f] != NO_LEVEL) continue;
+        fact_level[f] = static_cast<uint32_t>(level_fact.size());
+        level_fact.push_back(f);
+        if (f >= rule_base.negation_begin.size()) continue;
+
+        // 先に書いた事実から訪れるよう逆順に積む (否定の結論のルールの前提部も依存先)
+        const size_t base = order_stack.size();
+        auto push = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                if (fact_level[rule_base.fact_pool[i]] == NO_LEVEL) order_stack.push_back(rule_base.fact_pool[i]);
+            }
+        };
+        for (uint32_t n = rule_base.negation_begin[f]; n < rule_base.negation_end[f]; ++n) {
+            const Rule& rule = rule_base.rules[rule_base.negated_rules[n]];
+            push(rule.premise_facts_begin, rule.premise_facts_end);
+        }
+        if (f < rule_base.rules_by_conclusion.size()) {
+            for (size_t rule_index : rule_base.rules_by_conclusion[f]) {
+                const Rule& rule = rule_base.rules[rule_index];
+                push(rule.premise_facts_begin, rule.premise_facts_end);
+            }
+        }
+        std::reverse(order_stack.begin() + base, order_stack.end());
+    }
+}
+
+void BddEvaluator::rulesChanged(size_t new_fact_count, const std::vector<FactId>& cone) {
+    // 新しい事実は順位を持たず、初めて参照したときに末尾の順位が付く
+    fact_count = new_fact_count;
+    fact_level.resize(fact_count, NO_LEVEL);
+    roots.resize(fact_count, NO_ROOT);
+    is_true.resize(fact_count);
+    is_false.resize(fact_count);
+    proven_false.resize(fact_count);
+    failed.resize(fact_count);
+    initialized.resize(fact_count);
+    component_resolved.resize(rule_base.componentCount());
+    node_values.resize(rule_base.expressions.size());
+    node_epochs.resize(rule_base.expressions.size(), 0);
+    guard_values.resize(rule_base.expressions.size());
+    guard_internal.resize(rule_base.expressions.size(), 0);
+    guard_epochs.resize(rule_base.expressions.size(), 0);
+
+    // 下流の外の図は変わらないため残す (捨てた図のノードはマネージャに残る)
+    for (FactId id : cone) {
+        roots[id] = NO_ROOT;
+        failed.reset(id);
+        initialized.reset(id);
+        component_resolved.reset(rule_base.fact_component[id]);
+    }
+    epoch++; // 捨てた事実の図を指すメモを使わない
+}
+
+void BddEvaluator::initializeFact(FactId id) {
+    // resetFacts と同じく、初期事実なら TRUE、それ以外は FALSE
+    if (initialized.test(id)) return;
+    if (fact_level[id] == NO_LEVEL) {
+        fact_level[id] = static_cast<uint32_t>(level_fact.size());
+        level_fact.push_back(id);
+    }
+    const Node variable = manager.variable(fact_level[id]);
+    is_true[id] = variable;
+    is_false[id] = manager.negate(variable);
+    proven_false[id] = BddManager::FALSE_NODE;
+    initialized.set(id); // 未初期化の事実を参照するメモはないため epoch は進めない
+    attempt_facts.push_back(id);
+}
+
+bool BddEvaluator::compile(FactId id) {
+    if (id >= fact_count || failed.test(id)) return false;
+    if (roots[id] != NO_ROOT) return true;
+
+    if (order == BddOrder::DEPTH_FIRST) assignLevels(id);
+    const size_t mark = manager.size();
+    attempt_facts.clear();
+    attempt_components.clear();
+
+    bool ok = id >= rule_base.fact_component.size() || resolveComponents(rule_base.fact_component[id]);
+    if (ok) {
+        initializeFact(id);
+        const Node root = manager.combine(is_true[id], is_false[id]);
+        ok = !manager.exhausted();
+        if (ok) roots[id] = root;
+    }
+    if (!ok) {
+        discardAttempt(mark);
+        failed.set(id);
+    }
+    return ok;
+}
+
+void BddEvaluator::discardAttempt(size_t mark) {
+    manager.rollback(mark);
+    epoch++; // 捨てたノードを指すメモを使わない
+    for (FactId f : attempt_facts) initialized.reset(f);
+    for (uint32_t c : attempt_components) component_resolved.reset(c);
+    attempt_facts.clear();
+    attempt_components.clear();
+}
+
+FactState BddEvaluator::evaluate(FactId id, const Bitset& known) const {
+    if (id >= fact_count) return known.test(id) ? FactState::TRUE : FactState::FALSE;
+    const Node leaf = manager.evaluate(roots[id], [&](uint32_t level) { return known.test(level_fact[level]); });
+    if (leaf == BddManager::TRUE_NODE) return FactState::TRUE;
+    if (leaf == BddManager::FALSE_NODE) return FactState::FALSE;
+    return FactState::UNDETERMINED;
+}
+
+// BatchEvaluator::resolveComponents と同じ順序で成分を評価する
+bool BddEvaluator::resolveComponents(uint32_t root) {
+    if (component_resolved.test(root)) return true;
+    component_stack.clear();
+    component_stack.emplace_back(root, rule_base.dependency_begin[root]);
+    while (!component_stack.empty()) {
+        const uint32_t component = component_stack.back().first;
+        const uint32_t next = component_stack.back().second;
+        if (next < rule_base.dependency_end[component]) {
+            component_stack.back().second++;
+            const uint32_t dependency = rule_base.component_dependencies[next];
+            if (!component_resolved.test(dependency)) {
+                component_stack.emplace_back(dependency, rule_base.dependency_begin[dependency]);
+            }
+            continue;
+        }
+        if (!resolveComponent(component)) return false;
+        component_resolved.set(component);
+        attempt_components.push_back(component);
+        component_stack.pop_back();
+    }
+    return true;
+}
+
+// KnowledgeBase::resolveComponent と同じ手順を全シナリオについて同時に行う
+// 差分評価は位置順の全体走査と同じ結果になるため、ここでは変化がなくなるまで成分全体を走査する
+// (状態は FALSE < UNDETERMINED < TRUE の方向にしか変わらないため、各シナリオで逐次版と同じ不動点に達する)
+bool BddEvaluator::resolveComponent(uint32_t component) {
+    const bool cyclic = rule_base.cyclic_components.test(component);
+    const uint32_t fact_begin = rule_base.component_begin[component];
+    const uint32_t fact_end = rule_base.component_begin[component + 1];
+    const uint32_t slot_begin = rule_base.elimination_begin[component];
+    const uint32_t slot_end = rule_base.elimination_end[component];
+    for (uint32_t m = fact_begin; m < fact_end; ++m) initializeFact(rule_base.component_facts[m]);
+
+    bool changed = true;
+    while (changed && !manager.exhausted()) {
+        changed = false;
+
+        // 1. 各事実の偽の rail に、それを否定の結論とするルールの前提部が TRUE になる条件を加え (TRUE でなければ FALSE に下げる)、
+        //    それを結論とするルールの前提部との最大 (dual-rail では TRUE 側の OR、FALSE 側の AND) に上げる
+        for (uint32_t m = fact_begin; m < fact_end; ++m) {
+            const FactId id = rule_base.component_facts[m];
+            if (rule_base.negation_begin[id] < rule_base.negation_end[id]) {
+                Node fired = proven_false[id];
+                for (uint32_t i = rule_base.negation_begin[id]; i < rule_base.negation_end[id]; ++i) {
+                    const Rule& rule = rule_base.rules[rule_base.negated_rules[i]];
+                    if (cyclic && rule_base.readsComponent(rule, component)) continue; // 不動点の後で評価する
+                    fired = manager.apply(ExprNode::OpCode::OR, fired, evaluateRule(rule).first);
+                }
+                if (fired != proven_false[id] && proveFalse(id, fired)) changed = true;
+            }
+            if (id >= rule_base.rules_by_conclusion.size() || is_true[id] == BddManager::TRUE_NODE) continue;
+            Node best_true = is_true[id];
+            Node best_false = is_false[id];
+            for (size_t rule_index : rule_base.rules_by_conclusion[id]) {
+                const std::pair<Node, Node> premise = evaluateRule(rule_base.rules[rule_index], component);
+                best_true = manager.apply(ExprNode::OpCode::OR, best_true, premise.first);
+                best_false = manager.apply(ExprNode::OpCode::AND, best_false, premise.second);
+            }
+            // 偽と証明されたシナリオは TRUE にならない限り FALSE のまま
+            best_false = manager.apply(ExprNode::OpCode::OR, best_false,
+                                       manager.apply(ExprNode::OpCode::AND, proven_false[id], manager.negate(best_true)));
+            if (best_true == is_true[id] && best_false == is_false[id]) continue;
+            is_true[id] = best_true;
+            is_false[id] = best_false;
+            epoch++;
+            changed = true;
+        }
+
+        // 2. OR/XOR 結論の消去法: 前提部が TRUE で、この成分の TRUE でない選言肢がちょうど 1 つのシナリオでそれを TRUE にする
+        for (uint32_t e = slot_begin; e < slot_end; ++e) {
+            const Rule& rule = rule_base.rules[rule_base.component_eliminations[e]];
+            if (rule.removed) continue; // 実行時に取り除いたルールの位置
+            const Node single = singleOpen(rule);
+            if (single == BddManager::FALSE_NODE) continue;
+            const Node fired = manager.apply(ExprNode::OpCode::AND, evaluateRule(rule, component).first, single);
+            if (fired == BddManager::FALSE_NODE) continue;
+
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                const FactId id = rule_base.fact_pool[i];
+                if (rule_base.fact_component[id] != component) continue;
+                const Node promote = manager.apply(ExprNode::OpCode::AND, fired, manager.negate(is_true[id]));
+                if (promote == BddManager::FALSE_NODE) continue;
+                is_true[id] = manager.apply(ExprNode::OpCode::OR, is_true[id], promote);
+                is_false[id] = manager.apply(ExprNode::OpCode::AND, is_false[id], manager.negate(promote));
+                epoch++;
+                changed = true;
+            }
+        }
+    }
+    if (!cyclic || manager.exhausted()) return !manager.exhausted();
+
+    // 3. 成分内の事実を読む否定の結論 (すべての前提部を評価してから偽と証明する)
+    deferred_false.clear();
+    for (uint32_t m = fact_begin; m < fact_end; ++m) {
+        const FactId id = rule_base.component_facts[m];
+        Node fired = proven_false[id];
+        for (uint32_t i = rule_base.negation_begin[id]; i < rule_base.negation_end[id]; ++i) {
+            const Rule& rule = rule_base.rules[rule_base.negated_rules[i]];
+            if (rule_base.readsComponent(rule, component)) fired = manager.apply(ExprNode::OpCode::OR, fired, evaluateRule(rule).first);
+        }
+        if (fired != proven_false[id]) deferred_false.emplace_back(id, fired);
+    }
+    for (const std::pair<FactId, Node>& entry : deferred_false) proveFalse(entry.first, entry.second);
+    return !manager.exhausted();
+}
+
+bool BddEvaluator::proveFalse(FactId id, Node fired) {
+    // 偽の rail を fired にし、TRUE でないシナリオを FALSE に下げる (下げたシナリオがあれば true)
+    proven_false[id] = fired;
+    const Node lowered = manager.apply(ExprNode::OpCode::AND, fired, manager.negate(is_true[id]));
+    const Node pinned = manager.apply(ExprNode::OpCode::OR, is_false[id], lowered);
+    if (pinned == is_false[id]) return false;
+    is_false[id] = pinned;
+    epoch++;
+    return true;
+}
+
+BddEvaluator::Node BddEvaluator::singleOpen(const Rule& rule) {
+    // 結論部の先頭の事実と同じ成分の TRUE でない事実 (重複も数える) がちょうど 1 つになる条件 (BatchEvaluator::singleOpenLanes と同じ)
+    const uint32_t component = rule_base.fact_component[rule_base.fact_pool[rule.conclusion_facts_begin]];
+    Node one = BddManager::FALSE_NODE;
+    Node more = BddManager::FALSE_NODE;
+    for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+        const FactId id = rule_base.fact_pool[i];
+        if (rule_base.fact_component[id] != component) continue;
+        initializeFact(id);
+        const Node open = manager.negate(is_true[id]);
+        more = manager.apply(ExprNode::OpCode::OR, more, manager.apply(ExprNode::OpCode::AND, one, open));
+        one = manager.apply(ExprNode::OpCode::AND, manager.apply(ExprNode::OpCode::OR, one, open), manager.negate(more));
+    }
+    return one;
+}
+
+std::pair<BddManager::Node, BddManager::Node> BddEvaluator::nodeValue(ExprId id) {
+    const ExprNode& node = rule_base.expressions[id];
+    if (node.op == ExprNode::OpCode::LOAD || node.op == ExprNode::OpCode::LOAD_NOT) {
+        initializeFact(node.left);
+        if (node.op == ExprNode::OpCode::LOAD) return {is_true[node.left], is_false[node.left]};
+        return {is_false[node.left], is_true[node.left]};
+    }
+    return node_values[id];
+}
+
+std::pair<BddManager::Node, BddManager::Node> BddEvaluator::evaluateRule(const Rule& rule) {
+    // BatchEvaluator::evaluateRule の dual-rail 演算を BDD で行う
+    rule_base.expressions.evaluate(rule.premise, expression_stack,
+                                   [&](ExprId id) { return node_epochs[id] == epoch; },
+                                   [&](ExprId id) {
+                                       const ExprNode& node = rule_base.expressions[id];
+                                       const std::pair<Node, Node> l = nodeValue(node.left);
+                                       const std::pair<Node, Node> r = nodeValue(node.right);
+                                       node_values[id] = applyDualRail(node.op, l, r);
+                                       node_epochs[id] = epoch;
+                                   });
+    return nodeValue(rule.premise);
+}
+
+// KnowledgeBase::evaluateRule (成分の評価中) と同じ
+std::pair<BddManager::Node, BddManager::Node> BddEvaluator::evaluateRule(const Rule& rule, uint32_t component) {
+    if (rule_base.expressions.isMonotone(rule.premise) || !rule_base.cyclic_components.test(component)) return evaluateRule(rule);
+    return evaluateGuarded(rule.premise, component);
+}
+
+// KnowledgeBase::evaluateGuarded と同じく、否定や XOR を通して成分内の事実を読む部分式を全シナリオで UNDETERMINED とする
+std::pair<BddManager::Node, BddManager::Node> BddEvaluator::evaluateGuarded(ExprId root, uint32_t component) {
+    const std::pair<Node, Node> undetermined(BddManager::FALSE_NODE, BddManager::FALSE_NODE);
+    const uint64_t current = ++guard_epoch;
+    auto internal = [&](ExprId id) {
+        if (!rule_base.expressions.isFact(id)) return guard_internal[id] != 0;
+        return rule_base.fact_component[rule_base.expressions[id].left] == component;
+    };
+    auto value = [&](ExprId id) {
+        if (rule_base.expressions[id].op == ExprNode::OpCode::LOAD_NOT && internal(id)) return undetermined;
+        return rule_base.expressions.isFact(id) ? nodeValue(id) : guard_values[id];
+    };
+    rule_base.expressions.evaluate(root, expression_stack,
+                                   [&](ExprId id) { return guard_epochs[id] == current; },
+                                   [&](ExprId id) {
+                                       const ExprNode& node = rule_base.expressions[id];
+                                       guard_internal[id] = internal(node.left) || internal(node.right);
+                                       guard_values[id] = (node.op == ExprNode::OpCode::XOR && guard_internal[id])
+                                                              ? undetermined
+                                                              : applyDualRail(node.op, value(node.left), value(node.right));
+                                       guard_epochs[id] = current;
+                                   });
+    return value(root);
+}
+
+std::pair<BddManager::Node, BddManager::Node> BddEvaluator::applyDualRail(ExprNode::OpCode op, std::pair<Node, Node> l,
+                                                                          std::pair<Node, Node> r) {
+    if (op == ExprNode::OpCode::AND) {
+        return {manager.apply(ExprNode::OpCode::AND, l.first, r.first), manager.apply(ExprNode::OpCode::OR, l.second, r.second)};
+    }
+    if (op == ExprNode::OpCode::OR) {
+        return {manager.apply(ExprNode::OpCode::OR, l.first, r.first), manager.apply(ExprNode::OpCode::AND, l.second, r.second)};
+    }
+    // XOR: どちらかが未決定なら未決定
+    const Node determined = manager.apply(ExprNode::OpCode::AND,
+                                          manager.apply(ExprNode::OpCode::OR, l.first, l.second),
+                                          manager.apply(ExprNode::OpCode::OR, r.first, r.second));
+    const Node differ = manager.apply(ExprNode::OpCode::XOR, l.first, r.first);
+    return {manager.apply(ExprNode::OpCode::AND, determined, differ),
+            manager.apply(ExprNode::OpCode::AND, determined, manager.negate(differ))};
+}
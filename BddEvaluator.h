@@ -0,0 +1,101 @@
+#ifndef BDDEVALUATOR_H
+#define BDDEVALUATOR_H
+
+#include "BddManager.h"
+#include "Fact.h"
+#include "RuleBase.h"
+#include <cstdint>
+#include <vector>
+
+// BDD の変数順序 (事実 -> 順位) の決め方
+enum class BddOrder {
+    DEPTH_FIRST, // クエリから依存グラフを深さ優先でたどった順 (関係の深い事実が近くに並ぶ)
+    DECLARATION, // 事実 ID の順 (ファイルに現れた順)
+    FREQUENCY // ルールの前提部に現れる回数の多い順
+};
+
+// クエリの事実ごとに、結果を初期事実 (入力) の関数として表す BDD をコンパイルする評価器 (--bdd)
+// 後向き連鎖 (KnowledgeBase::resolveComponent) と同じ手順を、事実の状態を dual-rail の BDD の組
+// (TRUE になる条件, FALSE になる条件) として記号的に実行するため、結果は全てのシナリオで後向き連鎖と一致する
+// コンパイル後は、どの初期事実の組み合わせでも根から終端まで 1 度たどるだけで答えが決まる
+// ノード数が上限を超えたクエリはコンパイルをあきらめ (途中のノードは捨てる)、呼び出し元が通常のエンジンで評価する
+class BddEvaluator {
+    public:
+        static constexpr size_t DEFAULT_NODE_LIMIT = size_t(1) << 21;
+
+        // fact_count は評価で使う事実 ID の上限 (KnowledgeBase::facts.size())
+        BddEvaluator(const RuleBase& rule_base, size_t fact_count, BddOrder order, size_t node_limit);
+
+        size_t factCount() const { return fact_count; }
+        size_t nodeCount() const { return manager.size(); }
+
+        // id の図をコンパイルする (コンパイル済みなら何もしない)。ノード数の上限を超えた場合は false
+        bool compile(FactId id);
+        bool compiled(FactId id) const { return id < fact_count && roots[id] != NO_ROOT; }
+
+        // コンパイル済みの id を、known (事実 ID で引く初期事実) の下で評価する。スレッド安全
+        FactState evaluate(FactId id, const Bitset& known) const;
+
+        // ルールベースが実行時に変更された後に呼ぶ: cone (変更したルールの結論の下流) の事実の図だけを捨てる
+        // (成分を全体で作り直した場合は成分番号が変わるため、評価器を作り直す)
+        void rulesChanged(size_t new_fact_count, const std::vector<FactId>& cone);
+
+    private:
+        using Node = BddManager::Node;
+        static constexpr Node NO_ROOT = UINT32_MAX;
+        static constexpr uint32_t NO_LEVEL = UINT32_MAX;
+
+        const RuleBase& rule_base;
+        size_t fact_count;
+        const BddOrder order;
+        BddManager manager;
+
+        // 変数順序: 事実 -> 順位 と 順位 -> 事実
+        std::vector<uint32_t> fact_level;
+        std::vector<FactId> level_fact;
+
+        // コンパイル結果 (事実 ID で引く三値の図の根) と、上限を超えた事実
+        std::vector<Node> roots;
+        Bitset failed;
+
+        // 評価済みの事実の dual-rail の状態と成分 (コンパイルしたクエリの間で共有する)
+        std::vector<Node> is_true;
+        std::vector<Node> is_false;
+        std::vector<Node> proven_false; // 偽の rail (否定の結論で偽と証明される条件)
+        Bitset initialized;
+        Bitset component_resolved;
+        // 1 回のコンパイルで新たに評価したもの (上限を超えたら未評価に戻す)
+        std::vector<FactId> attempt_facts;
+        std::vector<uint32_t> attempt_components;
+
+        // 作業領域
+        std::vector<std::pair<uint32_t, uint32_t>> component_stack;
+        std::vector<FactId> order_stack;
+        // 式の節点ごとの評価結果のメモ (node_epochs[e] == epoch の間だけ有効)
+        // epoch は事実の図が変わるたびと、コンパイルをあきらめてノードを捨てたときに進める
+        std::vector<std::pair<Node, Node>> node_values;
+        std::vector<uint64_t> node_epochs;
+        uint64_t epoch = 1;
+        std::vector<ExprId> expression_stack;
+        // evaluateGuarded の作業領域 (guard_epochs[e] == guard_epoch の間だけ有効、呼び出しごとに進める)
+        std::vector<std::pair<Node, Node>> guard_values;
+        std::vector<uint8_t> guard_internal;
+        std::vector<uint64_t> guard_epochs;
+        uint64_t guard_epoch = 0;
+        std::vector<std::pair<FactId, Node>> deferred_false; // 循環を含む成分で、不動点の後に偽と証明する (事実, 偽の rail)
+
+        void assignLevels(FactId root); // DEPTH_FIRST: root から依存先をたどり、順位のない事実に順位を付ける
+        void initializeFact(FactId id);
+        bool resolveComponents(uint32_t root);
+        bool resolveComponent(uint32_t component);
+        std::pair<Node, Node> evaluateRule(const Rule& rule);
+        std::pair<Node, Node> evaluateRule(const Rule& rule, uint32_t component); // KnowledgeBase と同じ
+        std::pair<Node, Node> evaluateGuarded(ExprId root, uint32_t component);
+        bool proveFalse(FactId id, Node fired);
+        std::pair<Node, Node> nodeValue(ExprId id); // 事実の節点は初めて参照したときに変数を割り当てる
+        std::pair<Node, Node> applyDualRail(ExprNode::OpCode op, std::pair<Node, Node> l, std::pair<Node, Node> r);
+        Node singleOpen(const Rule& rule);
+        void discardAttempt(size_t mark);
+};
+
+#endif
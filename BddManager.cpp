@@ -0,0 +1,140 @@
+#include "BddManager.h"
+#include <algorithm>
+
+static constexpr uint32_t TERMINAL_LEVEL = UINT32_MAX;
+static constexpr BddManager::Node EMPTY_SLOT = UINT32_MAX;
+// computed cache の登録数 (2 のべき)
+static constexpr size_t CACHE_SIZE = size_t(1) << 18;
+// combine の computed cache 上の演算番号 (OpCode と重ならない値)
+static constexpr uint32_t COMBINE_OP = 0x100;
+
+static uint64_t hashTriple(uint32_t a, uint32_t b, uint32_t c) {
+    uint64_t h = a * 0x9E3779B97F4A7C15ULL;
+    h ^= (h >> 29) + b * 0xBF58476D1CE4E5B9ULL;
+    h ^= (h >> 31) + c * 0x94D049BB133111EBULL;
+    return h ^ (h >> 32);
+}
+
+BddManager::BddManager(size_t node_limit) : node_limit(std::max<size_t>(node_limit, 3)), cache(CACHE_SIZE) {
+    nodes.push_back({TERMINAL_LEVEL, FALSE_NODE, FALSE_NODE});
+    nodes.push_back({TERMINAL_LEVEL, TRUE_NODE, TRUE_NODE});
+    nodes.push_back({TERMINAL_LEVEL, UNDETERMINED_NODE, UNDETERMINED_NODE});
+    rebuildUnique(1024);
+}
+
+BddManager::Node BddManager::variable(uint32_t level) {
+    return makeNode(level, FALSE_NODE, TRUE_NODE);
+}
+
+size_t BddManager::uniqueSlot(uint32_t level, Node low, Node high) const {
+    return hashTriple(level, low, high) & (unique_table.size() - 1);
+}
+
+void BddManager::insertUnique(Node node) {
+    const Entry& entry = nodes[node];
+    size_t slot = uniqueSlot(entry.level, entry.low, entry.high);
+    while (unique_table[slot] != EMPTY_SLOT) slot = (slot + 1) & (unique_table.size() - 1);
+    unique_table[slot] = node;
+}
+
+void BddManager::rebuildUnique(size_t capacity) {
+    unique_table.assign(capacity, EMPTY_SLOT);
+    for (Node node = UNDETERMINED_NODE + 1; node < nodes.size(); ++node) insertUnique(node);
+}
+
+BddManager::Node BddManager::makeNode(uint32_t level, Node low, Node high) {
+    if (low == high) return low; // 冗長な分岐は作らない
+    size_t slot = uniqueSlot(level, low, high);
+    while (unique_table[slot] != EMPTY_SLOT) {
+        const Entry& entry = nodes[unique_table[slot]];
+        if (entry.level == level && entry.low == low && entry.high == high) return unique_table[slot];
+        slot = (slot + 1) & (unique_table.size() - 1);
+    }
+    if (nodes.size() >= node_limit) {
+        node_limit_reached = true;
+        return FALSE_NODE;
+    }
+
+    const Node node = static_cast<Node>(nodes.size());
+    nodes.push_back({level, low, high});
+    if (nodes.size() * 2 > unique_table.size()) {
+        rebuildUnique(unique_table.size() * 2);
+    } else {
+        unique_table[slot] = node;
+    }
+    return node;
+}
+
+BddManager::CacheEntry& BddManager::cacheEntry(uint32_t op, Node left, Node right) {
+    return cache[hashTriple(op, left, right) & (CACHE_SIZE - 1)];
+}
+
+BddManager::Node BddManager::apply(ExprNode::OpCode op, Node left, Node right) {
+    if (node_limit_reached) return FALSE_NODE;
+
+    // 終端の規則
+    if (op == ExprNode::OpCode::AND) {
+        if (left == FALSE_NODE || right == FALSE_NODE) return FALSE_NODE;
+        if (left == TRUE_NODE || left == right) return right;
+        if (right == TRUE_NODE) return left;
+    } else if (op == ExprNode::OpCode::OR) {
+        if (left == TRUE_NODE || right == TRUE_NODE) return TRUE_NODE;
+        if (left == FALSE_NODE || left == right) return right;
+        if (right == FALSE_NODE) return left;
+    } else {
+        if (left == right) return FALSE_NODE;
+        if (left == FALSE_NODE) return right;
+        if (right == FALSE_NODE) return left;
+    }
+    if (left > right) std::swap(left, right); // 可換なので順序をそろえてキャッシュを共有する
+
+    const uint32_t op_code = static_cast<uint32_t>(op);
+    CacheEntry& cached = cacheEntry(op_code, left, right);
+    if (cached.op == op_code && cached.left == left && cached.right == right) return cached.result;
+
+    // 上の変数で場合分けして子に適用する
+    const Entry l = nodes[left];
+    const Entry r = nodes[right];
+    const uint32_t level = std::min(l.level, r.level);
+    const Node low = apply(op, l.level == level ? l.low : left, r.level == level ? r.low : right);
+    const Node high = apply(op, l.level == level ? l.high : left, r.level == level ? r.high : right);
+    const Node result = makeNode(level, low, high);
+    if (node_limit_reached) return FALSE_NODE;
+
+    // 再帰の間にキャッシュが書き換わっている場合があるため引き直す
+    CacheEntry& entry = cacheEntry(op_code, left, right);
+    entry = {op_code, left, right, result};
+    return result;
+}
+
+BddManager::Node BddManager::combine(Node is_true, Node is_false) {
+    if (node_limit_reached) return FALSE_NODE;
+    if (is_true == TRUE_NODE) return TRUE_NODE;
+    if (is_false == TRUE_NODE) return FALSE_NODE;
+    if (is_true == FALSE_NODE && is_false == FALSE_NODE) return UNDETERMINED_NODE;
+
+    CacheEntry& cached = cacheEntry(COMBINE_OP, is_true, is_false);
+    if (cached.op == COMBINE_OP && cached.left == is_true && cached.right == is_false) return cached.result;
+
+    const Entry t = nodes[is_true];
+    const Entry f = nodes[is_false];
+    const uint32_t level = std::min(t.level, f.level);
+    const Node low = combine(t.level == level ? t.low : is_true, f.level == level ? f.low : is_false);
+    const Node high = combine(t.level == level ? t.high : is_true, f.level == level ? f.high : is_false);
+    const Node result = makeNode(level, low, high);
+    if (node_limit_reached) return FALSE_NODE;
+
+    CacheEntry& entry = cacheEntry(COMBINE_OP, is_true, is_false);
+    entry = {COMBINE_OP, is_true, is_false, result};
+    return result;
+}
+
+void BddManager::rollback(size_t mark) {
+    if (mark < nodes.size()) {
+        nodes.resize(std::max<size_t>(mark, UNDETERMINED_NODE + 1));
+        rebuildUnique(unique_table.size());
+    }
+    // 捨てたノードを指す結果が残らないようにキャッシュは全て捨てる
+    std::fill(cache.begin(), cache.end(), CacheEntry());
+    node_limit_reached = false;
+}
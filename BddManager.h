@@ -0,0 +1,78 @@
+#ifndef BDDMANAGER_H
+#define BDDMANAGER_H
+
+#include "Expression.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 既約順序付き二分決定図 (ROBDD) のノード管理
+// ノードは (変数の順位, 0 側の子, 1 側の子) の組を unique table で一意にし、同じ関数は必ず同じノード番号になる
+// 演算結果は computed cache (直接写像、上書きあり) に記録して再計算を避ける
+// ノードは追記するだけで解放しない。ノード数が上限に達すると以降の演算は打ち切られ、exhausted() が true になる
+class BddManager {
+    public:
+        using Node = uint32_t;
+
+        // 終端ノード。UNDETERMINED は combine で作る三値の図だけに現れる
+        static constexpr Node FALSE_NODE = 0;
+        static constexpr Node TRUE_NODE = 1;
+        static constexpr Node UNDETERMINED_NODE = 2;
+
+        explicit BddManager(size_t node_limit);
+
+        // 順位 level の変数そのものを表す図
+        Node variable(uint32_t level);
+
+        // 二項演算 (AND / OR / XOR) と否定
+        Node apply(ExprNode::OpCode op, Node left, Node right);
+        Node negate(Node node) { return apply(ExprNode::OpCode::XOR, node, TRUE_NODE); }
+
+        // dual-rail の組 (TRUE になる条件, FALSE になる条件) を TRUE / FALSE / UNDETERMINED の終端を持つ 1 つの図にまとめる
+        Node combine(Node is_true, Node is_false);
+
+        // 入力 (順位 -> 値) に従って根から終端までたどる
+        template <typename Input>
+        Node evaluate(Node node, Input input) const {
+            while (node > UNDETERMINED_NODE) {
+                const Entry& entry = nodes[node];
+                node = input(entry.level) ? entry.high : entry.low;
+            }
+            return node;
+        }
+
+        size_t size() const { return nodes.size(); }
+        bool exhausted() const { return node_limit_reached; }
+
+        // mark 以降に作ったノードを捨て、上限に達した状態を解除する (mark は以前の size())
+        void rollback(size_t mark);
+
+    private:
+        struct Entry {
+            uint32_t level; // 終端は UINT32_MAX (どの変数よりも下)
+            Node low;
+            Node high;
+        };
+        struct CacheEntry {
+            uint32_t op = UINT32_MAX;
+            Node left = 0;
+            Node right = 0;
+            Node result = 0;
+        };
+
+        const size_t node_limit;
+        bool node_limit_reached = false;
+        std::vector<Entry> nodes;
+
+        // unique table: ノード番号の開番地法ハッシュ表 (容量は 2 のべき、負荷率 1/2 以下)
+        std::vector<Node> unique_table;
+        std::vector<CacheEntry> cache;
+
+        Node makeNode(uint32_t level, Node low, Node high);
+        void insertUnique(Node node);
+        void rebuildUnique(size_t capacity);
+        size_t uniqueSlot(uint32_t level, Node low, Node high) const;
+        CacheEntry& cacheEntry(uint32_t op, Node left, Node right);
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "ExpertSystem.h"
+#include <stdexcept>
+
+ExpertSystem::ExpertSystem(InferenceMode mode) {
+    kb.mode = mode;
+}
+
+void ExpertSystem::beginLoad() {
+    // 読み込みは 1 度だけ (RuleBase の索引と成分は読み込みの最後に作り、以後の変更は addRule / removeRule で差分を反映する)
+    if (loaded) throw std::runtime_error("Error: A knowledge base is already loaded");
+    loaded = true;
+}
+
+void ExpertSystem::loadFile(const std::string& filename) {
+    beginLoad();
+    kb.loadFromFile(filename);
+}
+
+void ExpertSystem::loadBuffer(std::string_view buffer) {
+    beginLoad();
+    kb.loadFromBuffer(buffer);
+}
+
+void ExpertSystem::clearFacts() {
+    for (FactId id = 0; id < kb.facts.size(); ++id) {
+        if (kb.facts.isKnown(id)) kb.setInitialFact(id, false);
+    }
+}
+
+size_t ExpertSystem::addRule(std::string_view rule_line) {
+    RuleUpdate update;
+    kb.updateRules({}, {rule_line}, update);
+    return update.added_rules;
+}
+
+size_t ExpertSystem::removeRule(std::string_view rule_line) {
+    std::vector<size_t> removed;
+    kb.findRules(rule_line, removed);
+    RuleUpdate update;
+    kb.updateRules(removed, {}, update);
+    return update.removed_rules;
+}
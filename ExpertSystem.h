@@ -0,0 +1,60 @@
+#ifndef EXPERTSYSTEM_H
+#define EXPERTSYSTEM_H
+
+#include "KnowledgeBase.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 組み込み用の API (libexpert_system)
+// 知識ベースの読み込み・初期事実の設定・クエリの評価だけを提供し、標準出力には何も書かない
+// 結果は呼び出し元が確保した配列に書き込み、初期事実を変えながら評価を繰り返す間は変更の下流だけを再計算する
+// (後向き連鎖では、同じ知識ベースに対する 2 回目以降の評価で領域を確保し直さない)
+// エラーは std::runtime_error で報告する。スレッド安全ではないため、スレッドごとにインスタンスを持つか、
+// 多数のシナリオは knowledgeBase() を BatchRunner に渡して評価する
+class ExpertSystem {
+    public:
+        explicit ExpertSystem(InferenceMode mode = InferenceMode::BACKWARD);
+
+        // 知識ベースを読み込む (テキストまたは --compile のイメージ、buffer はファイル内容と同じ形式)。1 度だけ呼べる
+        void loadFile(const std::string& filename);
+        void loadBuffer(std::string_view buffer);
+
+        void setMode(InferenceMode mode) { kb.setMode(mode); }
+
+        // 読み込み後にルールを 1 行 ("=>" / "<=>") 単位で追加・削除し、作られた (取り除いた) ルールの数を返す
+        // 削除は同じ式のルールを探す。索引と推論結果は変更の下流だけを更新する
+        size_t addRule(std::string_view rule_line);
+        size_t removeRule(std::string_view rule_line);
+
+        // 事実は読み込み時に登録された ID で扱う (未登録の名前は NO_FACT)
+        size_t factCount() const { return kb.facts.size(); }
+        FactId findFact(std::string_view name) const { return kb.facts.find(name); }
+        std::string_view factName(FactId id) const { return kb.facts.name(id); }
+        const std::vector<FactId>& queries() const { return kb.queries; } // ファイルの '?' 行
+
+        // 初期事実 (読み込み直後はファイルの '=' 行)
+        void setFact(FactId id, bool value) { kb.setInitialFact(id, value); }
+        bool isFactSet(FactId id) const { return kb.facts.isKnown(id); }
+        void clearFacts();
+
+        // query_ids[0, count) を現在の初期事実の下で評価し、results[0, count) に書き込む
+        void evaluate(const FactId* query_ids, size_t count, FactState* results) {
+            kb.evaluateQueries(query_ids, count, results);
+        }
+        // ファイルのクエリを評価する (results は queries().size() 個)
+        void evaluateQueries(FactState* results) { evaluate(kb.queries.data(), kb.queries.size(), results); }
+
+        // 計測や BatchRunner / QueryServer など、知識ベースを直接扱う場合
+        KnowledgeBase& knowledgeBase() { return kb; }
+        const KnowledgeBase& knowledgeBase() const { return kb; }
+
+    private:
+        KnowledgeBase kb;
+        bool loaded = false;
+
+        void beginLoad();
+};
+
+#endif
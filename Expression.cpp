@@ -0,0 +1,91 @@
+#include "Expression.h"
+
+static uint64_t hashNode(const ExprNode& node) {
+    uint64_t h = (static_cast<uint64_t>(node.left) << 32 | node.right) * 0x9E3779B97F4A7C15ULL;
+    h ^= static_cast<uint64_t>(node.op) * 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 29);
+}
+
+static bool sameNode(const ExprNode& a, const ExprNode& b) {
+    return a.op == b.op && a.left == b.left && a.right == b.right;
+}
+
+ExprId ExpressionArena::fact(FactId id, bool negated) {
+    return intern({negated ? ExprNode::OpCode::LOAD_NOT : ExprNode::OpCode::LOAD, id, 0});
+}
+
+ExprId ExpressionArena::binary(ExprNode::OpCode op, ExprId left, ExprId right) {
+    return intern({op, left, right});
+}
+
+ExprId ExpressionArena::find(const ExprNode& node) const {
+    if (table.empty()) return NO_EXPR;
+    size_t slot = hashNode(node) & (table.size() - 1);
+    while (table[slot] != NO_EXPR) {
+        if (sameNode(nodes[table[slot]], node)) return table[slot];
+        slot = (slot + 1) & (table.size() - 1);
+    }
+    return NO_EXPR;
+}
+
+ExprId ExpressionArena::intern(ExprNode node) {
+    if (table.mapped()) {
+        nodes.own();
+        monotone.own();
+        table.own();
+    }
+    if (table.empty()) rebuildTable(64);
+    size_t slot = hashNode(node) & (table.size() - 1);
+    while (table[slot] != NO_EXPR) {
+        if (sameNode(nodes[table[slot]], node)) return table[slot];
+        slot = (slot + 1) & (table.size() - 1);
+    }
+
+    const ExprId id = static_cast<ExprId>(nodes.size());
+    nodes.push_back(node);
+    monotone.push_back(monotoneNode(node));
+    if (nodes.size() * 2 > table.size()) {
+        rebuildTable(table.size() * 2);
+    } else {
+        table[slot] = id;
+    }
+    return id;
+}
+
+bool ExpressionArena::monotoneNode(const ExprNode& node) const {
+    if (node.op == ExprNode::OpCode::LOAD) return true;
+    if (node.op == ExprNode::OpCode::LOAD_NOT || node.op == ExprNode::OpCode::XOR) return false;
+    return monotone[node.left] && monotone[node.right];
+}
+
+void ExpressionArena::rebuildTable(size_t capacity) {
+    table.assign(capacity, NO_EXPR);
+    for (ExprId id = 0; id < nodes.size(); ++id) {
+        size_t slot = hashNode(nodes[id]) & (capacity - 1);
+        while (table[slot] != NO_EXPR) slot = (slot + 1) & (capacity - 1);
+        table[slot] = id;
+    }
+}
+
+void ExpressionArena::mapRaw(const ExprNode* raw_nodes, const uint8_t* raw_monotone, size_t node_count,
+                             const ExprId* raw_table, size_t table_size) {
+    nodes.map(raw_nodes, node_count);
+    monotone.map(raw_monotone, node_count);
+    table.map(raw_table, table_size);
+}
+
+void ExpressionArena::collectFacts(ExprId id, std::vector<FactId>& out) const {
+    // 左の子から先に取り出すよう右の子を先に積む
+    std::vector<ExprId> stack = {id};
+    while (!stack.empty()) {
+        const ExprNode& node = nodes[stack.back()];
+        const bool leaf = isFact(stack.back());
+        stack.pop_back();
+        if (leaf) {
+            out.push_back(node.left);
+        } else {
+            stack.push_back(node.right);
+            stack.push_back(node.left);
+        }
+    }
+}
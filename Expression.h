@@ -2,71 +2,84 @@
 #define EXPRESSION_H
 
 #include "Fact.h"
-#include <memory>
+#include "FlatArray.h"
+#include <cstdint>
 #include <vector>
-#include <string>
 
-class KnowledgeBase;
-
-class Expression {
-    public:
-        virtual FactState evaluate(KnowledgeBase& kb) = 0;
-        virtual std::vector<char> getFacts() const = 0; // 式に含まれる事実を収集
-        virtual bool isOrXor() const { return false; } // 結論部のOR/XOR判定用
-        virtual std::string to_string() const = 0; // デバッグ/可視化用
-        virtual ~Expression() = default;
+// 式の節点 (ExpressionArena の添字 ExprId で参照する)
+// LOAD/LOAD_NOT は事実 left の状態 (またはその否定)、AND/OR/XOR は節点 left と right の演算結果
+struct ExprNode {
+    enum class OpCode : uint8_t { LOAD, LOAD_NOT, AND, OR, XOR };
+    OpCode op;
+    uint32_t left;
+    uint32_t right; // LOAD/LOAD_NOT では 0
 };
 
-// 葉ノード：事実（A, B, Cなど）
-class FactExpression : public Expression {
-    public:
-        char factSymbol;
-        bool isNegated; // 否定(!)されているか
-
-        FactExpression(char symbol, bool negated) : factSymbol(symbol), isNegated(negated) {}
+using ExprId = uint32_t;
+constexpr ExprId NO_EXPR = UINT32_MAX;
 
-        FactState evaluate(KnowledgeBase& kb) override;
-        
-        std::vector<char> getFacts() const override {
-            return {factSymbol};
-        }
-        
-        std::string to_string() const override {
-            return (isNegated ? "!" : "") + std::string(1, factSymbol);
-        }
-};
-
-// 中間ノード：二項演算子 (+, |, ^)
-class BinaryOperation : public Expression {
+// 論理式の DAG。節点は 1 本の配列 (arena) に追記するだけで個別には確保・解放しない
+// 同じ (演算, 子) の節点はハッシュ表で 1 つにまとめる (ハッシュコンシング) ため、
+// AND 分解や <=> で複数のルールに現れる前提部や、ルール間で共通の部分式は 1 度だけ格納される
+// 子は常に親より前に追加されるので、添字の昇順がそのまま評価できる順序になる
+class ExpressionArena {
     public:
-        enum class Operator { AND, OR, XOR };
-        Operator op;
-        std::unique_ptr<Expression> left;
-        std::unique_ptr<Expression> right;
+        ExprId fact(FactId id, bool negated);
+        ExprId binary(ExprNode::OpCode op, ExprId left, ExprId right);
+        // 同じ節点が登録済みならその ID、なければ NO_EXPR (登録はしない)
+        ExprId find(const ExprNode& node) const;
 
-        BinaryOperation(Operator op, std::unique_ptr<Expression> left, std::unique_ptr<Expression> right)
-            : op(op), left(std::move(left)), right(std::move(right)) {}
+        const ExprNode& operator[](ExprId id) const { return nodes[id]; }
+        size_t size() const { return nodes.size(); }
+        bool isFact(ExprId id) const { return nodes[id].op <= ExprNode::OpCode::LOAD_NOT; }
+        // id の式が否定と XOR を含まない (参照する事実の状態について単調な) とき true
+        bool isMonotone(ExprId id) const { return monotone[id] != 0; }
 
-        FactState evaluate(KnowledgeBase& kb) override;
+        // id の式に現れる事実を左から順に out の末尾に追加する (重複も含む)
+        void collectFacts(ExprId id, std::vector<FactId>& out) const;
 
-        std::vector<char> getFacts() const override {
-            std::vector<char> facts = left->getFacts();
-            std::vector<char> right_facts = right->getFacts();
-            facts.insert(facts.end(), right_facts.begin(), right_facts.end());
-            return facts;
+        // root の部分式のうち ready でない二項演算の節点を、両方の子が ready になってから 1 度ずつ compute に渡す
+        // (帰りがけ順。事実の節点は常に ready とみなす)。評価器はメモ済みの節点を ready として部分式の共有を生かす
+        // 深い式でも再帰しないよう、stack (呼び出し元の作業領域) に未処理の節点を積む
+        template <typename Ready, typename Compute>
+        void evaluate(ExprId root, std::vector<ExprId>& stack, Ready ready, Compute compute) const {
+            if (isFact(root) || ready(root)) return;
+            const size_t base = stack.size();
+            stack.push_back(root);
+            while (stack.size() > base) {
+                const ExprId id = stack.back();
+                if (ready(id)) { // 同じ部分式を 2 度積んだ場合
+                    stack.pop_back();
+                    continue;
+                }
+                const ExprNode& node = nodes[id];
+                const bool left_ready = isFact(node.left) || ready(node.left);
+                const bool right_ready = isFact(node.right) || ready(node.right);
+                if (left_ready && right_ready) {
+                    stack.pop_back();
+                    compute(id);
+                    continue;
+                }
+                if (!right_ready) stack.push_back(node.right);
+                if (!left_ready) stack.push_back(node.left);
+            }
         }
 
-        bool isOrXor() const override { 
-            return op == Operator::OR || op == Operator::XOR; 
-        }
+        // バイナリイメージとの相互変換用に内部配列をそのまま読み書きする (子が親より前にあること。再ハッシュしない)
+        const FlatArray<ExprNode>& rawNodes() const { return nodes; }
+        const FlatArray<uint8_t>& rawMonotone() const { return monotone; }
+        const FlatArray<ExprId>& rawTable() const { return table; }
+        void mapRaw(const ExprNode* raw_nodes, const uint8_t* raw_monotone, size_t node_count, const ExprId* raw_table,
+                    size_t table_size);
 
-        std::string to_string() const override {
-            std::string op_str;
-            if (op == Operator::AND) op_str = "+";
-            else if (op == Operator::OR) op_str = "|";
-            else if (op == Operator::XOR) op_str = "^";
-            return "(" + left->to_string() + op_str + right->to_string() + ")";
-        }
+    private:
+        FlatArray<ExprNode> nodes;
+        FlatArray<uint8_t> monotone; // 節点ごとの isMonotone (追加時に子から求める)
+        FlatArray<ExprId> table; // 開番地法のハッシュ表 (容量は 2 のべき、負荷率 1/2 以下)
+
+        ExprId intern(ExprNode node);
+        bool monotoneNode(const ExprNode& node) const;
+        void rebuildTable(size_t capacity);
 };
 
 #endif
@@ -1,7 +1,11 @@
 #ifndef FACT_H
 #define FACT_H
 
+#include "SymbolTable.h"
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Rule;
@@ -14,15 +18,215 @@ enum class FactState {
     PROCESSING // 無限ループ検出用：現在推論中の状態
 };
 
-class Fact {
+// 事実の密な整数ID (FactTable への添字)
+using FactId = uint32_t;
+constexpr FactId NO_FACT = SymbolTable::NOT_FOUND;
+
+// 64ビット語単位のビット集合
+class Bitset {
     public:
-        char symbol = '\0';
-        FactState currentState = FactState::FALSE; // デフォルトは偽
-        bool isProcessing = false; // 推論中のフラグ
+        void resize(size_t bits) { words.resize((bits + 63) / 64, 0); bit_count = bits; }
+        size_t size() const { return bit_count; }
+        bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+        void set(size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+        void reset(size_t i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+        void assign(size_t i, bool value) { value ? set(i) : reset(i); }
+        void clear() { std::fill(words.begin(), words.end(), 0); }
+        void copyFrom(const Bitset& other) { words = other.words; bit_count = other.bit_count; } // 同じサイズ同士なら再確保しない
+        // [from, end) で最初に立っているビットの位置 (なければ end)
+        size_t findNext(size_t from, size_t end) const {
+            while (from < end) {
+                uint64_t word = words[from >> 6] >> (from & 63);
+                if (word != 0) return std::min(end, from + __builtin_ctzll(word));
+                from = (from | 63) + 1;
+            }
+            return end;
+        }
+
+        std::vector<uint64_t> words;
+        size_t bit_count = 0;
+};
+
+// ボーナス: 推論の可視化のための導出記録 (証明 DAG の辺)
+// 事実 -> それを TRUE にした (NEGATION では偽と証明した) ルール -> 裏付けとなる事実 (RULE は前提部の事実、ELIMINATION は他の選言肢) をたどる
+// 裏付けの事実はルール側 (RuleBase::fact_pool) にあるため、ここではルール番号だけを記録し、説明文は表示時に作る
+enum class DerivationKind : uint8_t {
+    RULE, // 前提部が TRUE のルールから導出
+    ELIMINATION, // OR/XOR 結論の消去法で確定
+    NEGATION // 前提部が TRUE の否定の結論 (例: E + F => !V) から偽と証明
+};
+
+struct Derivation {
+    FactId fact;
+    uint32_t rule;
+    uint32_t next; // 同じ事実の 1 つ前の導出 (NO_DERIVATION で終端)
+    DerivationKind kind;
+};
+
+constexpr uint32_t NO_DERIVATION = UINT32_MAX;
+
+// 全事実の状態を ID で引く Structure-of-Arrays 形式の表
+// 真偽 (true/undetermined の2ビット) と初期事実 (known) をそれぞれビット集合で持つ
+// 否定の結論で偽と証明された事実は別のビット集合 (false_bits) に持ち、TRUE の rail と両方立った事実を矛盾とする
+// 偽と証明された事実は TRUE にならない限り FALSE のまま (UNDETERMINED に上げる setState は FALSE に留まる)
+class FactTable {
+    public:
+        // 識別子を ID に変換 (未登録なら FALSE の事実として追加)
+        FactId intern(std::string_view name) {
+            FactId id = symbols.intern(name);
+            if (id >= true_bits.size()) {
+                true_bits.resize(id + 1);
+                undetermined_bits.resize(id + 1);
+                false_bits.resize(id + 1);
+                known_bits.resize(id + 1);
+                last_derivation.resize(id + 1, NO_DERIVATION);
+            }
+            return id;
+        }
+
+        FactId find(std::string_view name) const { return symbols.find(name); }
+        std::string_view name(FactId id) const { return symbols.name(id); }
+        size_t size() const { return symbols.size(); }
+        void reserve(size_t count) { symbols.reserve(count); }
+
+        // 識別子の表をまとめて差し替える (バイナリイメージからの読み込み用、全事実は FALSE になる)
+        const SymbolTable& symbolTable() const { return symbols; }
+        void assignSymbols(SymbolTable table) {
+            symbols = std::move(table);
+            for (Bitset* bits : {&true_bits, &undetermined_bits, &false_bits, &known_bits}) {
+                bits->words.assign((symbols.size() + 63) / 64, 0);
+                bits->bit_count = symbols.size();
+            }
+            last_derivation.assign(symbols.size(), NO_DERIVATION);
+            derivations.clear();
+            state_version++;
+        }
+
+        FactState state(FactId id) const {
+            if (true_bits.test(id)) return FactState::TRUE;
+            if (undetermined_bits.test(id)) return FactState::UNDETERMINED;
+            return FactState::FALSE;
+        }
+        void setState(FactId id, FactState state) {
+            if (state == FactState::UNDETERMINED && false_bits.test(id)) state = FactState::FALSE;
+            if (this->state(id) == state) return;
+            true_bits.assign(id, state == FactState::TRUE);
+            undetermined_bits.assign(id, state == FactState::UNDETERMINED);
+            state_version++;
+        }
+
+        // 偽の rail: id を偽と証明する。UNDETERMINED から FALSE に下がったら true
+        // (TRUE の事実は TRUE のまま矛盾になる。どちらの場合も判定はビット 2 つの AND で済む)
+        bool isProvenFalse(FactId id) const { return false_bits.test(id); }
+        bool proveFalse(FactId id) {
+            false_bits.set(id);
+            if (!undetermined_bits.test(id)) return false;
+            undetermined_bits.reset(id);
+            state_version++;
+            return true;
+        }
+        bool contradicts(FactId id) const { return true_bits.test(id) && false_bits.test(id); }
+
+        // 矛盾している (両方の rail が立った) 事実を ID 順に out に書き込む (64 事実ずつ語単位の AND で探す)
+        void contradictions(std::vector<FactId>& out) const {
+            out.clear();
+            for (size_t w = 0; w < false_bits.words.size(); ++w) {
+                for (uint64_t both = true_bits.words[w] & false_bits.words[w]; both != 0; both &= both - 1) {
+                    out.push_back(static_cast<FactId>(w * 64 + __builtin_ctzll(both)));
+                }
+            }
+        }
+
+        // 事実の状態が変わるたびに増える番号 (部分式の評価結果のメモが今の状態に対するものかの判定に使う)
+        uint64_t version() const { return state_version; }
+
+        // 初期事実 (入力ファイルの '=' 行やインタラクティブモードで TRUE に設定されたもの)
+        bool isKnown(FactId id) const { return known_bits.test(id); }
+        void setKnown(FactId id, bool value) { known_bits.assign(id, value); }
+        void clearKnown() { known_bits.clear(); }
+        const Bitset& knownBits() const { return known_bits; }
+
+        // 導出の記録 (共有の領域に追記するだけで、リセット後は確保済みの容量を再利用する)
+        // 無効化した事実の古い導出は領域に残るため、前回の整理後の 2 倍に達したら整理する
+        void addDerivation(FactId id, size_t rule_index, DerivationKind kind) {
+            if (derivations.size() >= compact_threshold) compactDerivations();
+            derivations.push_back({id, static_cast<uint32_t>(rule_index), last_derivation[id], kind});
+            last_derivation[id] = static_cast<uint32_t>(derivations.size() - 1);
+        }
+        void clearDerivations(FactId id) { last_derivation[id] = NO_DERIVATION; }
+
+        // id の導出を記録した順に out に書き込む
+        void derivationsOf(FactId id, std::vector<Derivation>& out) const {
+            out.clear();
+            for (uint32_t d = last_derivation[id]; d != NO_DERIVATION; d = derivations[d].next) {
+                out.push_back(derivations[d]);
+            }
+            std::reverse(out.begin(), out.end());
+        }
+
+        // 1 つの事実の推論結果だけを捨てて初期状態に戻す
+        void invalidate(FactId id) {
+            false_bits.reset(id);
+            setState(id, isKnown(id) ? FactState::TRUE : FactState::FALSE);
+            clearDerivations(id);
+        }
+
+        // 推論結果を捨てて初期事実のみ TRUE の状態に戻す (語単位のコピー)
+        void reset() {
+            true_bits.copyFrom(known_bits);
+            undetermined_bits.clear();
+            false_bits.clear();
+            state_version++;
+            for (const Derivation& d : derivations) last_derivation[d.fact] = NO_DERIVATION;
+            derivations.clear();
+        }
+
+        // ids の事実だけを初期状態に戻す (クエリの影響範囲だけを評価する場合。導出はその範囲でしか記録されない)
+        void reset(const std::vector<FactId>& ids) {
+            for (FactId id : ids) {
+                false_bits.reset(id);
+                setState(id, isKnown(id) ? FactState::TRUE : FactState::FALSE);
+            }
+            for (const Derivation& d : derivations) last_derivation[d.fact] = NO_DERIVATION;
+            derivations.clear();
+        }
+
+    private:
+        SymbolTable symbols;
+
+        Bitset true_bits;
+        Bitset undetermined_bits;
+        Bitset false_bits; // 否定の結論で偽と証明された事実
+        Bitset known_bits;
+        uint64_t state_version = 1;
+
+        std::vector<uint32_t> last_derivation; // 事実ごとの最新の導出 (derivations への添字)
+        std::vector<Derivation> derivations;
+        size_t compact_threshold = 4096;
+        std::vector<uint32_t> derivation_remap; // compactDerivations の作業領域
 
-        // ボーナス: 推論の可視化のための履歴
-        std::vector<std::string> true_reasons; 
-        std::string final_state_reason;
+        // どの事実の鎖からもたどれない導出を捨てて詰める (鎖の順序は保つ)
+        // next は常に古い (小さい) 添字を指すため、新しい順に見れば生きている導出の next も生きていると分かる
+        void compactDerivations() {
+            derivation_remap.assign(derivations.size(), NO_DERIVATION);
+            for (size_t d = derivations.size(); d-- > 0;) {
+                const Derivation& derivation = derivations[d];
+                if (derivation_remap[d] == NO_DERIVATION && last_derivation[derivation.fact] != d) continue;
+                derivation_remap[d] = 0; // 生きている印 (添字は次で決める)
+                if (derivation.next != NO_DERIVATION) derivation_remap[derivation.next] = 0;
+            }
+            size_t live = 0;
+            for (size_t d = 0; d < derivations.size(); ++d) {
+                if (derivation_remap[d] == NO_DERIVATION) continue;
+                derivation_remap[d] = static_cast<uint32_t>(live);
+                Derivation derivation = derivations[d];
+                if (derivation.next != NO_DERIVATION) derivation.next = derivation_remap[derivation.next];
+                if (last_derivation[derivation.fact] == d) last_derivation[derivation.fact] = static_cast<uint32_t>(live);
+                derivations[live++] = derivation;
+            }
+            derivations.resize(live);
+            compact_threshold = std::max<size_t>(4096, live * 2);
+        }
 };
 
 #endif
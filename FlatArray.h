@@ -0,0 +1,186 @@
+#ifndef FLATARRAY_H
+#define FLATARRAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// バイナリイメージのマップした領域をそのまま指す配列、または自前の std::vector
+// イメージから読み込んだ配列は変更するまで複製しない (複数のプロセスが同じページを共有し、読み込みは領域を指すだけで済む)
+// 要素を増減する操作は自前の領域に写してから行う。マップした領域は読み取り専用のため、
+// 添字で書き換える前には own() を呼ぶ (RuleBase は変更の入口でまとめて呼ぶ)
+template <typename T>
+class FlatArray {
+    public:
+        FlatArray() = default;
+        FlatArray(std::initializer_list<T> values) : owned(values) { sync(); }
+        FlatArray(const FlatArray& other) : owned(other.owned) { adopt(other); }
+        FlatArray(FlatArray&& other) noexcept : owned(std::move(other.owned)) { adopt(other); other.reset(); }
+        FlatArray& operator=(const FlatArray& other) {
+            if (this != &other) {
+                owned = other.owned;
+                adopt(other);
+            }
+            return *this;
+        }
+        FlatArray& operator=(FlatArray&& other) noexcept {
+            if (this != &other) {
+                owned = std::move(other.owned);
+                adopt(other);
+                other.reset();
+            }
+            return *this;
+        }
+
+        // 長さ size の領域 data を指す (領域は呼び出し元がこの配列より長く保持する)
+        void map(const T* data, size_t size) {
+            std::vector<T>().swap(owned);
+            items = const_cast<T*>(data);
+            count = size;
+            is_mapped = true;
+        }
+        bool mapped() const { return is_mapped; }
+        // マップした領域を自前の領域に写す (自前の領域なら何もしない)
+        void own() {
+            if (!is_mapped) return;
+            owned.assign(items, items + count);
+            is_mapped = false;
+            sync();
+        }
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T* data() const { return items; }
+        const T& operator[](size_t i) const { return items[i]; }
+        T& operator[](size_t i) { return items[i]; }
+        const T* begin() const { return items; }
+        const T* end() const { return items + count; }
+        T* begin() { return items; }
+        T* end() { return items + count; }
+        const T& front() const { return items[0]; }
+        const T& back() const { return items[count - 1]; }
+
+        void push_back(const T& value) { own(); owned.push_back(value); sync(); }
+        template <typename... Args>
+        void emplace_back(Args&&... args) { own(); owned.emplace_back(std::forward<Args>(args)...); sync(); }
+        void pop_back() { own(); owned.pop_back(); sync(); }
+        void resize(size_t n) { own(); owned.resize(n); sync(); }
+        void resize(size_t n, const T& value) { own(); owned.resize(n, value); sync(); }
+        void reserve(size_t n) { own(); owned.reserve(n); sync(); }
+        void clear() { std::vector<T>().swap(owned); is_mapped = false; sync(); }
+        void assign(size_t n, const T& value) { is_mapped = false; owned.assign(n, value); sync(); }
+        template <typename It, typename = std::enable_if_t<!std::is_integral<It>::value>>
+        void assign(It first, It last) {
+            std::vector<T> values(first, last); // first, last がこの配列を指していてもよいように先に写す
+            owned.swap(values);
+            is_mapped = false;
+            sync();
+        }
+        void assign(std::vector<T> values) { owned = std::move(values); is_mapped = false; sync(); }
+        template <typename It, typename = std::enable_if_t<!std::is_integral<It>::value>>
+        void insert(const T* position, It first, It last) {
+            const size_t at = static_cast<size_t>(position - items);
+            own();
+            owned.insert(owned.begin() + at, first, last);
+            sync();
+        }
+        void insert(const T* position, size_t n, const T& value) {
+            const size_t at = static_cast<size_t>(position - items);
+            own();
+            owned.insert(owned.begin() + at, n, value);
+            sync();
+        }
+        void erase(const T* position) { erase(position, position + 1); }
+        void erase(const T* first, const T* last) {
+            const size_t from = static_cast<size_t>(first - items);
+            const size_t to = static_cast<size_t>(last - items);
+            own();
+            owned.erase(owned.begin() + from, owned.begin() + to);
+            sync();
+        }
+
+    private:
+        std::vector<T> owned;
+        T* items = nullptr;
+        size_t count = 0;
+        bool is_mapped = false;
+
+        void sync() {
+            items = owned.data();
+            count = owned.size();
+        }
+        void adopt(const FlatArray& other) {
+            is_mapped = other.is_mapped;
+            if (is_mapped) {
+                items = other.items;
+                count = other.count;
+            } else {
+                sync();
+            }
+        }
+        void reset() {
+            owned.clear();
+            is_mapped = false;
+            sync();
+        }
+};
+
+// 番号ごとのルール番号のリスト (RuleBase::rules_by_conclusion など)
+// イメージから読み込んだものは CSR 形式 (開始位置 + 番兵、連結した要素) の領域を指し、最初に変更したときに番号ごとの配列に展開する
+class FlatIndex {
+    public:
+        // 1 つの番号のリスト (読み出し専用)
+        struct List {
+            const uint32_t* first;
+            const uint32_t* last;
+
+            const uint32_t* begin() const { return first; }
+            const uint32_t* end() const { return last; }
+            size_t size() const { return static_cast<size_t>(last - first); }
+            bool empty() const { return first == last; }
+            uint32_t operator[](size_t i) const { return first[i]; }
+            uint32_t front() const { return *first; }
+            uint32_t back() const { return last[-1]; }
+        };
+
+        List operator[](size_t id) const {
+            if (is_mapped) return List{values + offsets[id], values + offsets[id + 1]};
+            const std::vector<uint32_t>& list = lists[id];
+            return List{list.data(), list.data() + list.size()};
+        }
+        size_t size() const { return is_mapped ? mapped_count : lists.size(); }
+
+        // count 個の番号の CSR 形式の領域を指す (offsets は count + 1 個)
+        void map(const uint32_t* offset_data, size_t id_count, const uint32_t* value_data) {
+            std::vector<std::vector<uint32_t>>().swap(lists);
+            offsets = offset_data;
+            values = value_data;
+            mapped_count = id_count;
+            is_mapped = true;
+        }
+        bool mapped() const { return is_mapped; }
+        void own() {
+            if (!is_mapped) return;
+            lists.resize(mapped_count);
+            for (size_t id = 0; id < mapped_count; ++id) lists[id].assign(values + offsets[id], values + offsets[id + 1]);
+            is_mapped = false;
+        }
+
+        // 番号 id のリストを書き換える
+        std::vector<uint32_t>& edit(size_t id) { own(); return lists[id]; }
+        void resize(size_t n) { own(); lists.resize(n); }
+        void assign(size_t n) { is_mapped = false; lists.assign(n, {}); }
+        void emplace_back() { own(); lists.emplace_back(); }
+
+    private:
+        std::vector<std::vector<uint32_t>> lists;
+        const uint32_t* offsets = nullptr;
+        const uint32_t* values = nullptr;
+        size_t mapped_count = 0;
+        bool is_mapped = false;
+};
+
+#endif
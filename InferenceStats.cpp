@@ -0,0 +1,86 @@
+#include "InferenceStats.h"
+#include <algorithm>
+#include <cstdio>
+
+void InferenceStats::merge(const InferenceStats& other) {
+    queries += other.queries;
+    rule_evaluations += other.rule_evaluations;
+    max_rule_evaluations_per_query = std::max(max_rule_evaluations_per_query, other.max_rule_evaluations_per_query);
+    fact_calls += other.fact_calls;
+    cache_hits += other.cache_hits;
+    components_resolved += other.components_resolved;
+    cyclic_components += other.cyclic_components;
+    fixpoint_iterations += other.fixpoint_iterations;
+    eliminations += other.eliminations;
+    contradictions += other.contradictions;
+    max_depth = std::max(max_depth, other.max_depth);
+    slice_facts = std::max(slice_facts, other.slice_facts);
+    sat_solves += other.sat_solves;
+    sat_conflicts += other.sat_conflicts;
+    sat_decisions += other.sat_decisions;
+    bdd_nodes = std::max(bdd_nodes, other.bdd_nodes);
+    bdd_fallbacks += other.bdd_fallbacks;
+    parse_seconds += other.parse_seconds;
+    inference_seconds += other.inference_seconds;
+}
+
+void InferenceStats::clear() {
+    double parse = parse_seconds;
+    *this = InferenceStats();
+    parse_seconds = parse;
+}
+
+static double perQuery(uint64_t value, uint64_t queries) {
+    return queries == 0 ? 0.0 : static_cast<double>(value) / queries;
+}
+
+void InferenceStats::print(std::ostream& out) const {
+    char line[128];
+    auto row = [&](const char* label, const char* format, auto value) {
+        std::snprintf(line, sizeof(line), format, value);
+        out << "  " << label << line << '\n';
+    };
+    row("Parse time            : ", "%.6f s", parse_seconds);
+    row("Inference time        : ", "%.6f s", inference_seconds);
+    row("Queries               : ", "%llu", static_cast<unsigned long long>(queries));
+    row("Rule evaluations      : ", "%llu", static_cast<unsigned long long>(rule_evaluations));
+    row("  per query (mean)    : ", "%.1f", perQuery(rule_evaluations, queries));
+    row("  per query (max)     : ", "%llu", static_cast<unsigned long long>(max_rule_evaluations_per_query));
+    row("isFactTrue calls      : ", "%llu", static_cast<unsigned long long>(fact_calls));
+    row("  already resolved    : ", "%llu", static_cast<unsigned long long>(cache_hits));
+    row("Components resolved   : ", "%llu", static_cast<unsigned long long>(components_resolved));
+    row("  cyclic              : ", "%llu", static_cast<unsigned long long>(cyclic_components));
+    row("  fixpoint iterations : ", "%llu", static_cast<unsigned long long>(fixpoint_iterations));
+    row("Max dependency depth  : ", "%llu", static_cast<unsigned long long>(max_depth));
+    row("Query slice facts     : ", "%llu", static_cast<unsigned long long>(slice_facts));
+    row("OR/XOR eliminations   : ", "%llu", static_cast<unsigned long long>(eliminations));
+    row("Contradictions        : ", "%llu", static_cast<unsigned long long>(contradictions));
+    row("SAT solver calls      : ", "%llu", static_cast<unsigned long long>(sat_solves));
+    row("  conflicts           : ", "%llu", static_cast<unsigned long long>(sat_conflicts));
+    row("  decisions           : ", "%llu", static_cast<unsigned long long>(sat_decisions));
+    row("BDD nodes             : ", "%llu", static_cast<unsigned long long>(bdd_nodes));
+    row("  fallback queries    : ", "%llu", static_cast<unsigned long long>(bdd_fallbacks));
+    out.flush();
+}
+
+std::string InferenceStats::toJson() const {
+    char buffer[768];
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\"parse_seconds\":%.6f,\"inference_seconds\":%.6f,\"queries\":%llu,\"rule_evaluations\":%llu,"
+                  "\"max_rule_evaluations_per_query\":%llu,\"fact_calls\":%llu,\"cache_hits\":%llu,\"components_resolved\":%llu,"
+                  "\"cyclic_components\":%llu,\"fixpoint_iterations\":%llu,\"eliminations\":%llu,\"contradictions\":%llu,"
+                  "\"max_depth\":%llu,\"slice_facts\":%llu,"
+                  "\"sat_solves\":%llu,\"sat_conflicts\":%llu,\"sat_decisions\":%llu,\"bdd_nodes\":%llu,\"bdd_fallbacks\":%llu}",
+                  parse_seconds, inference_seconds,
+                  static_cast<unsigned long long>(queries), static_cast<unsigned long long>(rule_evaluations),
+                  static_cast<unsigned long long>(max_rule_evaluations_per_query),
+                  static_cast<unsigned long long>(fact_calls), static_cast<unsigned long long>(cache_hits),
+                  static_cast<unsigned long long>(components_resolved), static_cast<unsigned long long>(cyclic_components),
+                  static_cast<unsigned long long>(fixpoint_iterations), static_cast<unsigned long long>(eliminations),
+                  static_cast<unsigned long long>(contradictions),
+                  static_cast<unsigned long long>(max_depth), static_cast<unsigned long long>(slice_facts),
+                  static_cast<unsigned long long>(sat_solves),
+                  static_cast<unsigned long long>(sat_conflicts), static_cast<unsigned long long>(sat_decisions),
+                  static_cast<unsigned long long>(bdd_nodes), static_cast<unsigned long long>(bdd_fallbacks));
+    return buffer;
+}
@@ -0,0 +1,39 @@
+#ifndef INFERENCESTATS_H
+#define INFERENCESTATS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// 推論エンジンの計測値 (インタラクティブモードの stats コマンド、バッチモードの --stats で出力)
+// 収集は collect_stats が true の間だけ行い、無効時の負担は分岐 1 つに留める
+// BatchEvaluator ではシナリオ (レーン) 単位で数えるため、各値は逐次版で全シナリオを評価した合計と一致する
+struct InferenceStats {
+    uint64_t queries = 0; // 評価したクエリ数
+    uint64_t rule_evaluations = 0; // 前提部の評価回数
+    uint64_t max_rule_evaluations_per_query = 0; // クエリ 1 つあたりの最大 (逐次版のみ)
+    uint64_t fact_calls = 0; // isFactTrue の呼び出し回数
+    uint64_t cache_hits = 0; // 事実の成分が評価済みで結果を読むだけだった回数
+    uint64_t components_resolved = 0; // 評価した強連結成分の数
+    uint64_t cyclic_components = 0; // そのうち循環を含む成分の数
+    uint64_t fixpoint_iterations = 0; // 循環を含む成分で不動点までに要した反復回数の合計
+    uint64_t eliminations = 0; // OR/XOR 結論の消去法で TRUE に確定した回数
+    uint64_t contradictions = 0; // TRUE と証明された事実が否定の結論でも偽と証明された (またはその逆の) 回数
+    uint64_t max_depth = 0; // 成分の依存関係をたどった最大の深さ
+    uint64_t slice_facts = 0; // シナリオごとに評価したクエリの影響範囲の事実の数 (最大)
+    uint64_t sat_solves = 0; // SAT モードでソルバを呼んだ回数
+    uint64_t sat_conflicts = 0; // そのうちの衝突 (節の学習) 回数
+    uint64_t sat_decisions = 0; // 仮定以外の決定の回数
+    uint64_t bdd_nodes = 0; // BDD モードでコンパイルした図のノード数 (最大)
+    uint64_t bdd_fallbacks = 0; // BDD が大きすぎて後向き連鎖で評価したクエリ数
+    double parse_seconds = 0; // 知識ベースの読み込み (解析・コンパイル) 時間
+    double inference_seconds = 0; // 推論時間 (収集中のみ)
+
+    void merge(const InferenceStats& other);
+    void clear(); // 読み込み時間以外をリセット
+
+    void print(std::ostream& out) const; // 人が読む形式
+    std::string toJson() const; // 1 行の JSON オブジェクト
+};
+
+#endif
@@ -1,45 +1,33 @@
 #include "KnowledgeBase.h"
+#include "MappedFile.h"
+#include "RuleFileWatcher.h"
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <stdexcept>
 
-std::string Rule::to_string() const {
-    return antecedent->to_string() + " => " + consequent->to_string();
-}
-
-// FactExpression の評価
-FactState FactExpression::evaluate(KnowledgeBase& kb) {
-    FactState state = kb.isFactTrue(factSymbol);
-    
-    if (!isNegated) {
-        return state;
-    }
-    
-    // 否定されている場合 (!X)
+// 三値論理の演算
+static FactState negateState(FactState state) {
     if (state == FactState::TRUE) return FactState::FALSE;
     if (state == FactState::FALSE) return FactState::TRUE;
     return FactState::UNDETERMINED; // 未決定の否定は未決定
 }
 
-FactState BinaryOperation::evaluate(KnowledgeBase& kb) {
-    FactState leftState = left->evaluate(kb);
-    FactState rightState = right->evaluate(kb);
-    
-    if (op == Operator::AND) {
+static FactState applyOperator(ExprNode::OpCode op, FactState leftState, FactState rightState) {
+    if (op == ExprNode::OpCode::AND) {
         if (leftState == FactState::FALSE || rightState == FactState::FALSE) return FactState::FALSE;
         if (leftState == FactState::TRUE && rightState == FactState::TRUE) return FactState::TRUE;
         return FactState::UNDETERMINED; // T+U, U+T, U+U
     }
     
-    if (op == Operator::OR) {
+    if (op == ExprNode::OpCode::OR) {
         if (leftState == FactState::TRUE || rightState == FactState::TRUE) return FactState::TRUE;
         if (leftState == FactState::FALSE && rightState == FactState::FALSE) return FactState::FALSE;
         return FactState::UNDETERMINED; // F|U, U|F, U|U
     }
     
-    if (op == Operator::XOR) {
+    if (op == ExprNode::OpCode::XOR) {
         // 未決定を含む場合は原則 UNDETERMINED
         if (leftState == FactState::UNDETERMINED || rightState == FactState::UNDETERMINED) {
             return FactState::UNDETERMINED;
@@ -58,396 +46,906 @@ FactState BinaryOperation::evaluate(KnowledgeBase& kb) {
     return FactState::FALSE; 
 }
 
-void KnowledgeBase::skipWhitespace() {
-    while (current_pos < input_str.length() && 
-           (input_str[current_pos] == ' ' || input_str[current_pos] == '\t')) {
-        current_pos++;
-    }
+// コンパイル済み前提部の評価 (参照する事実の状態をそのまま読む)
+// 後向き連鎖では前提部の事実の成分は評価済み (または評価中の同じ成分) なので再帰しない
+FactState KnowledgeBase::evaluateRule(const Rule& rule) {
+    if (collect_stats) stats.rule_evaluations++;
+    return evaluateExpression(rule.premise);
 }
 
-char KnowledgeBase::peek() const { 
-    return (current_pos < input_str.length()) ? input_str[current_pos] : '\0'; 
+// 二項演算の節点の値は事実の表の版 (facts.version()) とともにメモし、版が変わるまで再利用する
+// 共有された部分式は、事実の状態が変わらない間は何本のルールから参照されても 1 度しか評価しない
+FactState KnowledgeBase::evaluateExpression(ExprId root) {
+    if (node_epochs.size() < expressions.size()) {
+        node_epochs.resize(expressions.size(), 0);
+        node_values.resize(expressions.size(), FactState::FALSE);
+    }
+    const uint64_t epoch = facts.version();
+    auto value = [&](ExprId id) {
+        const ExprNode& node = expressions[id];
+        if (node.op == ExprNode::OpCode::LOAD) return facts.state(node.left);
+        if (node.op == ExprNode::OpCode::LOAD_NOT) return negateState(facts.state(node.left));
+        return node_values[id];
+    };
+    expressions.evaluate(root, expression_stack,
+                         [&](ExprId id) { return node_epochs[id] == epoch; },
+                         [&](ExprId id) {
+                             const ExprNode& node = expressions[id];
+                             node_values[id] = applyOperator(node.op, value(node.left), value(node.right));
+                             node_epochs[id] = epoch;
+                         });
+    return value(root);
 }
 
-void KnowledgeBase::consume() { 
-    if (current_pos < input_str.length()) current_pos++; 
+// 成分 component の評価中の前提部の評価
+// 循環を含む成分の事実は不動点に達するまで確定しないため、否定と XOR を含む前提部は evaluateGuarded で評価する
+FactState KnowledgeBase::evaluateRule(const Rule& rule, uint32_t component) {
+    if (expressions.isMonotone(rule.premise) || !cyclic_components.test(component)) return evaluateRule(rule);
+    if (collect_stats) stats.rule_evaluations++;
+    return evaluateGuarded(rule.premise, component);
 }
 
-void KnowledgeBase::syntaxError(const std::string& message) {
-    throw std::runtime_error("Syntax Error at position " + std::to_string(current_pos) + " ('" + input_str + "'): " + message);
+// 否定や XOR を通して成分 component の事実を読む部分式を UNDETERMINED とみなして評価する
+// 前提部は成分内の事実について単調になるため、不動点はルールや事実の評価順によらず、成分内の事実が後で TRUE に
+// 上がっても、それを否定で読んだ前提部から導いた結果を取り消す必要がない (値は成分ごとに異なるためメモしない)
+FactState KnowledgeBase::evaluateGuarded(ExprId root, uint32_t component) {
+    if (guard_epochs.size() < expressions.size()) {
+        guard_epochs.resize(expressions.size(), 0);
+        guard_values.resize(expressions.size(), FactState::FALSE);
+        guard_internal.resize(expressions.size(), false);
+    }
+    const uint64_t epoch = ++guard_epoch;
+    auto internal = [&](ExprId id) {
+        const ExprNode& node = expressions[id];
+        if (!expressions.isFact(id)) return static_cast<bool>(guard_internal[id]);
+        return node.left < fact_component.size() && fact_component[node.left] == component;
+    };
+    auto value = [&](ExprId id) {
+        const ExprNode& node = expressions[id];
+        if (node.op == ExprNode::OpCode::LOAD) return facts.state(node.left);
+        if (node.op == ExprNode::OpCode::LOAD_NOT) {
+            return internal(id) ? FactState::UNDETERMINED : negateState(facts.state(node.left));
+        }
+        return guard_values[id];
+    };
+    expressions.evaluate(root, expression_stack,
+                         [&](ExprId id) { return guard_epochs[id] == epoch; },
+                         [&](ExprId id) {
+                             const ExprNode& node = expressions[id];
+                             guard_internal[id] = internal(node.left) || internal(node.right);
+                             guard_values[id] = (node.op == ExprNode::OpCode::XOR && guard_internal[id])
+                                                    ? FactState::UNDETERMINED
+                                                    : applyOperator(node.op, value(node.left), value(node.right));
+                             guard_epochs[id] = epoch;
+                         });
+    return value(root);
 }
 
+static int stateRank(FactState state) {
+    if (state == FactState::TRUE) return 2;
+    if (state == FactState::UNDETERMINED) return 1;
+    return 0;
+}
 
-// --- KnowledgeBase 論理式パーサー (再帰下降) ---
-
-std::unique_ptr<Expression> KnowledgeBase::parse_Factor() {
-    skipWhitespace();
-    char current_char = peek();
-
-    if (current_char == '(') {
-        consume(); // '(' を消費
-        std::unique_ptr<Expression> expr = parse_XOR(); 
-        skipWhitespace();
-        if (peek() != ')') {
-            syntaxError("Expected ')'");
+// --- KnowledgeBase 推論エンジン (後向き連鎖) ---
+
+FactState KnowledgeBase::isFactTrue(FactId id) {
+    // 事実の属する強連結成分を (依存先の成分から順に) 1 度だけ評価し、以降は結果を読むだけ
+    if (collect_stats) stats.fact_calls++;
+    if (id < fact_component.size()) {
+        const uint32_t component = fact_component[id];
+        if (!component_resolved.test(component)) {
+            resolveComponents(component);
+        } else if (collect_stats) {
+            stats.cache_hits++;
         }
-        consume(); // ')' を消費
-        return expr;
-    } 
-    else if (current_char >= 'A' && current_char <= 'Z') {
-        consume(); // 事実文字を消費
-        return std::make_unique<FactExpression>(current_char, false); 
-    } 
-    else {
-        syntaxError("Expected a fact (A-Z) or '('");
-        return nullptr;
     }
+    return facts.state(id);
 }
 
-std::unique_ptr<Expression> KnowledgeBase::parse_NOT() {
-    skipWhitespace();
-    
-    if (peek() == '!') {
-        consume(); // '!' を消費
-        // NOT の右側が FactExpression の場合、その否定フラグを立てる
-        std::unique_ptr<Expression> operand = parse_Factor();
-        if (FactExpression* fact_expr = dynamic_cast<FactExpression*>(operand.get())) {
-            fact_expr->isNegated = !fact_expr->isNegated; // NOTのネストを考慮 (!!A -> A)
-            return operand;
-        }
-        // TODO: !(A+B) のような複雑な否定は、UnaryOperatorノードが必要だが、ここでは簡単化
-        // 課題の例 "not B" (!B) のみをサポート
-        syntaxError("Complex negation like !(A+B) is not fully supported.");
-        return operand;
+void KnowledgeBase::resolveComponents(uint32_t root) {
+    // 成分の依存関係は DAG なので、未評価の依存先を深さ優先でたどって帰りがけに評価する
+    component_stack.clear();
+    component_stack.emplace_back(root, dependency_begin[root]);
+    while (!component_stack.empty()) {
+        const uint32_t component = component_stack.back().first;
+        const uint32_t next = component_stack.back().second;
+        if (next < dependency_end[component]) {
+            component_stack.back().second++;
+            const uint32_t dependency = component_dependencies[next];
+            if (!component_resolved.test(dependency)) {
+                component_stack.emplace_back(dependency, dependency_begin[dependency]);
+                if (collect_stats) stats.max_depth = std::max<uint64_t>(stats.max_depth, component_stack.size());
+            }
+            continue;
+        }
+        resolveComponent(component);
+        component_resolved.set(component);
+        component_stack.pop_back();
     }
-    
-    return parse_Factor();
+    if (collect_stats) stats.max_depth = std::max<uint64_t>(stats.max_depth, 1);
 }
 
-std::unique_ptr<Expression> KnowledgeBase::parse_AND() {
-    std::unique_ptr<Expression> left = parse_NOT(); 
-
-    while (true) {
-        skipWhitespace();
-        if (peek() == '+') {
-            consume(); 
-            std::unique_ptr<Expression> right = parse_NOT();
-            left = std::make_unique<BinaryOperation>(
-                BinaryOperation::Operator::AND, std::move(left), std::move(right)
-            );
-        } else {
-            break;
+void KnowledgeBase::resolveComponent(uint32_t component) {
+    // 依存先の成分は評価済みなので、成分内の事実だけを FALSE < UNDETERMINED < TRUE の方向に更新する
+    // 最初のパスで成分内の全事実と OR/XOR ルールを評価し、以降は状態が変わった事実を参照するものだけを再評価する
+    // (各事実は高々 2 回しか変化しないため必ず停止する)。再評価は成分内の位置順に行うため、
+    // 結果は毎回全体を走査した場合と同じになる
+    // 循環を含む成分では、前提部は成分内の事実を否定や XOR を通して読まず (evaluateRule)、
+    // 成分内の事実を読む否定の結論は不動点の後で評価するため、結果はルールの順序によらない
+    const bool cyclic = cyclic_components.test(component);
+    if (collect_stats) {
+        stats.components_resolved++;
+        if (cyclic) stats.cyclic_components++;
+    }
+    pending_eliminations.clear();
+
+    const uint32_t fact_begin = component_begin[component];
+    const uint32_t fact_end = component_begin[component + 1];
+    const uint32_t slot_begin = elimination_begin[component];
+    const uint32_t slot_end = elimination_end[component];
+    for (uint32_t m = fact_begin; m < fact_end; ++m) {
+        dirty_facts.set(m);
+        // 新しい推論サイクルのためクリア (TRUE でない事実の導出は、この成分の評価中に記録したものだけになる)
+        if (facts.state(component_facts[m]) != FactState::TRUE) facts.clearDerivations(component_facts[m]);
+    }
+    for (uint32_t e = slot_begin; e < slot_end; ++e) {
+        const Rule& rule = rules[component_eliminations[e]];
+        if (rule.removed) continue; // 実行時に取り除いたルールの位置 (監視されないため再評価待ちにもならない)
+        uint32_t open = 0;
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            const FactId f = fact_pool[i];
+            if (fact_component[f] == component && facts.state(f) != FactState::TRUE) open++;
         }
+        open_disjuncts[e] = open;
+        dirty_eliminations.set(e);
     }
-    return left;
-}
 
-std::unique_ptr<Expression> KnowledgeBase::parse_OR() {
-    std::unique_ptr<Expression> left = parse_AND(); 
+    do {
+        if (collect_stats && cyclic) stats.fixpoint_iterations++;
+
+        // 1. 再評価待ちの事実について、それを否定の結論とするルール (偽の rail、証明済みなら確定済み) と
+        //    結論とするルール (TRUE の rail、TRUE の事実は確定済み) を試行
+        for (size_t m = dirty_facts.findNext(fact_begin, fact_end); m < fact_end; m = dirty_facts.findNext(m + 1, fact_end)) {
+            dirty_facts.reset(m);
+            const FactId id = component_facts[m];
+            FactState before = facts.state(id);
+            if (!facts.isProvenFalse(id) && negation_begin[id] < negation_end[id]) {
+                bool proven = false;
+                for (uint32_t i = negation_begin[id]; i < negation_end[id]; ++i) {
+                    const Rule& rule = rules[negated_rules[i]];
+                    if (cyclic && readsComponent(rule, component)) continue; // 不動点の後で評価する
+                    if (evaluateRule(rule) != FactState::TRUE) continue;
+                    facts.addDerivation(id, negated_rules[i], DerivationKind::NEGATION);
+                    proven = true;
+                }
+                if (proven && proveFalse(id)) {
+                    markDependents(id, before);
+                    before = FactState::FALSE;
+                }
+            }
+            if (before == FactState::TRUE) continue;
+
+            FactState best = before;
+            if (id < rules_by_conclusion.size()) {
+                for (size_t rule_index : rules_by_conclusion[id]) {
+                    FactState premiseState = evaluateRule(rules[rule_index], component);
+                    if (premiseState == FactState::TRUE) {
+                        facts.addDerivation(id, rule_index, DerivationKind::RULE); // 記録 (説明文は表示時に作る)
+                    }
+                    if (stateRank(premiseState) > stateRank(best)) best = premiseState;
+                }
+            }
+            if (raiseState(id, best)) markDependents(id, before);
+        }
 
-    while (true) {
-        skipWhitespace();
-        if (peek() == '|') {
-            consume(); 
-            std::unique_ptr<Expression> right = parse_AND();
-            left = std::make_unique<BinaryOperation>(
-                BinaryOperation::Operator::OR, std::move(left), std::move(right)
-            );
-        } else {
-            break;
+        // 2. ボーナス: OR/XOR 結論の消去法
+        //    前提が真で、結論部のこの成分の事実のうち 1 つだけが UNDETERMINED/FALSE のまま残っていればそれを TRUE に確定する
+        //    残りの選言肢が 1 つのルールのうち、前提部か選言肢が変化したものだけを調べる
+        for (size_t e = dirty_eliminations.findNext(slot_begin, slot_end); e < slot_end;
+             e = dirty_eliminations.findNext(e + 1, slot_end)) {
+            dirty_eliminations.reset(e);
+            if (open_disjuncts[e] != 1) continue;
+            const uint32_t rule_index = component_eliminations[e];
+            const Rule& rule = rules[rule_index];
+            if (evaluateRule(rule, component) != FactState::TRUE) continue;
+
+            FactId open_fact = NO_FACT;
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end && open_fact == NO_FACT; ++i) {
+                const FactId f = fact_pool[i];
+                if (fact_component[f] == component && facts.state(f) != FactState::TRUE) open_fact = f;
+            }
+            const FactState before = facts.state(open_fact);
+            facts.setState(open_fact, FactState::TRUE);
+            pending_eliminations.emplace_back(open_fact, rule_index);
+            if (collect_stats) {
+                stats.eliminations++;
+                if (facts.contradicts(open_fact)) stats.contradictions++;
+            }
+            markDependents(open_fact, before);
+        }
+    } while (dirty_facts.findNext(fact_begin, fact_end) < fact_end ||
+             dirty_eliminations.findNext(slot_begin, slot_end) < slot_end);
+
+    // 3. 循環を含む成分で、成分内の事実を読む否定の結論 (成分の事実は確定済み)
+    //    すべての前提部を評価してから偽と証明するため順序によらない。FALSE に下げた事実から成分内の他の事実へは伝えない
+    if (cyclic) {
+        deferred_false.clear();
+        for (uint32_t m = fact_begin; m < fact_end; ++m) {
+            const FactId id = component_facts[m];
+            if (facts.isProvenFalse(id)) continue;
+            bool proven = false;
+            for (uint32_t i = negation_begin[id]; i < negation_end[id]; ++i) {
+                const Rule& rule = rules[negated_rules[i]];
+                if (!readsComponent(rule, component) || evaluateRule(rule) != FactState::TRUE) continue;
+                facts.addDerivation(id, negated_rules[i], DerivationKind::NEGATION);
+                proven = true;
+            }
+            if (proven) deferred_false.push_back(id);
         }
+        for (FactId id : deferred_false) proveFalse(id);
     }
-    return left;
-}
 
-std::unique_ptr<Expression> KnowledgeBase::parse_XOR() {
-    std::unique_ptr<Expression> left = parse_OR(); 
-
-    while (true) {
-        skipWhitespace();
-        if (peek() == '^') {
-            consume(); 
-            std::unique_ptr<Expression> right = parse_OR();
-            left = std::make_unique<BinaryOperation>(
-                BinaryOperation::Operator::XOR, std::move(left), std::move(right)
-            );
-        } else {
-            break;
-        }
+    // 消去法による導出はルールによる導出の後に記録する
+    for (const std::pair<FactId, uint32_t>& elimination : pending_eliminations) {
+        facts.addDerivation(elimination.first, elimination.second, DerivationKind::ELIMINATION);
     }
-    return left;
 }
 
-std::unique_ptr<Expression> KnowledgeBase::parseExpression(const std::string& str) {
-    this->input_str = str;
-    this->current_pos = 0;
-    
-    std::unique_ptr<Expression> ast_root = parse_XOR(); 
-
-    skipWhitespace();
-    if (peek() != '\0') {
-        syntaxError("Unexpected token at end of expression");
+void KnowledgeBase::markDependents(FactId id, FactState before) {
+    // 成分内で id の状態が before から変わった: id を前提部で参照する事実と、選言肢が 1 つだけ残った OR/XOR ルールを再評価待ちにする
+    for (uint32_t i = dependent_begin[id]; i < dependent_end[id]; ++i) {
+        dirty_facts.set(fact_dependents[i]);
+    }
+    for (uint32_t i = premise_watch_begin[id]; i < premise_watch_end[id]; ++i) {
+        if (open_disjuncts[premise_watches[i]] == 1) dirty_eliminations.set(premise_watches[i]);
+    }
+    if (before == FactState::TRUE || facts.state(id) != FactState::TRUE) return;
+    // 同じ結論部に id が複数回現れる場合 (例: X | X) は、すべて減らしてから判定する
+    for (uint32_t i = disjunct_begin[id]; i < disjunct_end[id]; ++i) {
+        open_disjuncts[disjunct_watches[i]]--;
+    }
+    for (uint32_t i = disjunct_begin[id]; i < disjunct_end[id]; ++i) {
+        if (open_disjuncts[disjunct_watches[i]] == 1) dirty_eliminations.set(disjunct_watches[i]);
     }
-    
-    return ast_root;
 }
 
+// --- KnowledgeBase 前向き連鎖 (アジェンダ方式) ---
 
-// --- KnowledgeBase 推論エンジン ---
+bool KnowledgeBase::raiseState(FactId id, FactState state) {
+    // 偽と証明された事実は TRUE にならない限り FALSE のまま
+    if (stateRank(state) <= stateRank(facts.state(id))) return false;
+    if (state == FactState::UNDETERMINED && facts.isProvenFalse(id)) return false;
+    facts.setState(id, state);
+    if (collect_stats && facts.contradicts(id)) stats.contradictions++;
+    return true;
+}
 
-FactState KnowledgeBase::isFactTrue(char symbol) {
-    // 知識ベースに Fact が存在しない場合、作成し、デフォルトの FALSE で初期化
-    if (facts.find(symbol) == facts.end()) {
-        facts[symbol].symbol = symbol;
-    }
-    Fact& fact = facts[symbol]; 
+bool KnowledgeBase::proveFalse(FactId id) {
+    // 1 つの事実の偽の rail は 1 度しか立たないため、矛盾はその時点か TRUE に上がった時点 (raiseState) で 1 度だけ数える
+    if (facts.isProvenFalse(id)) return false;
+    const bool lowered = facts.proveFalse(id);
+    if (collect_stats && facts.contradicts(id)) stats.contradictions++;
+    return lowered;
+}
 
-    // 1. 基本ケース (キャッシュと無限ループ検出)
-    if (fact.currentState != FactState::FALSE && fact.currentState != FactState::UNDETERMINED) {
-        return fact.currentState;
-    }
-    if (fact.isProcessing) {
-        // 循環参照を検出
-        return FactState::FALSE; // 証明不可能と見なす
+void KnowledgeBase::runForwardChaining() {
+    std::vector<size_t> all_rules;
+    all_rules.reserve(rules.size());
+    for (size_t rule_index = 0; rule_index < rules.size(); ++rule_index) {
+        if (!rules[rule_index].removed) all_rules.push_back(rule_index);
     }
+    runForwardChaining(all_rules);
+    part_derived.resize(partCount());
+    for (size_t part = 0; part < partCount(); ++part) part_derived.set(part);
+}
 
-    // 2. 推論の開始と状態フラグの設定
-    fact.isProcessing = true;
-    
-    bool isProvenByAnyRule = false;
-    bool isUndeterminedPossible = false;
-    
-    // 推論前の状態を FALSE として、推論後に確定できなかった場合に備える
-    fact.currentState = FactState::FALSE; 
-    fact.true_reasons.clear(); // 新しい推論サイクルのためクリア
-
-    // 3. すべての関連するルールを試行 (後向き連鎖)
-    for (const auto& rule : rules) {
-        // 結論部に symbol が含まれているかをチェック (結論がAND分解されている場合は単一のFact)
-        bool concerns_symbol = false;
-        if (FactExpression* fe = dynamic_cast<FactExpression*>(rule.consequent.get())) {
-            concerns_symbol = (fe->factSymbol == symbol && !fe->isNegated);
-        } else if (rule.consequent->isOrXor() || dynamic_cast<BinaryOperation*>(rule.consequent.get())) {
-            // OR/XOR または複雑な結論の場合、含まれる事実をチェック
-            for(char c : rule.consequent->getFacts()) {
-                if(c == symbol) concerns_symbol = true;
+void KnowledgeBase::derivePart(FactId id) {
+    // 独立部分をまたぐルールはないため、部分ごとに導出しても全体を一度に導出した結果と同じになる
+    if (id >= fact_component.size()) return; // 読み込み後に登録された事実はどのルールにも現れない
+    const uint32_t part = partOf(fact_component[id]);
+    if (part_derived.test(part)) return;
+    const FlatIndex::List rules_in_part = rules_by_part[part];
+    runForwardChaining(std::vector<size_t>(rules_in_part.begin(), rules_in_part.end()));
+    part_derived.set(part);
+}
+
+void KnowledgeBase::runForwardChaining(const std::vector<size_t>& seed_rules, const Bitset* allowed_rules) {
+    // 否定を含むルール (前提部の否定や XOR、否定の結論) があると、先に FALSE として読んだ事実が後から TRUE に
+    // なっても結果を取り消せないため、結論の成分を依存先から順に評価する (後向き連鎖と同じ手順で、結果も一致する)
+    const bool monotone = std::all_of(seed_rules.begin(), seed_rules.end(), [&](size_t rule_index) {
+        return !rules[rule_index].negated_conclusion && expressions.isMonotone(rules[rule_index].premise);
+    });
+    if (!monotone) {
+        for (size_t rule_index : seed_rules) {
+            const Rule& rule = rules[rule_index];
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                const uint32_t component = fact_component[fact_pool[i]];
+                if (!component_resolved.test(component)) resolveComponents(component);
             }
         }
+        return;
+    }
 
-        if (concerns_symbol) { 
-            FactState premiseState = rule.antecedent->evaluate(*this); 
+    // 否定がなければ、最初に seed_rules を一度ずつ評価し、以降は状態が変化した事実を監視するルールだけを再評価する
+    // 各事実の状態は FALSE -> UNDETERMINED -> TRUE の方向にしか変化しないため、必ず不動点に到達する
+    // (agenda_queued は取り出すたびに戻すため、終了時には常に空になっている)
+    agenda.clear();
+    agenda_queued.resize(rules.size());
+    for (size_t rule_index : seed_rules) {
+        if (agenda_queued.test(rule_index)) continue;
+        agenda.push_back(rule_index);
+        agenda_queued.set(rule_index);
+    }
+
+    for (size_t head = 0; head < agenda.size(); ++head) {
+        const size_t rule_index = agenda[head];
+        agenda_queued.reset(rule_index);
+        const Rule& rule = rules[rule_index];
+
+        FactState premiseState = evaluateRule(rule);
+        if (premiseState == FactState::FALSE) continue;
+
+        // OR/XOR 結論も後向き連鎖と同様に含まれる全事実を結論とする (消去法による確定はこれに含まれる)
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            FactId c = fact_pool[i];
+            if (!raiseState(c, premiseState)) continue;
 
             if (premiseState == FactState::TRUE) {
-                isProvenByAnyRule = true;
-                // 記録
-                fact.true_reasons.push_back("Derived TRUE from Rule: " + rule.to_string() + " (Premise was TRUE)");
+                facts.addDerivation(c, rule_index, DerivationKind::RULE);
             }
-            if (premiseState == FactState::UNDETERMINED) {
-                isUndeterminedPossible = true;
+            if (c >= rules_by_premise.size()) continue;
+            for (size_t watcher : rules_by_premise[c]) {
+                if (allowed_rules && !allowed_rules->test(watcher)) continue;
+                if (!agenda_queued.test(watcher)) {
+                    agenda_queued.set(watcher);
+                    agenda.push_back(watcher);
+                }
             }
         }
     }
+    agenda.clear();
 
-    // 4. 結論の決定と状態の更新
-    fact.isProcessing = false;
-
-    if (isProvenByAnyRule) {
-        fact.currentState = FactState::TRUE;
-    } else if (isUndeterminedPossible) {
-        fact.currentState = FactState::UNDETERMINED;
-        fact.final_state_reason = "Fact is UNDETERMINED. Premise of a relevant rule was UNDETERMINED.";
-    } else {
-        fact.currentState = FactState::FALSE;
-        fact.final_state_reason = "Fact is FALSE (by default/not proven by any rule).";
+    // 導出した成分は評価済みとする (後で否定を含むルールの下流を評価するとき、依存先として評価し直さない)
+    for (size_t rule_index : seed_rules) {
+        const Rule& rule = rules[rule_index];
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            component_resolved.set(fact_component[fact_pool[i]]);
+        }
     }
+}
 
-    return fact.currentState;
+// --- KnowledgeBase 差分再計算 (インタラクティブモード) ---
+
+void KnowledgeBase::setInitialFact(FactId id, bool value) {
+    scenario_active = false;
+    if (facts.isKnown(id) == value) return;
+    facts.setKnown(id, value);
+    changed_facts.push_back(id);
 }
 
-// --- KnowledgeBase OR/XOR 伝播ロジック (前方連鎖的) ---
+void KnowledgeBase::setMode(InferenceMode new_mode) {
+    mode = new_mode;
+    derived_valid = false; // 次のクエリで全体を推論し直す
+}
 
-void KnowledgeBase::propagate_Undetermined() {
-    // 状態が変化しなくなるまで推論を繰り返す
-    bool changed;
-    int max_iterations = 100; // 安全のための制限
-    do {
-        changed = false;
-        max_iterations--;
-
-        for (Rule& rule : rules) {
-            // OR/XOR 結論を持つルール、かつ前提が真のもののみチェック
-            if (rule.consequent->isOrXor() && rule.antecedent->evaluate(*this) == FactState::TRUE) {
-                
-                std::vector<char> conclusions = rule.consequent->getFacts();
-                int undetermined_or_false_count = 0;
-                char last_undetermined_fact = '\0';
-                
-                for (char c : conclusions) {
-                    FactState state = isFactTrue(c); // 推論を呼び出して最新の状態を取得
-                    if (state == FactState::UNDETERMINED || state == FactState::FALSE) {
-                        undetermined_or_false_count++;
-                        last_undetermined_fact = c;
-                    }
-                }
-                
-                // 結論確定ロジック: 1つだけ UNDETERMINED/FALSE が残っている場合
-                if (undetermined_or_false_count == 1) {
-                    if (facts[last_undetermined_fact].currentState != FactState::TRUE) {
-                        // 残った 1 つの事実が TRUE に確定する！
-                        facts[last_undetermined_fact].currentState = FactState::TRUE;
-                        
-                        // 記録
-                        std::string reason = "Derived TRUE by elimination from Rule: " + rule.to_string();
-                        reason += " (All other conclusions were determined to be FALSE or resolved)";
-                        facts[last_undetermined_fact].true_reasons.push_back(reason);
-
-                        changed = true; // 状態が変化
-                    }
-                }
-            }
+void KnowledgeBase::updateDerivedState() {
+    if (!derived_valid) {
+        // 初回: 全ての状態をリセットする。推論はクエリ時に、後向き連鎖では必要な成分だけ、
+        // 前向き連鎖ではクエリの事実を含む独立部分だけを行う
+        resetFacts();
+        part_derived.resize(partCount());
+        part_derived.clear();
+        if (mode == InferenceMode::SAT) {
+            SatEvaluator& evaluator = satEvaluator();
+            for (FactId id = 0; id < evaluator.factCount(); ++id) evaluator.setInitial(id, facts.isKnown(id));
         }
-    } while (changed && max_iterations > 0);
+        derived_valid = true;
+        changed_facts.clear();
+        return;
+    }
+    if (changed_facts.empty()) return;
+
+    // SAT モードでは初期事実を仮定として差し替えるだけ (学習節はそのまま使える)
+    if (mode == InferenceMode::SAT) {
+        for (FactId id : changed_facts) satEvaluator().setInitial(id, facts.isKnown(id));
+        changed_facts.clear();
+        return;
+    }
+
+    // 変更された初期事実の下流だけを無効化し、前向き連鎖では導出済みの部分で影響を受けるルールだけを再評価
+    // (後向き連鎖では無効化した成分が、前向き連鎖では未導出の部分が次のクエリで評価される)
+    std::vector<size_t>& affected_rules = affected_rule_buffer;
+    affected_rules.clear();
+    invalidateCone(affected_rules);
+    changed_facts.clear();
+
+    if (mode == InferenceMode::FORWARD) {
+        affected_rules.erase(std::remove_if(affected_rules.begin(), affected_rules.end(), [&](size_t rule_index) {
+            const FactId conclusion = fact_pool[rules[rule_index].conclusion_facts_begin];
+            return !part_derived.test(partOf(fact_component[conclusion]));
+        }), affected_rules.end());
+        runForwardChaining(affected_rules);
+    }
 }
 
-// --- KnowledgeBase I/O パーサー ---
+void KnowledgeBase::invalidateCone(std::vector<size_t>& affected_rules) {
+    // 変更された初期事実の下流を集め、その推論結果を捨てる
+    cone_bits.resize(facts.size());
+    cone_bits.clear();
+    std::vector<FactId>& cone = cone_facts;
+    collectCone(changed_facts, cone_bits, cone, &affected_rules);
+
+    // 強連結成分の事実は互いに下流にあるため、成分は丸ごと cone に含まれる
+    for (FactId id : cone) {
+        facts.invalidate(id);
+        if (id < fact_component.size()) component_resolved.reset(fact_component[id]);
+    }
 
-void KnowledgeBase::addImpliesRule(const std::string& antecedent_str, const std::string& consequent_str) {
-    // 結論部の AND 分解
-    std::string temp_conc_str = consequent_str;
-    temp_conc_str.erase(std::remove(temp_conc_str.begin(), temp_conc_str.end(), ' '), temp_conc_str.end());
+    // 元のルール順で再評価するため整列し、重複を除く
+    std::sort(affected_rules.begin(), affected_rules.end());
+    affected_rules.erase(std::unique(affected_rules.begin(), affected_rules.end()), affected_rules.end());
+}
 
-    // 結論が AND 分解可能かチェック (例: B+C)
-    size_t plus_pos = temp_conc_str.find('+');
+// --- KnowledgeBase I/O パーサー ---
 
-    if (plus_pos != std::string::npos && !temp_conc_str.empty()) {
-        std::stringstream ss(temp_conc_str);
-        std::string segment;
+void KnowledgeBase::compileRule(const ParsedRule& parsed) {
+    // parsed の式は取り込み済み (expressions の節点)
+    Rule rule;
+    rule.premise = parsed.antecedent;
+    rule.conclusion = parsed.consequent;
+
+    // 前提部が参照する事実 (重複なし)
+    std::vector<FactId> premise;
+    expressions.collectFacts(rule.premise, premise);
+    std::sort(premise.begin(), premise.end());
+    premise.erase(std::unique(premise.begin(), premise.end()), premise.end());
+    rule.premise_facts_begin = static_cast<uint32_t>(fact_pool.size());
+    fact_pool.insert(fact_pool.end(), premise.begin(), premise.end());
+    rule.premise_facts_end = static_cast<uint32_t>(fact_pool.size());
+
+    // 結論部の事実 (OR/XOR の消去法で重複も数えるため出現順のまま)
+    rule.conclusion_facts_begin = static_cast<uint32_t>(fact_pool.size());
+    premise.clear();
+    expressions.collectFacts(rule.conclusion, premise);
+    fact_pool.insert(fact_pool.end(), premise.begin(), premise.end());
+    rule.conclusion_facts_end = static_cast<uint32_t>(fact_pool.size());
+
+    const ExprNode::OpCode op = expressions[rule.conclusion].op;
+    rule.disjunctive_conclusion = op == ExprNode::OpCode::OR || op == ExprNode::OpCode::XOR;
+    rule.negated_conclusion = op == ExprNode::OpCode::LOAD_NOT;
+
+    rules.push_back(rule);
+}
 
-        while (std::getline(ss, segment, '+')) {
-            if (segment.empty()) continue;
-            // AND分解された各部分を個別のルールとして追加
-            rules.emplace_back(Rule{
-                parseExpression(antecedent_str),
-                parseExpression(segment) 
-            });
+std::string KnowledgeBase::expressionToString(ExprId id) const {
+    // 解析した表記を二項演算ごとに括弧で囲んで復元する (例: "((A+B)|!C)")
+    const ExprNode& node = expressions[id];
+    switch (node.op) {
+        case ExprNode::OpCode::LOAD:
+            return std::string(facts.name(node.left));
+        case ExprNode::OpCode::LOAD_NOT:
+            return "!" + std::string(facts.name(node.left));
+        default: {
+            const char* op_str = node.op == ExprNode::OpCode::AND ? "+" : node.op == ExprNode::OpCode::OR ? "|" : "^";
+            return "(" + expressionToString(node.left) + op_str + expressionToString(node.right) + ")";
         }
-    } else {
-        // 通常のルール、または OR/XOR 結論 (分解しない)
-        rules.emplace_back(Rule{
-            parseExpression(antecedent_str),
-            parseExpression(consequent_str) 
-        });
     }
 }
 
-void KnowledgeBase::parseRule(const std::string& rule_str) {
-    // 1. <=> の検出と分解 (ボーナス)
-    size_t biconditional_pos = rule_str.find("<=>");
-    if (biconditional_pos != std::string::npos) {
-        std::string left_side = rule_str.substr(0, biconditional_pos);
-        std::string right_side = rule_str.substr(biconditional_pos + 3);
+std::string KnowledgeBase::ruleToString(const Rule& rule) const {
+    return expressionToString(rule.premise) + " => " + expressionToString(rule.conclusion);
+}
 
-        addImpliesRule(left_side, right_side); 
-        addImpliesRule(right_side, left_side); 
-        return;
+// from の式 root を別の DAG の節点に写す (事実の節点は fact_node、二項演算の節点は子を写してから binary_node で作る)
+// 写した節点は mapping に記録して共有する。どちらかが NO_EXPR を返せば、それを含む式も NO_EXPR になる
+template <typename FactNode, typename BinaryNode>
+static ExprId translateExpression(const ExpressionArena& from, ExprId root, std::vector<ExprId>& mapping,
+                                  std::vector<ExprId>& stack, FactNode fact_node, BinaryNode binary_node) {
+    auto translate = [&](ExprId id) {
+        // 事実の節点 (二項演算は子より後に写し済み)
+        if (mapping[id] == NO_EXPR && from.isFact(id)) mapping[id] = fact_node(from[id]);
+        return mapping[id];
+    };
+    from.evaluate(root, stack,
+                  [&](ExprId id) { return mapping[id] != NO_EXPR; },
+                  [&](ExprId id) {
+                      const ExprNode& node = from[id];
+                      const ExprId left = translate(node.left);
+                      const ExprId right = translate(node.right);
+                      if (left != NO_EXPR && right != NO_EXPR) mapping[id] = binary_node(node.op, left, right);
+                  });
+    return translate(root);
+}
+
+void KnowledgeBase::mergeChunk(ParsedChunk& chunk) {
+    // チャンク内のローカル ID を全体の事実 ID に対応付ける
+    // 逐次読み込みと同じ ID 順になるよう、各ルールが初めて参照した事実をその位置で登録する
+    std::vector<FactId> local_to_global(chunk.symbols.size(), NO_FACT);
+    uint32_t interned = 0;
+    auto internUpTo = [&](uint32_t count) {
+        for (; interned < count; ++interned) {
+            local_to_global[interned] = facts.intern(chunk.symbols.name(interned));
+        }
+    };
+
+    size_t next_line = 0;
+    auto applyFactLines = [&](size_t rules_before) {
+        for (; next_line < chunk.fact_lines.size() && chunk.fact_lines[next_line].rules_before == rules_before; ++next_line) {
+            const FactListLine& line = chunk.fact_lines[next_line];
+            if (line.kind == '?') {
+                parseQueries(line.text);
+            } else {
+                parseInitialFacts(line.text);
+            }
+        }
+    };
+
+    // チャンクの式を全体の DAG に取り込む (チャンク内の節点 -> 全体の節点)
+    // 子は親より前にあるため、取り込み済みでない節点は子から順に取り込める
+    // 他のチャンクやそれまでのルールと同じ部分式は既存の節点にまとまる
+    std::vector<ExprId> local_to_expr(chunk.expressions.size(), NO_EXPR);
+    std::vector<ExprId> import_stack;
+    auto importExpression = [&](ExprId root) {
+        return translateExpression(chunk.expressions, root, local_to_expr, import_stack,
+                                   [&](const ExprNode& node) {
+                                       return expressions.fact(local_to_global[node.left], node.op == ExprNode::OpCode::LOAD_NOT);
+                                   },
+                                   [&](ExprNode::OpCode op, ExprId left, ExprId right) { return expressions.binary(op, left, right); });
+    };
+
+    rules.reserve(rules.size() + chunk.rules.size());
+    for (size_t i = 0; i < chunk.rules.size(); ++i) {
+        applyFactLines(i);
+        internUpTo(chunk.rule_symbol_counts[i]);
+
+        const ParsedRule& parsed = chunk.rules[i];
+        compileRule(ParsedRule{importExpression(parsed.antecedent), importExpression(parsed.consequent)});
+        indexRule(rules.size() - 1, facts.size());
     }
+    applyFactLines(chunk.rules.size());
+    chunk.expressions = ExpressionArena(); // チャンクの式は取り込み後は不要
 
-    // 2. => の検出 (必須)
-    size_t implies_pos = rule_str.find("=>");
-    if (implies_pos != std::string::npos) {
-        std::string antecedent_str = rule_str.substr(0, implies_pos);
-        std::string consequent_str = rule_str.substr(implies_pos + 2);
-        
-        addImpliesRule(antecedent_str, consequent_str); 
-        return;
+    if (!chunk.error.empty()) {
+        throw std::runtime_error(chunk.error);
     }
-    
-    // エラー処理
-    syntaxError("Invalid rule format: expected '=>' or '<=>'");
 }
 
-void KnowledgeBase::parseInitialFacts(const std::string& fact_str, bool interactive) {
-    std::string cleaned_str = fact_str;
-    cleaned_str.erase(std::remove_if(cleaned_str.begin(), cleaned_str.end(), ::isspace), cleaned_str.end());
+// --- KnowledgeBase 実行時のルールの変更 ---
+
+void KnowledgeBase::updateRules(const std::vector<size_t>& removed, const std::vector<std::string_view>& added_lines,
+                                RuleUpdate& update) {
+    // 1. 追加する行を全て解析し、取り除くルールを確かめてから変更を始める (エラーなら何も変更しない)
+    ParsedChunk chunk;
+    RuleParser parser(chunk.symbols, chunk.expressions);
+    update.rule_begin.assign(1, rules.size());
+    for (std::string_view line : added_lines) {
+        parser.parseRule(line, chunk.rules);
+        update.rule_begin.push_back(rules.size() + chunk.rules.size());
+    }
+    std::vector<size_t> sorted_removed = removed;
+    std::sort(sorted_removed.begin(), sorted_removed.end());
+    for (size_t i = 0; i < sorted_removed.size(); ++i) {
+        const size_t rule_index = sorted_removed[i];
+        if (rule_index >= rules.size() || rules[rule_index].removed || (i > 0 && sorted_removed[i - 1] == rule_index)) {
+            throw std::runtime_error("Error: Rule " + std::to_string(rule_index + 1) + " does not exist");
+        }
+    }
+
+    // 2. ルールを索引から外し、追加したルールを登録する (結論の事実が変更の起点)
+    std::vector<FactId> seeds;
+    auto addSeeds = [&](const Rule& rule) {
+        seeds.insert(seeds.end(), fact_pool.begin() + rule.conclusion_facts_begin, fact_pool.begin() + rule.conclusion_facts_end);
+    };
+    for (size_t rule_index : sorted_removed) {
+        addSeeds(rules[rule_index]);
+        removeRule(rule_index);
+    }
+    std::vector<FactId> local_to_global(chunk.symbols.size());
+    for (FactId local = 0; local < chunk.symbols.size(); ++local) local_to_global[local] = facts.intern(chunk.symbols.name(local));
+    std::vector<ExprId> local_to_expr(chunk.expressions.size(), NO_EXPR);
+    std::vector<ExprId> import_stack;
+    auto importExpression = [&](ExprId root) {
+        return translateExpression(chunk.expressions, root, local_to_expr, import_stack,
+                                   [&](const ExprNode& node) {
+                                       return expressions.fact(local_to_global[node.left], node.op == ExprNode::OpCode::LOAD_NOT);
+                                   },
+                                   [&](ExprNode::OpCode op, ExprId left, ExprId right) { return expressions.binary(op, left, right); });
+    };
+    std::vector<std::pair<uint32_t, uint32_t>> merged_parts;
+    for (const ParsedRule& parsed : chunk.rules) {
+        compileRule(ParsedRule{importExpression(parsed.antecedent), importExpression(parsed.consequent)});
+        insertRule(rules.size() - 1, facts.size(), merged_parts);
+        addSeeds(rules.back());
+    }
+    update.added_rules = chunk.rules.size();
+    update.removed_rules = sorted_removed.size();
+
+    // 3. 成分と索引を変更したルールの分だけ合わせる (循環が変わる成分だけを作り直す)
+    std::vector<size_t> changed = sorted_removed;
+    for (size_t rule_index = update.rule_begin.front(); rule_index < rules.size(); ++rule_index) changed.push_back(rule_index);
+    update.rebuilt = updateComponents(facts.size(), changed);
+
+    // 4. 変更したルールの結論の下流 (推論結果が変わりうる事実) を求める
+    //    前向き連鎖で導出済みなら、下流を前提部や結論とするルールも再評価のために集める
+    //    下流が事実の 1/8 を超えるとき (大きな循環の中や上流の変更) は、下流をたどり切るより推論状態を全体で捨てて
+    //    次のクエリでリセットする方が安い (変更した結論の成分だけで超えるなら、たどる前にわかる)
+    update.reset = update.rebuilt;
+    if (!update.reset) {
+        std::vector<uint32_t> seed_components;
+        for (FactId id : seeds) seed_components.push_back(fact_component[id]);
+        std::sort(seed_components.begin(), seed_components.end());
+        seed_components.erase(std::unique(seed_components.begin(), seed_components.end()), seed_components.end());
+        size_t seed_facts = 0;
+        for (uint32_t component : seed_components) seed_facts += component_begin[component + 1] - component_begin[component];
+        update.reset = seed_facts * 8 > facts.size();
+    }
+    std::vector<size_t>& affected_rules = affected_rule_buffer;
+    affected_rules.clear();
+    if (!update.reset) {
+        cone_bits.resize(facts.size());
+        cone_bits.clear();
+        const bool collect_rules = derived_valid && mode == InferenceMode::FORWARD;
+        update.reset = !collectCone(seeds, cone_bits, update.cone, collect_rules ? &affected_rules : nullptr, facts.size() / 8);
+    }
+    if (update.reset) update.cone.clear();
+    if (update.reset || mode == InferenceMode::SAT) derived_valid = false;
+
+    // 5. 推論状態を新しいルールに合わせる
+    //    SAT の符号化はルール全体から作るため次の問い合わせで作り直し、BDD は下流の事実の図だけを捨てる
+    scenario_active = false;
+    sat.reset();
+    if (bdd && update.reset) {
+        bdd.reset();
+    } else if (bdd) {
+        bdd->rulesChanged(facts.size(), update.cone);
+    }
+    if (!derived_valid) return; // 次のクエリで全体をリセットする
+
+    component_resolved.resize(componentCount());
+    dirty_facts.resize(component_facts.size());
+    dirty_eliminations.resize(component_eliminations.size());
+    open_disjuncts.resize(component_eliminations.size());
+    // 新しい事実だけの部分はルールがないため初期状態のまま導出済み、まとめた部分は両方が導出済みの場合だけ導出済み
+    const size_t old_parts = part_derived.size();
+    part_derived.resize(partCount());
+    for (size_t part = old_parts; part < partCount(); ++part) part_derived.set(part);
+    for (const std::pair<uint32_t, uint32_t>& merged : merged_parts) {
+        if (!part_derived.test(merged.second)) part_derived.reset(merged.first);
+    }
+
+    // 下流の推論結果を捨てる (後向き連鎖では次のクエリで評価し直し、前向き連鎖では導出済みの部分のルールを再評価する)
+    for (FactId id : update.cone) {
+        facts.invalidate(id);
+        component_resolved.reset(fact_component[id]);
+    }
+    if (mode == InferenceMode::FORWARD) {
+        affected_rules.erase(std::remove_if(affected_rules.begin(), affected_rules.end(), [&](size_t rule_index) {
+            const FactId conclusion = fact_pool[rules[rule_index].conclusion_facts_begin];
+            return !part_derived.test(partOf(fact_component[conclusion]));
+        }), affected_rules.end());
+        std::sort(affected_rules.begin(), affected_rules.end());
+        affected_rules.erase(std::unique(affected_rules.begin(), affected_rules.end()), affected_rules.end());
+        runForwardChaining(affected_rules);
+    }
+}
 
-    // リセットモードでない場合、既存の初期事実を FALSE に設定
-    if (!interactive) {
-        for (auto& pair : facts) {
-            if (pair.second.currentState == FactState::TRUE) {
-                 pair.second.currentState = FactState::FALSE;
+void KnowledgeBase::findRules(std::string_view rule_line, std::vector<size_t>& out) const {
+    // 行を別の DAG に解析し、同じ式の節点を登録せずに探す (同じ式はハッシュコンシングで同じ節点になる)
+    ParsedChunk chunk;
+    RuleParser parser(chunk.symbols, chunk.expressions);
+    parser.parseRule(rule_line, chunk.rules);
+
+    std::vector<ExprId> mapping(chunk.expressions.size(), NO_EXPR);
+    std::vector<ExprId> stack;
+    auto findExpression = [&](ExprId root) {
+        return translateExpression(chunk.expressions, root, mapping, stack,
+                                   [&](const ExprNode& node) {
+                                       const FactId id = facts.find(chunk.symbols.name(node.left));
+                                       return id == NO_FACT ? NO_EXPR : expressions.find({node.op, id, 0});
+                                   },
+                                   [&](ExprNode::OpCode op, ExprId left, ExprId right) { return expressions.find({op, left, right}); });
+    };
+    const size_t first = out.size();
+    for (const ParsedRule& parsed : chunk.rules) {
+        const ExprId premise = findExpression(parsed.antecedent);
+        const ExprId conclusion = findExpression(parsed.consequent);
+        size_t found = rules.size();
+        if (premise != NO_EXPR && conclusion != NO_EXPR) {
+            // 結論部の先頭の事実を結論とするルールから、最後に追加されたものを選ぶ
+            ExprId leaf = conclusion;
+            while (!expressions.isFact(leaf)) leaf = expressions[leaf].left;
+            const FactId fact = expressions[leaf].left;
+            auto matches = [&](size_t rule_index) {
+                return rules[rule_index].premise == premise && rules[rule_index].conclusion == conclusion &&
+                       std::find(out.begin() + first, out.end(), rule_index) == out.end();
+            };
+            if (expressions[conclusion].op == ExprNode::OpCode::LOAD_NOT) {
+                if (fact < negation_begin.size()) {
+                    for (uint32_t i = negation_end[fact]; i > negation_begin[fact] && found == rules.size(); --i) {
+                        if (matches(negated_rules[i - 1])) found = negated_rules[i - 1];
+                    }
+                }
+            } else if (fact < rules_by_conclusion.size()) {
+                const FlatIndex::List candidates = rules_by_conclusion[fact];
+                for (size_t i = candidates.size(); i > 0 && found == rules.size(); --i) {
+                    if (matches(candidates[i - 1])) found = candidates[i - 1];
+                }
             }
         }
+        if (found == rules.size()) throw std::runtime_error("Error: No matching rule: " + std::string(rule_line));
+        out.push_back(found);
     }
+}
 
-    for (char c : cleaned_str) {
-        if (c >= 'A' && c <= 'Z') {
-            facts[c].symbol = c;
-            facts[c].currentState = FactState::TRUE;
+// 事実の並びを識別子ごとに visit に渡す (識別子以外の文字 (空白や ',') は区切りとして扱う)
+template <typename Visit>
+static void splitFactList(const FactTable& facts, std::string_view list_str, Visit visit) {
+    size_t pos = 0;
+    while (pos < list_str.size()) {
+        if (!isIdentifierChar(list_str[pos])) {
+            pos++;
+            continue;
+        }
+        size_t start = pos;
+        while (pos < list_str.size() && isIdentifierChar(list_str[pos])) pos++;
+        std::string_view token = list_str.substr(start, pos - start);
+
+        // 従来形式 (=ABG, ?GVX) との互換: 未登録で大文字のみの識別子は 1 文字ずつの事実とみなす
+        bool legacy = facts.find(token) == NO_FACT && token.size() > 1 &&
+                      std::all_of(token.begin(), token.end(), [](char c) { return c >= 'A' && c <= 'Z'; });
+        if (legacy) {
+            for (size_t i = 0; i < token.size(); ++i) visit(token.substr(i, 1));
+        } else if (isIdentifierStart(token[0])) {
+            visit(token);
         }
     }
 }
 
-void KnowledgeBase::parseQueries(const std::string& query_str) {
-    std::string cleaned_str = query_str;
-    cleaned_str.erase(std::remove_if(cleaned_str.begin(), cleaned_str.end(), ::isspace), cleaned_str.end());
+void KnowledgeBase::parseFactList(std::string_view list_str, std::vector<FactId>& out) {
+    splitFactList(facts, list_str, [&](std::string_view name) { out.push_back(facts.intern(name)); });
+}
 
-    for (char c : cleaned_str) {
-        if (c >= 'A' && c <= 'Z') {
-            queries.push_back(c);
-        }
+void KnowledgeBase::lookupFactList(std::string_view list_str, std::vector<FactId>& ids,
+                                   std::vector<std::string_view>& names) const {
+    splitFactList(facts, list_str, [&](std::string_view name) {
+        ids.push_back(facts.find(name));
+        names.push_back(name);
+    });
+}
+
+void KnowledgeBase::parseInitialFacts(std::string_view fact_str, bool interactive) {
+    // リセットモードでない場合、既存の初期事実を FALSE に設定
+    if (!interactive) {
+        facts.clearKnown();
+    }
+
+    std::vector<FactId> initial;
+    parseFactList(fact_str, initial);
+    for (FactId id : initial) {
+        facts.setKnown(id, true);
     }
 }
 
+void KnowledgeBase::parseQueries(std::string_view query_str) {
+    parseFactList(query_str, queries);
+}
+
 void KnowledgeBase::loadFromFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Error: Could not open file " + filename);
+    // ファイルはメモリにマップし、行や式の文字列をコピーせずに解析する
+    // 先頭がイメージの識別子ならコンパイル済みのバイナリイメージとして解析なしで読み込む
+    // (イメージの配列はマップした領域をそのまま指すため、領域は知識ベースが保持する)
+    auto file = std::make_shared<const MappedFile>(filename);
+    if (isImage(file->view())) {
+        auto start = std::chrono::steady_clock::now();
+        loadImage(file);
+        stats.parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        resetFacts();
+        return;
     }
+    loadFromBuffer(file->view());
+}
 
-    std::string line;
-    while (std::getline(file, line)) {
-        size_t non_comment_start = line.find_first_not_of(" \t");
-        if (non_comment_start == std::string::npos || line[non_comment_start] == '#') {
-            continue;
-        }
+void KnowledgeBase::loadFromBuffer(std::string_view buffer) {
+    // 大きな入力はチャンクごとに並列で解析し、ファイル中の順序で結合する
+    // (ルール番号・事実 ID・最初に報告する構文エラーは逐次解析と同じになる)
+    auto start = std::chrono::steady_clock::now();
+    std::vector<ParsedChunk> chunks;
+    parseBuffer(buffer, chunks, parse_threads);
+    for (ParsedChunk& chunk : chunks) {
+        mergeChunk(chunk);
+    }
+    buildComponents(facts.size());
+    stats.parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-        std::string cleaned_line = line.substr(non_comment_start);
-        
-        size_t inline_comment_pos = cleaned_line.find('#');
-        if (inline_comment_pos != std::string::npos) {
-            cleaned_line = cleaned_line.substr(0, inline_comment_pos);
-        }
-        size_t last_char = cleaned_line.find_last_not_of(" \t\n\r");
-        if (last_char == std::string::npos) continue; // 行が空になった場合
-        cleaned_line = cleaned_line.substr(0, last_char + 1);
+    resetFacts(); // 初期事実を TRUE にした状態から推論を始める
+}
 
-        if (cleaned_line.empty()) continue; //コメント削除後に空になった場合
+// --- KnowledgeBase 実行と出力 ---
 
-        if (cleaned_line.front() == '?') {
-            parseQueries(cleaned_line.substr(1));
-        } else if (cleaned_line.front() == '=') {
-            parseInitialFacts(cleaned_line.substr(1));
-        } else if (cleaned_line.find("=>") != std::string::npos || 
-                   cleaned_line.find("<=>") != std::string::npos) {
-            parseRule(cleaned_line);
-        }
+void KnowledgeBase::recordQuery(uint64_t evaluations_before) {
+    stats.queries++;
+    stats.max_rule_evaluations_per_query = std::max(stats.max_rule_evaluations_per_query,
+                                                    stats.rule_evaluations - evaluations_before);
+}
+
+SatEvaluator& KnowledgeBase::satEvaluator() {
+    if (!sat) sat = std::make_unique<SatEvaluator>(*this, facts.size());
+    return *sat;
+}
+
+FactState KnowledgeBase::satState(FactId id) {
+    // 読み込み後に登録された事実はどのルールにも現れないため、初期事実かどうかだけで決まる
+    if (id >= satEvaluator().factCount()) return facts.isKnown(id) ? FactState::TRUE : FactState::FALSE;
+    return sat->decide(id, collect_stats ? &stats : nullptr);
+}
+
+FactState KnowledgeBase::bddState(FactId id) {
+    if (!bdd) bdd = std::make_unique<BddEvaluator>(*this, facts.size(), bdd_order, bdd_node_limit);
+    if (bdd->compile(id)) {
+        if (collect_stats) stats.bdd_nodes = std::max<uint64_t>(stats.bdd_nodes, bdd->nodeCount());
+        return bdd->evaluate(id, facts.knownBits());
     }
+    // 読み込み後に登録された事実は初期事実かどうかだけで決まる
+    if (id >= bdd->factCount()) return facts.isKnown(id) ? FactState::TRUE : FactState::FALSE;
+    if (collect_stats) stats.bdd_fallbacks++;
+    return isFactTrue(id);
+}
 
-    saveInitialState(); // インタラクティブモード用に初期状態を保存
+FactState KnowledgeBase::queryState(FactId id) {
+    if (mode == InferenceMode::SAT) {
+        if (collect_stats) recordQuery(stats.rule_evaluations);
+        FactState result = satState(id);
+        facts.setState(id, result); // json 表示用 (導出記録はない)
+        return result;
+    }
+    if (mode == InferenceMode::BACKWARD || mode == InferenceMode::BDD) {
+        // BDD モードの結果は facts に書かない (コンパイルできないクエリの後向き連鎖が未評価の状態を読むため)
+        const uint64_t evaluations_before = stats.rule_evaluations;
+        FactState result = (mode == InferenceMode::BDD) ? bddState(id) : isFactTrue(id);
+        if (collect_stats) recordQuery(evaluations_before);
+        return result;
+    }
+    // 前向き連鎖では事実の独立部分を (未導出なら) 導出し、状態を読むだけ
+    const uint64_t evaluations_before = stats.rule_evaluations;
+    derivePart(id);
+    if (collect_stats) recordQuery(evaluations_before);
+    return facts.state(id);
 }
 
-// --- KnowledgeBase 実行と出力 ---
+void KnowledgeBase::evaluateQueries(std::vector<FactState>& results) {
+    results.resize(queries.size());
+    evaluateQueries(queries.data(), queries.size(), results.data());
+}
 
-void KnowledgeBase::runQueries(bool verbose) {
-    // 1. 全ての状態をリセット (インタラクティブモードからの呼び出しに備える)
-    resetFacts();
+void KnowledgeBase::evaluateQueries(const FactId* query_ids, size_t count, FactState* results) {
+    auto start = std::chrono::steady_clock::now();
+    updateDerivedState();
+    for (size_t q = 0; q < count; ++q) {
+        results[q] = queryState(query_ids[q]);
+    }
+    if (collect_stats) {
+        stats.inference_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
 
-    // 2. OR/XOR伝播を繰り返す (ボーナス)
-    propagate_Undetermined(); 
+void KnowledgeBase::runQueries(bool verbose) {
+    // 1-2. 推論状態を初期事実に追従させる
+    //      初回 (や推論方式の切り替え後) は全体をリセット (前向き連鎖では全体を推論) し、
+    //      以降は変更された初期事実の下流だけを無効化・再計算する
+    auto start = std::chrono::steady_clock::now();
+    updateDerivedState();
+    if (mode == InferenceMode::SAT && !satEvaluator().consistent(collect_stats ? &stats : nullptr)) {
+        std::cout << "Warning: the rules contradict the initial facts; no query is forced TRUE or FALSE." << std::endl;
+    }
 
     // 3. クエリを実行し、結果を出力
-    for (char query_fact : queries) {
-        FactState result = isFactTrue(query_fact);
+    for (FactId query_id : queries) {
+        const std::string_view query_fact = facts.name(query_id);
+        FactState result = queryState(query_id);
+        if (collect_stats) {
+            stats.inference_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
         std::string result_str;
         
         if (result == FactState::TRUE) {
@@ -463,49 +961,226 @@ void KnowledgeBase::runQueries(bool verbose) {
         if (verbose) {
             // 推論の可視化 (ボーナス)
             std::cout << "--- Reasoning for " << query_fact << " ---" << std::endl;
-            if (result == FactState::TRUE) {
-                for (const auto& reason : facts[query_fact].true_reasons) {
-                    std::cout << "  - " << reason << std::endl;
+            printReasoning(query_id, result);
+            std::cout << "--------------------------" << std::endl;
+        }
+        start = std::chrono::steady_clock::now(); // 出力の時間は推論時間に含めない
+    }
+    reportContradictions();
+}
+
+void KnowledgeBase::reportContradictions() {
+    // SAT モードの矛盾はルール全体の充足不能として警告済み、BDD モードは事実の状態を書かないため対象外
+    if (mode == InferenceMode::SAT || mode == InferenceMode::BDD) return;
+    facts.contradictions(contradiction_buffer);
+    for (FactId id : contradiction_buffer) {
+        std::cout << "Warning: contradiction: " << facts.name(id) << " is proven both TRUE and FALSE";
+        facts.derivationsOf(id, derivation_buffer);
+        for (const Derivation& derivation : derivation_buffer) {
+            if (derivation.kind == DerivationKind::NEGATION) {
+                std::cout << " (" << ruleToString(rules[derivation.rule]) << ")";
+                break;
+            }
+        }
+        std::cout << std::endl;
+    }
+}
+
+// --- KnowledgeBase 推論の説明 (導出記録から表示時に作る) ---
+
+std::string KnowledgeBase::derivationToString(const Derivation& derivation) const {
+    const Rule& rule = rules[derivation.rule];
+    if (derivation.kind == DerivationKind::NEGATION) {
+        return "Derived FALSE from Rule: " + ruleToString(rule) + " (Premise was TRUE)";
+    }
+    if (derivation.kind == DerivationKind::ELIMINATION) {
+        return "Derived TRUE by elimination from Rule: " + ruleToString(rule) +
+               " (All other conclusions were determined to be FALSE or resolved)";
+    }
+    return "Derived TRUE from Rule: " + ruleToString(rule) + " (Premise was TRUE)";
+}
+
+void KnowledgeBase::printReasoning(FactId id, FactState result) {
+    if (mode == InferenceMode::SAT) {
+        // SAT モードは導出を記録せず、全モデルでの値だけを判定する
+        if (result == FactState::TRUE) {
+            std::cout << "  Fact is TRUE in every model of the rules and initial facts (SAT)." << std::endl;
+        } else if (result == FactState::FALSE) {
+            std::cout << "  Fact is FALSE in every model of the rules and initial facts (SAT)." << std::endl;
+        } else {
+            std::cout << "  Fact is UNDETERMINED. Both TRUE and FALSE are consistent with the rules and initial facts (SAT)." << std::endl;
+        }
+        return;
+    }
+    if (mode == InferenceMode::BDD && bdd && bdd->compiled(id)) {
+        // BDD は導出を記録せず、初期事実の組み合わせに対する結果だけを持つ
+        static const char* const STATE_NAMES[] = {"TRUE", "FALSE", "UNDETERMINED"};
+        std::cout << "  Fact is " << STATE_NAMES[static_cast<int>(result)]
+                  << " for these initial facts in the compiled BDD (same result as backward chaining)." << std::endl;
+        return;
+    }
+    facts.derivationsOf(id, derivation_buffer);
+    if (result == FactState::TRUE || (result == FactState::FALSE && !derivation_buffer.empty())) {
+        for (const Derivation& derivation : derivation_buffer) {
+            std::cout << "  - " << derivationToString(derivation) << std::endl;
+        }
+    } else if (result == FactState::UNDETERMINED) {
+        std::cout << "  Fact is UNDETERMINED. Premise of a relevant rule was UNDETERMINED." << std::endl;
+    } else {
+        std::cout << "  Fact is FALSE (by default/not proven by any rule)." << std::endl;
+    }
+}
+
+static const char* stateName(FactState state) {
+    if (state == FactState::TRUE) return "true";
+    if (state == FactState::FALSE) return "false";
+    return "undetermined";
+}
+
+std::string KnowledgeBase::explanationToJson(FactId id) const {
+    // id から導出記録をたどって到達する事実を 1 度ずつ節点として並べる (識別子は英数字と '_' のみなのでエスケープ不要)
+    std::vector<FactId> nodes = {id};
+    std::vector<bool> visited(facts.size(), false);
+    visited[id] = true;
+    std::vector<Derivation> node_derivations;
+
+    std::string json = "{\"fact\":\"" + std::string(facts.name(id)) + "\",\"state\":\"" + stateName(facts.state(id)) + "\",\"proof\":[";
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        const FactId fact = nodes[n];
+        if (n > 0) json += ',';
+        json += "{\"fact\":\"";
+        json += facts.name(fact);
+        json += "\",\"state\":\"";
+        json += stateName(facts.state(fact));
+        json += "\",\"initial\":";
+        json += facts.isKnown(fact) ? "true" : "false";
+        if (facts.contradicts(fact)) json += ",\"contradiction\":true";
+        json += ",\"derivations\":[";
+
+        facts.derivationsOf(fact, node_derivations);
+        for (size_t d = 0; d < node_derivations.size(); ++d) {
+            const Derivation& derivation = node_derivations[d];
+            const Rule& rule = rules[derivation.rule];
+            if (d > 0) json += ',';
+            json += "{\"rule\":" + std::to_string(derivation.rule + 1);
+            json += derivation.kind == DerivationKind::ELIMINATION ? ",\"kind\":\"elimination\""
+                  : derivation.kind == DerivationKind::NEGATION ? ",\"kind\":\"negation\"" : ",\"kind\":\"rule\"";
+            json += ",\"text\":\"" + ruleToString(rule) + "\",\"supports\":[";
+
+            // 裏付け: RULE・NEGATION は前提部の事実、ELIMINATION は結論部の他の事実
+            uint32_t begin = rule.premise_facts_begin;
+            uint32_t end = rule.premise_facts_end;
+            if (derivation.kind == DerivationKind::ELIMINATION) {
+                begin = rule.conclusion_facts_begin;
+                end = rule.conclusion_facts_end;
+            }
+            bool first = true;
+            for (uint32_t i = begin; i < end; ++i) {
+                const FactId support = fact_pool[i];
+                if (support == fact) continue;
+                if (!first) json += ',';
+                first = false;
+                json += '"';
+                json += facts.name(support);
+                json += '"';
+                if (!visited[support]) {
+                    visited[support] = true;
+                    nodes.push_back(support);
                 }
-            } else {
-                std::cout << "  " << facts[query_fact].final_state_reason << std::endl;
             }
-            std::cout << "--------------------------" << std::endl;
+            json += "]}";
         }
+        json += "]}";
     }
+    json += "]}";
+    return json;
 }
 
-void KnowledgeBase::saveInitialState() {
-    initial_fact_states.clear();
-    for (const auto& pair : facts) {
-        initial_fact_states[pair.first] = pair.second.currentState;
+void KnowledgeBase::evaluateScenario(const std::vector<FactId>& initial, const std::vector<FactId>& query_ids,
+                                     std::vector<FactState>& results) {
+    // 同じクエリの間は影響範囲 (scenario_slice) を使い回し、初期事実の差し替えと範囲の事実・成分のリセットだけを行う
+    // (範囲外の状態は読まないため古いままでよい。最初のシナリオとクエリが変わったときだけ全体をリセットする)
+    if (scenario_active) {
+        for (FactId id : scenario_initial) facts.setKnown(id, false);
+    } else {
+        facts.clearKnown();
+    }
+    for (FactId id : initial) facts.setKnown(id, true);
+    scenario_initial = initial;
+
+    if (scenario_active && scenario_slice.queries == query_ids) {
+        facts.reset(scenario_slice.facts);
+        for (uint32_t component : scenario_slice.components) component_resolved.reset(component);
+    } else {
+        buildSlice(query_ids, scenario_slice);
+        resetFacts();
+        scenario_active = true;
+    }
+    if (collect_stats) stats.slice_facts = std::max<uint64_t>(stats.slice_facts, scenario_slice.facts.size());
+    if (mode == InferenceMode::FORWARD) runForwardChaining(scenario_slice.rules, &scenario_slice.rule_bits);
+    if (mode == InferenceMode::SAT) {
+        SatEvaluator& evaluator = satEvaluator();
+        for (FactId id = 0; id < evaluator.factCount(); ++id) evaluator.setInitial(id, facts.isKnown(id));
+    }
+    derived_valid = false; // インタラクティブモードの推論状態は作り直す
+
+    results.clear();
+    for (FactId id : query_ids) {
+        const uint64_t evaluations_before = stats.rule_evaluations;
+        if (mode == InferenceMode::SAT) {
+            results.push_back(satState(id));
+        } else if (mode == InferenceMode::BDD) {
+            results.push_back(bddState(id));
+        } else {
+            results.push_back(mode == InferenceMode::FORWARD ? facts.state(id) : isFactTrue(id));
+        }
+        if (collect_stats) recordQuery(evaluations_before);
     }
 }
 
 void KnowledgeBase::resetFacts() {
-    // 全ての事実の状態と推論フラグをリセット
-    for (auto& pair : facts) {
-        pair.second.currentState = FactState::FALSE;
-        pair.second.isProcessing = false;
-        pair.second.true_reasons.clear();
-        pair.second.final_state_reason.clear();
+    // 全ての事実の状態と成分の評価済みフラグをリセットし、初期状態 (入力ファイルやインタラクティブ設定で TRUE になったもの) を復元
+    facts.reset();
+    scenario_active = false;
+    component_resolved.resize(componentCount());
+    component_resolved.clear();
+    dirty_facts.resize(component_facts.size());
+    dirty_eliminations.resize(component_eliminations.size());
+    open_disjuncts.resize(component_eliminations.size());
+}
+
+void KnowledgeBase::applyRuleEdit(std::string_view command) {
+    // "+ <ルール>" は追加、"- <ルール>" は同じ式のルールを取り除く (推論結果は次のクエリで変更の下流だけ再計算する)
+    std::string_view rule_line = command.substr(1);
+    trimLine(rule_line);
+    std::vector<size_t> removed;
+    std::vector<std::string_view> added;
+    if (command.front() == '+') {
+        added.push_back(rule_line);
+    } else {
+        findRules(rule_line, removed);
     }
-    
-    // 初期状態を復元 (入力ファイルやインタラクティブ設定で TRUE になったもの)
-    for (const auto& pair : initial_fact_states) {
-        if (pair.second == FactState::TRUE) {
-             facts[pair.first].currentState = FactState::TRUE;
-        }
+    RuleUpdate update;
+    updateRules(removed, added, update);
+    if (command.front() == '+') {
+        std::cout << "Added " << update.added_rules << " rules. Run query with '?'" << std::endl;
+    } else {
+        std::cout << "Removed " << update.removed_rules << " rules. Run query with '?'" << std::endl;
     }
 }
 
-void KnowledgeBase::runInteractiveMode() {
+void KnowledgeBase::runInteractiveMode(RuleFileWatcher* watcher) {
     std::cout << "\n--- Interactive Fact Validation Mode ---" << std::endl;
     std::cout << "Commands:" << std::endl;
     std::cout << "  ? <Facts> : Run queries (e.g., ?GVX)" << std::endl;
     std::cout << "  = <Facts> : Set facts to TRUE (e.g., =A B)" << std::endl;
     std::cout << "  ! <Facts> : Set facts to FALSE (e.g., !C)" << std::endl;
+    std::cout << "  + <Rule>  : Add a rule (e.g., + A + B => C)" << std::endl;
+    std::cout << "  - <Rule>  : Remove a rule (e.g., - A + B => C)" << std::endl;
     std::cout << "  log       : Toggle verbose output (Reasoning Visualization)" << std::endl;
+    std::cout << "  json <Facts> : Evaluate facts and print their proof graphs as JSON (e.g., json GV)" << std::endl;
+    std::cout << "  mode      : Cycle inference mode (backward/forward chaining, SAT, BDD)" << std::endl;
+    std::cout << "  stats     : Show inference statistics (stats on|off|reset)" << std::endl;
     std::cout << "  exit      : Exit interactive mode" << std::endl;
     std::cout << "----------------------------------------" << std::endl;
 
@@ -513,36 +1188,91 @@ void KnowledgeBase::runInteractiveMode() {
     bool verbose = true; // 可視化をデフォルトでオン
 
     while (std::cout << "KB> " && std::getline(std::cin, command)) {
+        if (watcher) {
+            // 前のコマンドの後にルールファイルが書き換えられていれば、変わった行のルールだけを反映する
+            try {
+                RuleUpdate update;
+                if (watcher->poll(*this, update)) {
+                    std::cout << "Rules reloaded: " << update.added_rules << " added, " << update.removed_rules
+                              << " removed." << std::endl;
+                }
+            } catch (const std::exception& e) {
+                std::cout << e.what() << std::endl;
+            }
+        }
         if (command == "exit") break;
         if (command == "log") {
             verbose = !verbose;
             std::cout << "Verbose output is " << (verbose ? "ON" : "OFF") << "." << std::endl;
             continue;
         }
+        if (command == "stats") {
+            std::cout << "--- Inference Statistics (collection " << (collect_stats ? "ON" : "OFF") << ") ---" << std::endl;
+            stats.print(std::cout);
+            std::cout << "--------------------------" << std::endl;
+            continue;
+        }
+        if (command == "stats on" || command == "stats off") {
+            collect_stats = (command == "stats on");
+            std::cout << "Statistics collection is " << (collect_stats ? "ON" : "OFF") << "." << std::endl;
+            continue;
+        }
+        if (command == "stats reset") {
+            stats.clear();
+            std::cout << "Statistics reset." << std::endl;
+            continue;
+        }
+        if (command == "mode") {
+            static const char* const MODE_NAMES[] = {"BACKWARD", "FORWARD", "SAT", "BDD"};
+            setMode((mode == InferenceMode::BACKWARD) ? InferenceMode::FORWARD
+                    : (mode == InferenceMode::FORWARD) ? InferenceMode::SAT
+                    : (mode == InferenceMode::SAT) ? InferenceMode::BDD : InferenceMode::BACKWARD);
+            std::cout << "Inference mode is " << MODE_NAMES[static_cast<int>(mode)] << "." << std::endl;
+            continue;
+        }
 
-        // 1. 推論結果をリセットし、初期状態を復元
-        resetFacts();
-        
+        // "json" の後は空白か行末 ("jsonX" などは事実の並びとして読まない)
+        if (command.compare(0, 4, "json") == 0 &&
+            (command.size() == 4 || std::isspace(static_cast<unsigned char>(command[4])))) {
+            std::vector<FactId> ids;
+            parseFactList(std::string_view(command).substr(4), ids);
+            updateDerivedState();
+            for (FactId id : ids) {
+                // BDD モードは導出を記録しないため、証明 DAG は後向き連鎖で求める
+                if (mode == InferenceMode::BDD) {
+                    isFactTrue(id);
+                } else {
+                    queryState(id);
+                }
+                std::cout << explanationToJson(id) << std::endl;
+            }
+            continue;
+        }
+
+        // 推論結果は保持し、初期事実の変更は次のクエリで差分として反映する
         if (command.front() == '?') {
             queries.clear();
             parseQueries(command.substr(1));
             runQueries(verbose);
         } else if (command.front() == '=') {
             // 現在の知識ベースの状態に上書き
-            std::string fact_str = command.substr(1);
-            fact_str.erase(std::remove_if(fact_str.begin(), fact_str.end(), ::isspace), fact_str.end());
-            for (char c : fact_str) {
-                if (c >= 'A' && c <= 'Z') initial_fact_states[c] = FactState::TRUE;
-            }
+            std::vector<FactId> changed;
+            parseFactList(command.substr(1), changed);
+            for (FactId id : changed) setInitialFact(id, true);
             std::cout << "Facts set to TRUE. Run query with '?'" << std::endl;
         } else if (command.front() == '!') {
             // 現在の知識ベースの状態に上書き
-            std::string fact_str = command.substr(1);
-            fact_str.erase(std::remove_if(fact_str.begin(), fact_str.end(), ::isspace), fact_str.end());
-            for (char c : fact_str) {
-                if (c >= 'A' && c <= 'Z') initial_fact_states[c] = FactState::FALSE;
-            }
+            std::vector<FactId> changed;
+            parseFactList(command.substr(1), changed);
+            for (FactId id : changed) setInitialFact(id, false);
             std::cout << "Facts set to FALSE. Run query with '?'" << std::endl;
+        } else if (command.front() == '+' || command.front() == '-') {
+            // 構文エラーや見つからないルールは報告して続ける (知識ベースは変更されない)
+            try {
+                applyRuleEdit(command);
+            } catch (const std::exception& e) {
+                std::cout << e.what() << std::endl;
+            }
         } else {
             std::cout << "Unknown command." << std::endl;
         }
@@ -1,66 +1,191 @@
 #ifndef KNOWLEDGEBASE_H
 #define KNOWLEDGEBASE_H
 
+#include "BddEvaluator.h"
 #include "Fact.h"
+#include "InferenceStats.h"
 #include "Expression.h"
-#include <map>
+#include "RuleBase.h"
+#include "RuleParser.h"
+#include "SatEvaluator.h"
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
 
-class Rule {
-    public:
-        std::unique_ptr<Expression> antecedent; // 前提部 (AST)
-        std::unique_ptr<Expression> consequent; // 結論部 (AST)
+// 推論方式: 後向き連鎖 (クエリごとに再帰) / 前向き連鎖 (クエリの事実を含む独立部分の全事実を一度に導出) / SAT (CNF に符号化して厳密に判定) /
+// BDD (後向き連鎖の結果をクエリごとに BDD にコンパイルし、初期事実から 1 度たどるだけで答える)
+enum class InferenceMode { BACKWARD, FORWARD, SAT, BDD };
 
-        std::string to_string() const;
+// 実行時のルールの変更の結果 (KnowledgeBase::updateRules)
+struct RuleUpdate {
+    std::vector<size_t> rule_begin; // 追加した行 i のルールは rules[rule_begin[i], rule_begin[i + 1])
+    std::vector<FactId> cone; // 推論結果が変わりうる事実 (変更したルールの結論とその下流。reset のときは空)
+    size_t added_rules = 0;
+    size_t removed_rules = 0;
+    bool rebuilt = false; // 成分を全体で作り直した (成分と独立部分の番号が変わった)
+    bool reset = false; // 下流を求めずに推論状態を全体で捨てた (rebuilt のとき、または下流が知識ベースの大半に及ぶとき)
 };
 
-class KnowledgeBase {
+class RuleFileWatcher;
+
+// ルール集合 (RuleBase) に、事実の表・クエリと単一スレッドの推論状態を加えたもの
+// 複数スレッドで評価する場合は RuleBase 部分だけを const で共有する
+class KnowledgeBase : public RuleBase {
     public:
-        std::map<char, Fact> facts;
-        std::vector<Rule> rules;
-        std::vector<char> queries;
+        FactTable facts; // 事実の状態 (ID で引く)
+        std::vector<FactId> queries;
+
+        InferenceMode mode = InferenceMode::BACKWARD;
 
-        // ボーナス: インタラクティブモード用の初期状態
-        std::map<char, FactState> initial_fact_states; 
+        // BDD モードの変数順序とノード数の上限 (最初のコンパイルより前に設定する)
+        BddOrder bdd_order = BddOrder::DEPTH_FIRST;
+        size_t bdd_node_limit = BddEvaluator::DEFAULT_NODE_LIMIT;
+
+        // 大きなルールファイルを解析するスレッド数の上限 (0 はハードウェアのスレッド数、読み込みより前に設定する)
+        size_t parse_threads = 0;
+
+        // 推論の計測 (collect_stats が false の間は読み込み時間以外を収集しない)
+        bool collect_stats = false;
+        InferenceStats stats;
 
         // I/O & 初期化
         void loadFromFile(const std::string& filename);
+        void loadFromBuffer(std::string_view buffer); // ファイル内容と同じ形式の文字列から読み込む
+        void saveImage(const std::string& filename) const; // コンパイル済みのバイナリイメージを書き出す
+        void emitCpp(const std::string& filename) const; // クエリの評価関数を自己完結した C++ のヘッダとして書き出す
         void runQueries(bool verbose = false);
-        void runInteractiveMode();
+        void runInteractiveMode(RuleFileWatcher* watcher = nullptr); // watcher があればコマンドの前にファイルの変更を反映する
+
+        // runQueries と同じ推論を出力なしで行い、queries の結果を results に書き込む
+        void evaluateQueries(std::vector<FactState>& results);
+        // query_ids[0, count) を同じ手順で評価し、results[0, count) に書き込む (呼び出し元が確保した配列)
+        void evaluateQueries(const FactId* query_ids, size_t count, FactState* results);
+
+        // 推論方式を切り替える (次のクエリで全体を推論し直す)
+        void setMode(InferenceMode new_mode);
+
+        // 初期事実を変更する (次の runQueries ではこの事実の下流だけを再計算する)
+        void setInitialFact(FactId id, bool value);
+
+        // ルールを実行時に取り除き (removed はルール番号)、ルールの行 added_lines を追加する
+        // 索引と成分は変更したルールの結論の下流だけを作り直し、推論状態もその範囲だけを無効化する
+        // 行の構文エラーや存在しないルール番号は std::runtime_error (その場合は何も変更しない)
+        // 取り除いたルールは番号を保つため rules に残り (Rule::removed)、追加したルールは末尾に並ぶ
+        void updateRules(const std::vector<size_t>& removed, const std::vector<std::string_view>& added_lines,
+                         RuleUpdate& update);
+        // ルールの行 rule_line (AND 分解・<=> 分解で複数になりうる) と同じ式の、取り除かれていないルールの番号を out に加える
+        // 同じルールが複数あれば最後に追加されたものから選ぶ。見つからないルールがあれば std::runtime_error
+        void findRules(std::string_view rule_line, std::vector<size_t>& out) const;
+
+        // 初期事実 initial のシナリオで query_ids を評価し、結果を results に書き込む (出力なし)
+        // runQueries と同じ手順で、初期事実は initial で置き換えられる
+        void evaluateScenario(const std::vector<FactId>& initial, const std::vector<FactId>& query_ids,
+                              std::vector<FactState>& results);
+
+        // ルールの表示 (例: "(A+B) => C")
+        std::string ruleToString(const Rule& rule) const;
+
+        // id の現在の状態と、導出記録からたどれる証明 DAG を 1 行の JSON で返す
+        // (例: {"fact":"C","state":"true","proof":[{"fact":"C",...,"derivations":[{"rule":1,"kind":"rule",...,"supports":["A","B"]}]},...]})
+        std::string explanationToJson(FactId id) const;
+
+        // 事実の並び (例: "A B", "GVX") を登録せずに ID に変換する (未登録の事実は NO_FACT)
+        // names には各事実の識別子 (list_str の一部) を同じ順に追加する
+        void lookupFactList(std::string_view list_str, std::vector<FactId>& ids,
+                            std::vector<std::string_view>& names) const;
 
         // 推論エンジン
-        FactState isFactTrue(char symbol); 
+        FactState isFactTrue(FactId id); 
+        void runForwardChaining(); // 初期事実から導出できる全事実を不動点まで求める
 
     private:
         // 推論ヘルパー
         void resetFacts();
-        void saveInitialState();
-        void propagate_Undetermined(); // ボーナス: OR/XOR結論からの伝播
-
-        // パーサーの状態とメソッド
-        std::string input_str;
-        size_t current_pos = 0;
-        
-        void skipWhitespace();
-        char peek() const;
-        void consume();
-        void syntaxError(const std::string& message);
+        void updateDerivedState(); // 推論状態を初期事実の変更に追従させる
+        FactState satState(FactId id); // SAT モードでの id の判定
+        SatEvaluator& satEvaluator(); // 初回の呼び出しで知識ベースを CNF に符号化する
+        FactState bddState(FactId id); // BDD モードでの id の評価 (コンパイルできなければ後向き連鎖)
+        FactState queryState(FactId id); // クエリ 1 つの結果 (推論方式に応じて評価または導出済みの状態)
+        void recordQuery(uint64_t evaluations_before); // クエリ 1 つ分の計測値を stats に加える
+        void invalidateCone(std::vector<size_t>& affected_rules); // 変更された初期事実の下流を無効化
+        void resolveComponents(uint32_t root); // root と未評価の依存先の成分をトポロジカル順に評価
+        void resolveComponent(uint32_t component); // 成分内の不動点を求める (OR/XOR 結論の消去法を含む)
+        void markDependents(FactId id, FactState before); // 成分内で状態が変わった事実を参照するものを再評価待ちにする
+        // seed_rules から前向き連鎖を行う (allowed_rules があればそれ以外のルールは再評価待ちにしない)
+        void runForwardChaining(const std::vector<size_t>& seed_rules, const Bitset* allowed_rules = nullptr);
+        void derivePart(FactId id); // 前向き連鎖: id の独立部分が未導出なら、その部分のルールだけで導出する
+        void compileRule(const ParsedRule& parsed); // 取り込み済みの式から事実リストを生成して rules に追加
+        void applyRuleEdit(std::string_view command); // インタラクティブモードの "+ <ルール>" / "- <ルール>"
+        std::string expressionToString(ExprId id) const; // 式の節点を表記に戻す
+        FactState evaluateRule(const Rule& rule); // コンパイル済み前提部を現在の事実の状態で評価
+        FactState evaluateExpression(ExprId root); // 部分式の値を事実の表の版ごとにメモしながら評価
+        FactState evaluateRule(const Rule& rule, uint32_t component); // 成分 component の評価中の前提部の評価
+        FactState evaluateGuarded(ExprId root, uint32_t component); // 成分内の事実の否定・XOR を未決定として評価
+        bool raiseState(FactId id, FactState state); // FALSE < UNDETERMINED < TRUE の順にのみ更新
+        bool proveFalse(FactId id); // 偽の rail を立てる (UNDETERMINED から FALSE に下がったら true)
+        void reportContradictions(); // 両方の rail が立っている事実を警告として表示
+
+        // 推論の可視化 (log 表示)
+        std::string derivationToString(const Derivation& derivation) const;
+        void printReasoning(FactId id, FactState result);
+        std::vector<Derivation> derivation_buffer;
+        std::vector<FactId> contradiction_buffer;
+
+        // 後向き連鎖: 評価済みの成分と、resolveComponents の探索スタック (成分, 次に調べる依存先)
+        Bitset component_resolved;
+        std::vector<std::pair<uint32_t, uint32_t>> component_stack;
+        std::vector<std::pair<FactId, uint32_t>> pending_eliminations; // (事実, ルール番号)
+        // 成分内の差分評価: 再評価待ちの事実 (component_facts の位置) と OR/XOR ルール (component_eliminations の添字)、
+        // OR/XOR ルールごとの TRUE でない選言肢の数
+        Bitset dirty_facts;
+        Bitset dirty_eliminations;
+        std::vector<uint32_t> open_disjuncts;
+        std::vector<FactId> deferred_false; // 循環を含む成分で、不動点の後に偽と証明する事実
+
+        // SAT モードの評価器 (使うまで符号化しない)
+        std::unique_ptr<SatEvaluator> sat;
+        // BDD モードの評価器 (クエリの図は初めて問われたときにコンパイルする)
+        std::unique_ptr<BddEvaluator> bdd;
+
+        // 式の節点ごとの評価結果のメモ (node_epochs[e] == facts.version() の間だけ有効) と作業領域
+        std::vector<FactState> node_values;
+        std::vector<uint64_t> node_epochs;
+        std::vector<ExprId> expression_stack;
+        // evaluateGuarded の作業領域 (guard_epochs[e] == guard_epoch の間だけ有効、呼び出しごとに進める)
+        std::vector<FactState> guard_values;
+        std::vector<uint8_t> guard_internal;
+        std::vector<uint64_t> guard_epochs;
+        uint64_t guard_epoch = 0;
+
+        // 前向き連鎖の再評価待ちルールと、導出済みの独立部分
+        std::vector<size_t> agenda;
+        Bitset agenda_queued;
+        Bitset part_derived;
+
+        // インタラクティブモードの差分再計算
+        bool derived_valid = false; // 現在の推論状態が初期事実 (の変更前) に対して計算済みか
+        std::vector<FactId> changed_facts; // 前回の推論以降に変更された初期事実
+        // invalidateCone の作業領域 (繰り返しの問い合わせで確保し直さない)
+        Bitset cone_bits;
+        std::vector<FactId> cone_facts;
+        std::vector<size_t> affected_rule_buffer;
+
+        // evaluateScenario: クエリの影響範囲と直前のシナリオの初期事実
+        // scenario_active の間は範囲外の事実の状態を読まないため、範囲の事実と成分だけをリセットする
+        QuerySlice scenario_slice;
+        std::vector<FactId> scenario_initial;
+        bool scenario_active = false;
+
+        // バイナリイメージ (KnowledgeBaseImage.cpp)
+        static bool isImage(std::string_view buffer);
+        void loadImage(std::shared_ptr<const MappedFile> file);
 
         // I/O パーサー
-        void parseRule(const std::string& rule_str);
-        void parseInitialFacts(const std::string& fact_str, bool interactive = false);
-        void parseQueries(const std::string& query_str);
-        void addImpliesRule(const std::string& antecedent_str, const std::string& consequent_str);
-        
-        // 論理式パーサー (AST構築)
-        std::unique_ptr<Expression> parseExpression(const std::string& str);
-        std::unique_ptr<Expression> parse_XOR(); 
-        std::unique_ptr<Expression> parse_OR(); 
-        std::unique_ptr<Expression> parse_AND(); 
-        std::unique_ptr<Expression> parse_NOT(); 
-        std::unique_ptr<Expression> parse_Factor();
+        void mergeChunk(ParsedChunk& chunk); // チャンクの解析結果をファイル順に取り込む
+        void parseInitialFacts(std::string_view fact_str, bool interactive = false);
+        void parseQueries(std::string_view query_str);
+        void parseFactList(std::string_view list_str, std::vector<FactId>& out); // "=A B" や "?GVX" の事実の並び
 };
 
 #endif
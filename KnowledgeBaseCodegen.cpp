@@ -0,0 +1,497 @@
+#include "KnowledgeBase.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+// --emit-cpp: 後向き連鎖の手順を、クエリの影響範囲の成分ごとに直線的な C++ に展開する
+// 生成するコードの事実の状態は BatchEvaluator と同じ 64 レーンの dual-rail で、評価順 (依存先の成分から) と
+// 成分内の手順 (否定の結論、結論とするルール、OR/XOR 結論の消去法) は KnowledgeBase::resolveComponent と同じ
+// 非循環の成分は 1 度のパスで確定するため分岐なしの代入の列に、循環を含む成分は全体を走査するパスを
+// 変化がなくなるまで繰り返すループになる (成分内の位置順に再評価するため、結果は差分評価と一致する)
+// 循環を含む成分では、否定や XOR を通して成分内の事実を読む部分式を UNDETERMINED ({0, 0}) とし、
+// 成分内の事実を読む否定の結論はループの後に評価する (KnowledgeBase::evaluateGuarded と同じ)
+class CppEmitter {
+    public:
+        explicit CppEmitter(const KnowledgeBase& kb) : kb(kb) {
+            // 成分の順位: 依存先の成分ほど小さい (実行時のルールの変更で作り直した成分は番号順がトポロジカル順でないため、
+            // 依存先をたどる帰りがけ順で振り直す)
+            component_rank.assign(kb.componentCount(), UINT32_MAX);
+            uint32_t next_rank = 0;
+            std::vector<std::pair<uint32_t, uint32_t>> stack;
+            for (FactId id = 0; id < kb.fact_component.size(); ++id) {
+                if (component_rank[kb.fact_component[id]] != UINT32_MAX) continue;
+                stack.emplace_back(kb.fact_component[id], kb.dependency_begin[kb.fact_component[id]]);
+                component_rank[kb.fact_component[id]] = UINT32_MAX - 1; // 訪問中
+                while (!stack.empty()) {
+                    const uint32_t component = stack.back().first;
+                    if (stack.back().second < kb.dependency_end[component]) {
+                        const uint32_t dependency = kb.component_dependencies[stack.back().second++];
+                        if (component_rank[dependency] != UINT32_MAX) continue;
+                        component_rank[dependency] = UINT32_MAX - 1;
+                        stack.emplace_back(dependency, kb.dependency_begin[dependency]);
+                        continue;
+                    }
+                    component_rank[component] = next_rank++;
+                    stack.pop_back();
+                }
+            }
+
+            // 式の節点 -> 参照する事実の成分の順位の最大値 (子は親より前にあるので添字順に求まる)
+            node_rank.resize(kb.expressions.size());
+            for (ExprId id = 0; id < kb.expressions.size(); ++id) {
+                const ExprNode& node = kb.expressions[id];
+                if (kb.expressions.isFact(id)) {
+                    node_rank[id] = component_rank[kb.fact_component[node.left]];
+                } else {
+                    node_rank[id] = std::max(node_rank[node.left], node_rank[node.right]);
+                }
+            }
+            hoisted.resize(kb.expressions.size(), 0);
+            block_nodes.resize(kb.expressions.size(), 0);
+        }
+
+        // slice の成分を評価する関数本体 (事実 f の状態は局所変数 s<f>)
+        void emitSlice(const QuerySlice& slice, std::string& out) {
+            function_epoch++;
+            for (FactId id : slice.facts) {
+                line(out, 1, "Lanes s" + std::to_string(id) + " = detail::initial(known(" + std::to_string(id) + "u)); // " +
+                             std::string(kb.facts.name(id)));
+            }
+            for (uint32_t component : slice.components) emitComponent(component, out);
+        }
+
+    private:
+        const KnowledgeBase& kb;
+        std::vector<uint32_t> component_rank;
+        std::vector<uint32_t> node_rank;
+        // 二項演算の節点の値を入れた局所変数 e<節点> が有効な範囲: 関数の先頭 (確定した事実だけを参照する節点) と
+        // 文のブロック (評価中の成分の事実を参照し、参照するたびに計算し直す節点)
+        std::vector<uint32_t> hoisted;
+        std::vector<uint32_t> block_nodes;
+        uint32_t function_epoch = 0;
+        uint32_t block_epoch = 0;
+        std::vector<ExprId> expression_stack;
+
+        static void line(std::string& out, int depth, const std::string& text) {
+            out.append(static_cast<size_t>(depth) * 4, ' ');
+            out += text;
+            out += '\n';
+        }
+
+        static std::string state(FactId id) { return "s" + std::to_string(id); }
+
+        // guarded (循環を含む成分の評価中に成分内の事実を読む節点) なら、否定と XOR は UNDETERMINED
+        std::string operand(ExprId id, bool guarded) const {
+            const ExprNode& node = kb.expressions[id];
+            if (node.op == ExprNode::OpCode::LOAD) return state(node.left);
+            if (guarded && (node.op == ExprNode::OpCode::LOAD_NOT || node.op == ExprNode::OpCode::XOR)) return "Lanes{0, 0}";
+            if (node.op == ExprNode::OpCode::LOAD_NOT) return "detail::lnot(" + state(node.left) + ")";
+            return "e" + std::to_string(id);
+        }
+
+        // root の値を表す式を返す。必要な二項演算の節点は帰りがけ順に局所変数として書き出す
+        // (component より前の成分の事実だけを参照する節点は hoist に 1 度だけ、それ以外は block に毎回)
+        // guard が true なら循環を含む成分の評価中として、成分内の事実を否定や XOR を通して読む部分式を UNDETERMINED にする
+        // (その XOR の節点は書き出さず、部分式もたどらない)
+        std::string premise(ExprId root, uint32_t component, std::string& hoist, std::string& block, int depth, bool guard) {
+            auto guarded = [&](ExprId id) { return guard && node_rank[id] == component_rank[component]; };
+            kb.expressions.evaluate(root, expression_stack,
+                                    [&](ExprId id) {
+                                        return hoisted[id] == function_epoch || block_nodes[id] == block_epoch ||
+                                               (kb.expressions[id].op == ExprNode::OpCode::XOR && guarded(id));
+                                    },
+                                    [&](ExprId id) {
+                                        const ExprNode& node = kb.expressions[id];
+                                        const char* op = node.op == ExprNode::OpCode::AND ? "land"
+                                                         : node.op == ExprNode::OpCode::OR ? "lor" : "lxor";
+                                        const std::string text = "const Lanes e" + std::to_string(id) + " = detail::" + op + "(" +
+                                                                 operand(node.left, guarded(node.left)) + ", " +
+                                                                 operand(node.right, guarded(node.right)) + ");";
+                                        if (node_rank[id] < component_rank[component]) {
+                                            line(hoist, 1, text);
+                                            hoisted[id] = function_epoch;
+                                        } else {
+                                            line(block, depth, text);
+                                            block_nodes[id] = block_epoch;
+                                        }
+                                    });
+            return operand(root, guarded(root));
+        }
+
+        void emitComponent(uint32_t component, std::string& out) {
+            const uint32_t fact_begin = kb.component_begin[component];
+            const uint32_t fact_end = kb.component_begin[component + 1];
+            const uint32_t slot_begin = kb.elimination_begin[component];
+            const uint32_t slot_end = kb.elimination_end[component];
+            // 循環のない成分では消去法が数える選言肢はその事実だけで、結論とするルールと同じ結果になるため展開しない
+            const bool loop = kb.cyclic_components.test(component);
+            const int depth = loop ? 4 : 2;
+
+            std::string hoist;
+            std::string body;
+            std::string names;
+            for (uint32_t m = fact_begin; m < fact_end; ++m) {
+                names += ' ';
+                names.append(kb.facts.name(kb.component_facts[m]));
+            }
+            line(hoist, 1, std::string("// 成分 ") + std::to_string(component) + (loop ? " (不動点):" : ":") + names);
+
+            for (uint32_t m = fact_begin; m < fact_end; ++m) {
+                const FactId id = kb.component_facts[m];
+                const std::string s = state(id);
+                const std::string pf = "pf" + std::to_string(id);
+                const bool derived = id < kb.rules_by_conclusion.size() && !kb.rules_by_conclusion[id].empty();
+
+                // 1. 否定の結論: 偽の rail (循環がなければ初期状態は TRUE / FALSE に決まっているため、状態は変わらず、
+                //    結論とするルールの結果を FALSE に留めるためだけに使う)
+                //    循環を含む成分では、成分内の事実を読むルールはループの後に評価する (4.)
+                std::string fired;
+                std::string negation_block;
+                block_epoch++;
+                for (uint32_t i = kb.negation_begin[id]; i < kb.negation_end[id] && (loop || derived); ++i) {
+                    const Rule& rule = kb.rules[kb.negated_rules[i]];
+                    if (loop && kb.readsComponent(rule, component)) continue;
+                    fired += (fired.empty() ? "" : " | ") +
+                             premise(rule.premise, component, hoist, negation_block, depth, false) + ".is_true";
+                }
+                const bool negated = !fired.empty();
+                if (negated) {
+                    if (!loop) {
+                        out += hoist;
+                        hoist.clear();
+                        line(out, 1, "const uint64_t " + pf + " = " + fired + ";");
+                    } else {
+                        if (derived) line(hoist, 1, "uint64_t " + pf + " = 0;");
+                        line(body, depth - 1, "{ // !" + std::string(kb.facts.name(id)));
+                        body += negation_block;
+                        line(body, depth, "const uint64_t fired = " + fired + ";");
+                        if (derived) line(body, depth, pf + " |= fired;");
+                        line(body, depth, "const uint64_t lowered = fired & ~" + s + ".is_true & ~" + s + ".is_false;");
+                        line(body, depth, s + ".is_false |= lowered;");
+                        line(body, depth, "changed |= lowered;");
+                        line(body, depth - 1, "}");
+                    }
+                }
+
+                // 2. 結論とするルール: FALSE < UNDETERMINED < TRUE の最大 (dual-rail の OR)。証明済みの偽は FALSE に留める
+                if (!derived) continue;
+                std::string block;
+                block_epoch++;
+                std::vector<std::string> premises;
+                for (size_t rule_index : kb.rules_by_conclusion[id]) {
+                    premises.push_back(premise(kb.rules[rule_index].premise, component, hoist, block, depth, loop));
+                }
+                if (!loop) {
+                    out += hoist;
+                    hoist.clear();
+                    line(out, 1, "// " + std::string(kb.facts.name(id)));
+                    for (const std::string& p : premises) line(out, 1, s + " = detail::lor(" + s + ", " + p + ");");
+                    if (negated) line(out, 1, s + ".is_false |= " + pf + " & ~" + s + ".is_true;");
+                    continue;
+                }
+                line(body, depth - 1, "{ // " + std::string(kb.facts.name(id)));
+                body += block;
+                line(body, depth, "const Lanes before = " + s + ";");
+                for (const std::string& p : premises) line(body, depth, s + " = detail::lor(" + s + ", " + p + ");");
+                if (negated) line(body, depth, s + ".is_false |= " + pf + " & ~" + s + ".is_true;");
+                line(body, depth, "changed |= (" + s + ".is_true ^ before.is_true) | (" + s + ".is_false ^ before.is_false);");
+                line(body, depth - 1, "}");
+            }
+            if (!loop) return;
+
+            // 3. OR/XOR 結論の消去法: この成分の TRUE でない結論 (重複も数える) がちょうど 1 つで前提部が TRUE のレーンで、
+            //    それを TRUE にする
+            for (uint32_t e = slot_begin; e < slot_end; ++e) {
+                const Rule& rule = kb.rules[kb.component_eliminations[e]];
+                if (rule.removed) continue; // 実行時に取り除いたルールの位置
+                std::string block;
+                block_epoch++;
+                const std::string p = premise(rule.premise, component, hoist, block, depth, true);
+                line(body, depth - 1, "{ // " + kb.ruleToString(rule));
+                body += block;
+                line(body, depth, "uint64_t one = 0;");
+                line(body, depth, "uint64_t more = 0;");
+                for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                    if (kb.fact_component[kb.fact_pool[i]] != component) continue;
+                    const std::string s = state(kb.fact_pool[i]);
+                    line(body, depth, "more |= one & ~" + s + ".is_true;");
+                    line(body, depth, "one = (one | ~" + s + ".is_true) & ~more;");
+                }
+                line(body, depth, "const uint64_t fired = " + p + ".is_true & one;");
+                for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                    if (kb.fact_component[kb.fact_pool[i]] != component) continue;
+                    bool repeated = false;
+                    for (uint32_t j = rule.conclusion_facts_begin; j < i; ++j) repeated |= kb.fact_pool[j] == kb.fact_pool[i];
+                    if (repeated) continue;
+                    const std::string s = state(kb.fact_pool[i]);
+                    line(body, depth, "changed |= fired & ~" + s + ".is_true;");
+                    line(body, depth, s + ".is_true |= fired;");
+                    line(body, depth, s + ".is_false &= ~fired;");
+                }
+                line(body, depth - 1, "}");
+            }
+
+            // 4. 成分内の事実を読む否定の結論: 確定した状態ですべての前提部を評価してから偽と証明する
+            //    (部分式は 1 つのブロックで共有し、FALSE に下げた事実から成分内の他の事実へは伝えない)
+            std::string deferred;
+            std::string lowering;
+            block_epoch++;
+            for (uint32_t m = fact_begin; m < fact_end; ++m) {
+                const FactId id = kb.component_facts[m];
+                std::string fired;
+                for (uint32_t i = kb.negation_begin[id]; i < kb.negation_end[id]; ++i) {
+                    const Rule& rule = kb.rules[kb.negated_rules[i]];
+                    if (!kb.readsComponent(rule, component)) continue;
+                    fired += (fired.empty() ? "" : " | ") + premise(rule.premise, component, hoist, deferred, 2, false) + ".is_true";
+                }
+                if (fired.empty()) continue;
+                const std::string df = "df" + std::to_string(id);
+                line(deferred, 2, "const uint64_t " + df + " = " + fired + "; // !" + std::string(kb.facts.name(id)));
+                line(lowering, 2, state(id) + ".is_false |= " + df + " & ~" + state(id) + ".is_true;");
+            }
+
+            out += hoist;
+            line(out, 1, "{");
+            line(out, 2, "uint64_t changed;");
+            line(out, 2, "do {");
+            line(out, 3, "changed = 0;");
+            out += body;
+            line(out, 2, "} while (changed != 0);");
+            out += deferred;
+            out += lowering;
+            line(out, 1, "}");
+        }
+};
+
+// 出力ファイル名から名前空間を決める (例: "out/rules.h" -> kb_rules)
+static std::string namespaceName(const std::string& filename) {
+    size_t start = filename.find_last_of('/');
+    start = (start == std::string::npos) ? 0 : start + 1;
+    size_t end = filename.find('.', start);
+    if (end == std::string::npos) end = filename.size();
+    std::string name = "kb_";
+    for (size_t i = start; i < end; ++i) {
+        name += isIdentifierChar(filename[i]) ? filename[i] : '_';
+    }
+    return name;
+}
+
+// 検証用の main: --batch と同じ形式のシナリオを標準入力から読み、同じ JSON Lines を標準出力に書く
+static const char* const VERIFY_MAIN = R"(
+#ifdef EXPERT_SYSTEM_VERIFY_MAIN
+// c++ -std=c++17 -O2 -DEXPERT_SYSTEM_VERIFY_MAIN -x c++ <このファイル> -o verify
+// ./verify < scenarios.txt と expert_system --batch scenarios.txt <ルールファイル> の出力は一致する
+// (クエリはファイルのクエリのみ。"?" 以降はファイルのクエリと同じ並びだけを受け付け、異なる行はエラーにする)
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+int main() {
+    using namespace NAMESPACE;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    for (uint32_t id = 0; id < FACT_COUNT; ++id) ids.emplace(FACT_NAMES[id], id);
+    auto identifierStart = [](char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_'; };
+    auto identifierChar = [&](char c) { return identifierStart(c) || (c >= '0' && c <= '9'); };
+    // 事実の並びの識別子を順に visit に渡す (expert_system と同じく、未登録で大文字のみの識別子は 1 文字ずつの事実とみなす)
+    auto splitFacts = [&](std::string_view list, auto visit) {
+        size_t pos = 0;
+        while (pos < list.size()) {
+            if (!identifierChar(list[pos])) {
+                pos++;
+                continue;
+            }
+            const size_t begin = pos;
+            while (pos < list.size() && identifierChar(list[pos])) pos++;
+            const std::string_view token = list.substr(begin, pos - begin);
+            bool legacy = ids.count(token) == 0 && token.size() > 1;
+            for (char c : token) legacy &= c >= 'A' && c <= 'Z';
+            if (legacy) {
+                for (size_t i = 0; i < token.size(); ++i) visit(token.substr(i, 1));
+            } else if (identifierStart(token[0])) {
+                visit(token);
+            }
+        }
+    };
+
+    std::vector<uint64_t> known(FACT_COUNT, 0);
+    std::vector<std::vector<uint32_t>> scenarios;
+    Lanes results[QUERY_COUNT];
+    std::string output;
+    size_t count = 0;
+    auto flush = [&]() {
+        for (size_t lane = 0; lane < scenarios.size(); ++lane) {
+            for (uint32_t id : scenarios[lane]) known[id] |= uint64_t(1) << lane;
+        }
+        evaluateLanes([&](uint32_t id) { return known[id]; }, results);
+        for (size_t lane = 0; lane < scenarios.size(); ++lane) {
+            output += "{\"scenario\":" + std::to_string(count - scenarios.size() + lane + 1) + ",\"results\":{";
+            for (uint32_t q = 0; q < QUERY_COUNT; ++q) {
+                const State state = stateOf(results[q], static_cast<unsigned>(lane));
+                output += (q > 0 ? ",\"" : "\"") + std::string(FACT_NAMES[QUERY_FACTS[q]]) + "\":" +
+                          (state == STATE_TRUE ? "\"true\"" : state == STATE_FALSE ? "\"false\"" : "\"undetermined\"");
+            }
+            output += "}}\n";
+            for (uint32_t id : scenarios[lane]) known[id] = 0;
+        }
+        scenarios.clear();
+        std::cout << output;
+        output.clear();
+    };
+
+    std::string text;
+    while (std::getline(std::cin, text)) {
+        std::string_view line = text;
+        line = line.substr(0, line.find('#'));
+        const size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos) continue;
+        line.remove_prefix(start);
+        const size_t query_pos = line.find('?');
+        if (query_pos != std::string_view::npos) {
+            // 同じクエリの並びなら省略した場合と同じ結果になる
+            uint32_t q = 0;
+            bool same = true;
+            splitFacts(line.substr(query_pos + 1), [&](std::string_view name) {
+                same = same && q < QUERY_COUNT && name == FACT_NAMES[QUERY_FACTS[q]];
+                q++;
+            });
+            if (!same || q != QUERY_COUNT) {
+                std::cerr << "Error: Only the queries of the rule file are compiled: " << text << std::endl;
+                return 1;
+            }
+            line = line.substr(0, query_pos);
+        }
+        if (!line.empty() && line.front() == '=') line.remove_prefix(1);
+
+        std::vector<uint32_t> initial;
+        splitFacts(line, [&](std::string_view name) {
+            auto it = ids.find(name);
+            if (it != ids.end()) initial.push_back(it->second);
+        });
+        scenarios.push_back(std::move(initial));
+        count++;
+        if (scenarios.size() == 64) flush();
+    }
+    flush();
+    return 0;
+}
+#endif
+)";
+
+void KnowledgeBase::emitCpp(const std::string& filename) const {
+    if (queries.empty()) {
+        throw std::runtime_error("Error: No queries to generate code for");
+    }
+    const std::string name_space = namespaceName(filename);
+    std::string guard;
+    for (char c : name_space) guard += static_cast<char>(c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
+    guard += "_H";
+
+    std::string out;
+    out += "// expert_system --emit-cpp で生成 (編集しないこと)\n";
+    out += "// 後向き連鎖と同じ結果を、Expression の仮想呼び出しや表の検索なしに直線的なコードで求める\n";
+    out += "// 事実の状態は dual-rail のビット列 (Lanes) で、1 語の各ビットが 1 シナリオ (64 シナリオを同時に評価する)\n";
+    out += "#ifndef " + guard + "\n#define " + guard + "\n\n#include <cstdint>\n\nnamespace " + name_space + " {\n\n";
+
+    // 事実・クエリ・ルールの表
+    out += "constexpr uint32_t FACT_COUNT = " + std::to_string(facts.size()) + ";\n";
+    out += "constexpr const char* FACT_NAMES[FACT_COUNT] = {\n";
+    for (FactId id = 0; id < facts.size(); ++id) out += "    \"" + std::string(facts.name(id)) + "\",\n";
+    out += "};\n\n";
+    out += "constexpr uint32_t QUERY_COUNT = " + std::to_string(queries.size()) + ";\n";
+    out += "constexpr uint32_t QUERY_FACTS[QUERY_COUNT] = {";
+    for (size_t q = 0; q < queries.size(); ++q) out += (q > 0 ? ", " : "") + std::to_string(queries[q]);
+    out += "};\n\n";
+
+    out += "// ルール (ルール番号順)。前提部・結論部の事実は RULE_FACTS[begin, end)\n";
+    out += "struct RuleEntry {\n";
+    out += "    const char* text;\n";
+    out += "    uint32_t premise_facts_begin, premise_facts_end;\n";
+    out += "    uint32_t conclusion_facts_begin, conclusion_facts_end;\n";
+    out += "    bool disjunctive_conclusion;\n";
+    out += "    bool negated_conclusion;\n";
+    out += "};\n";
+    out += "constexpr uint32_t RULE_COUNT = " + std::to_string(rules.size()) + ";\n";
+    out += "constexpr uint32_t RULE_FACTS[" + std::to_string(std::max<size_t>(fact_pool.size(), 1)) + "] = {";
+    for (size_t i = 0; i < fact_pool.size(); ++i) out += (i % 16 == 0 ? "\n    " : " ") + std::to_string(fact_pool[i]) + ",";
+    out += "\n};\n";
+    out += "constexpr RuleEntry RULES[RULE_COUNT > 0 ? RULE_COUNT : 1] = {\n";
+    for (const Rule& rule : rules) {
+        out += "    {\"" + ruleToString(rule) + "\", " + std::to_string(rule.premise_facts_begin) + ", " +
+               std::to_string(rule.premise_facts_end) + ", " + std::to_string(rule.conclusion_facts_begin) + ", " +
+               std::to_string(rule.conclusion_facts_end) + ", " + (rule.disjunctive_conclusion ? "true" : "false") + ", " +
+               (rule.negated_conclusion ? "true" : "false") + "},\n";
+    }
+    out += "};\n\n";
+
+    out += "// 1 語 64 シナリオ分の事実の状態 (どちらのビットも立っていないレーンは UNDETERMINED)\n";
+    out += "struct Lanes {\n    uint64_t is_true;\n    uint64_t is_false;\n};\n\n";
+    out += "enum State : uint8_t { STATE_TRUE, STATE_FALSE, STATE_UNDETERMINED };\n\n";
+    out += "inline State stateOf(Lanes lanes, unsigned lane) {\n";
+    out += "    if ((lanes.is_true >> lane) & 1) return STATE_TRUE;\n";
+    out += "    return ((lanes.is_false >> lane) & 1) ? STATE_FALSE : STATE_UNDETERMINED;\n}\n\n";
+    out += "namespace detail {\n";
+    out += "inline Lanes initial(uint64_t known) { return {known, ~known}; }\n";
+    out += "inline Lanes lnot(Lanes a) { return {a.is_false, a.is_true}; }\n";
+    out += "inline Lanes land(Lanes l, Lanes r) { return {l.is_true & r.is_true, l.is_false | r.is_false}; }\n";
+    out += "inline Lanes lor(Lanes l, Lanes r) { return {l.is_true | r.is_true, l.is_false & r.is_false}; }\n";
+    out += "inline Lanes lxor(Lanes l, Lanes r) {\n";
+    out += "    const uint64_t determined = (l.is_true | l.is_false) & (r.is_true | r.is_false);\n";
+    out += "    const uint64_t differ = l.is_true ^ r.is_true;\n";
+    out += "    return {determined & differ, determined & ~differ};\n}\n";
+    out += "} // namespace detail\n\n";
+
+    // クエリの事実ごとの評価関数と、全クエリをまとめて評価する関数
+    CppEmitter emitter(*this);
+    QuerySlice slice;
+    out += "// known(id) は事実 id が初期事実であるシナリオのビット列 (uint64_t) を返す関数\n";
+    std::vector<FactId> emitted;
+    for (FactId query : queries) {
+        if (std::find(emitted.begin(), emitted.end(), query) != emitted.end()) continue;
+        emitted.push_back(query);
+        buildSlice({query}, slice);
+        out += "template <typename Known>\ninline Lanes query_" + std::string(facts.name(query)) + "(Known known) {\n";
+        emitter.emitSlice(slice, out);
+        out += "    return " + std::string("s") + std::to_string(query) + ";\n}\n\n";
+    }
+
+    buildSlice(queries, slice);
+    out += "// 全クエリを 1 度に評価し、results[q] に QUERY_FACTS[q] の状態を書き込む (影響範囲の重なる事実は 1 度だけ評価する)\n";
+    out += "template <typename Known>\ninline void evaluateLanes(Known known, Lanes* results) {\n";
+    emitter.emitSlice(slice, out);
+    for (size_t q = 0; q < queries.size(); ++q) {
+        out += "    results[" + std::to_string(q) + "] = s" + std::to_string(queries[q]) + ";\n";
+    }
+    out += "}\n\n";
+
+    out += "// 1 シナリオ: input は事実 ID で引く初期事実のビット集合 ((FACT_COUNT + 63) / 64 語)\n";
+    out += "inline void evaluate(const uint64_t* input, State* results) {\n";
+    out += "    Lanes lanes[QUERY_COUNT];\n";
+    out += "    evaluateLanes([input](uint32_t id) { return uint64_t(0) - ((input[id >> 6] >> (id & 63)) & 1); }, lanes);\n";
+    out += "    for (uint32_t q = 0; q < QUERY_COUNT; ++q) results[q] = stateOf(lanes[q], 0);\n}\n\n";
+    out += "} // namespace " + name_space + "\n";
+
+    std::string verify_main = VERIFY_MAIN;
+    verify_main.replace(verify_main.find("NAMESPACE"), 9, name_space);
+    out += verify_main;
+    out += "\n#endif\n";
+
+    // 一時ファイルに書いてから置き換える
+    const std::string temp_name = filename + ".tmp";
+    {
+        std::ofstream file(temp_name, std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Error: Could not write file " + filename);
+        }
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        if (!file) {
+            throw std::runtime_error("Error: Could not write file " + filename);
+        }
+    }
+    if (std::rename(temp_name.c_str(), filename.c_str()) != 0) {
+        std::remove(temp_name.c_str());
+        throw std::runtime_error("Error: Could not write file " + filename);
+    }
+}
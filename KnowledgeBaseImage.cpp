@@ -0,0 +1,382 @@
+#include "KnowledgeBase.h"
+#include "KnowledgeBaseImage.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace kb_image;
+
+// --- 書き出し ---
+
+static_assert(std::is_trivially_copyable<Rule>::value && std::is_standard_layout<Rule>::value,
+              "Rule is stored in the image as is");
+static_assert(std::is_trivially_copyable<ExprNode>::value && std::is_standard_layout<ExprNode>::value,
+              "ExprNode is stored in the image as is");
+
+// 番号ごとのリストを CSR 形式 (開始位置 + 番兵、連結した要素) に変換
+static void flattenIndex(const FlatIndex& index, size_t id_count, std::vector<uint32_t>& offsets, std::vector<uint32_t>& values) {
+    offsets.assign(1, 0);
+    for (size_t id = 0; id < id_count; ++id) {
+        if (id < index.size()) values.insert(values.end(), index[id].begin(), index[id].end());
+        offsets.push_back(static_cast<uint32_t>(values.size()));
+    }
+}
+
+// 構造体の配列をメモリ上の配置のまま並べる (詰め物のバイトは 0 にして、同じ知識ベースからは同じイメージになるようにする)
+template <typename T, typename CopyFields>
+static std::string packStructs(const FlatArray<T>& items, CopyFields copy_fields) {
+    std::string bytes(items.size() * sizeof(T), '\0');
+    for (size_t i = 0; i < items.size(); ++i) copy_fields(items[i], &bytes[i * sizeof(T)]);
+    return bytes;
+}
+
+template <typename Field>
+static void copyField(char* out, size_t offset, const Field& field) {
+    std::memcpy(out + offset, &field, sizeof(field));
+}
+
+void KnowledgeBase::saveImage(const std::string& filename) const {
+    const SymbolTable& symbols = facts.symbolTable();
+    std::string_view bytes[SECTION_COUNT]; // セクションの内容 (配列をそのまま指すか、下の作業領域を指す)
+    auto put = [&](Section s, const auto& array) {
+        bytes[s] = std::string_view(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(array[0]));
+    };
+
+    bytes[SYMBOL_TEXT] = symbols.rawText();
+    put(SYMBOL_OFFSETS, symbols.rawOffsets());
+    put(SYMBOL_SLOTS, symbols.rawSlots());
+    put(SYMBOL_HASHES, symbols.rawSlotHashes());
+
+    const std::string expression_bytes = packStructs(expressions.rawNodes(), [](const ExprNode& node, char* out) {
+        copyField(out, offsetof(ExprNode, op), node.op);
+        copyField(out, offsetof(ExprNode, left), node.left);
+        copyField(out, offsetof(ExprNode, right), node.right);
+    });
+    bytes[EXPRESSIONS] = expression_bytes;
+    put(EXPRESSION_MONOTONE, expressions.rawMonotone());
+    put(EXPRESSION_TABLE, expressions.rawTable());
+    put(FACT_POOL, fact_pool);
+    const std::string rule_bytes = packStructs(rules, [](const Rule& rule, char* out) {
+        copyField(out, offsetof(Rule, premise), rule.premise);
+        copyField(out, offsetof(Rule, conclusion), rule.conclusion);
+        copyField(out, offsetof(Rule, premise_facts_begin), rule.premise_facts_begin);
+        copyField(out, offsetof(Rule, premise_facts_end), rule.premise_facts_end);
+        copyField(out, offsetof(Rule, conclusion_facts_begin), rule.conclusion_facts_begin);
+        copyField(out, offsetof(Rule, conclusion_facts_end), rule.conclusion_facts_end);
+        copyField(out, offsetof(Rule, disjunctive_conclusion), rule.disjunctive_conclusion);
+        copyField(out, offsetof(Rule, negated_conclusion), rule.negated_conclusion);
+        copyField(out, offsetof(Rule, removed), rule.removed);
+    });
+    bytes[RULES] = rule_bytes;
+
+    std::vector<uint32_t> csr[6];
+    flattenIndex(rules_by_conclusion, facts.size(), csr[0], csr[1]);
+    flattenIndex(rules_by_premise, facts.size(), csr[2], csr[3]);
+    flattenIndex(rules_by_part, partCount(), csr[4], csr[5]);
+    put(CONCLUSION_INDEX_OFFSETS, csr[0]);
+    put(CONCLUSION_INDEX, csr[1]);
+    put(PREMISE_INDEX_OFFSETS, csr[2]);
+    put(PREMISE_INDEX, csr[3]);
+    put(PART_INDEX_OFFSETS, csr[4]);
+    put(PART_INDEX, csr[5]);
+    put(DISJUNCTIVE_RULES, disjunctive_rules);
+
+    put(NEGATION_BEGIN, negation_begin);
+    put(NEGATION_END, negation_end);
+    put(NEGATED_RULES, negated_rules);
+    put(FACT_COMPONENT, fact_component);
+    put(COMPONENT_BEGIN, component_begin);
+    put(COMPONENT_FACTS, component_facts);
+    put(DEPENDENCY_BEGIN, dependency_begin);
+    put(DEPENDENCY_END, dependency_end);
+    put(COMPONENT_DEPENDENCIES, component_dependencies);
+    put(ELIMINATION_BEGIN, elimination_begin);
+    put(ELIMINATION_END, elimination_end);
+    put(COMPONENT_ELIMINATIONS, component_eliminations);
+    put(CYCLIC_COMPONENTS, cyclic_components.words);
+    put(DEPENDENT_BEGIN, dependent_begin);
+    put(DEPENDENT_END, dependent_end);
+    put(FACT_DEPENDENTS, fact_dependents);
+    put(PREMISE_WATCH_BEGIN, premise_watch_begin);
+    put(PREMISE_WATCH_END, premise_watch_end);
+    put(PREMISE_WATCHES, premise_watches);
+    put(DISJUNCT_BEGIN, disjunct_begin);
+    put(DISJUNCT_END, disjunct_end);
+    put(DISJUNCT_WATCHES, disjunct_watches);
+    put(COMPONENT_PART, component_part);
+    put(PART_PARENT, part_parent);
+    const std::vector<uint32_t> stale = {static_cast<uint32_t>(std::min<size_t>(stale_entries, UINT32_MAX))};
+    put(STALE_ENTRIES, stale);
+
+    put(QUERIES, queries);
+    std::vector<uint32_t> known_facts;
+    for (FactId id = 0; id < facts.size(); ++id) {
+        if (facts.isKnown(id)) known_facts.push_back(id);
+    }
+    put(KNOWN_FACTS, known_facts);
+
+    // セクションの配置を決める
+    ImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+
+    uint64_t offset = sizeof(ImageHeader);
+    for (uint32_t s = 0; s < SECTION_COUNT; ++s) {
+        offset = (offset + 7) & ~uint64_t(7);
+        header.sections[s].offset = offset;
+        header.sections[s].size = bytes[s].size();
+        offset += header.sections[s].size;
+    }
+
+    // 一時ファイルに書いてから置き換える (書き込み途中のイメージを他のプロセスが読まないように)
+    const std::string temp_name = filename + ".tmp";
+    {
+        std::ofstream out(temp_name, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Error: Could not write file " + filename);
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t written = sizeof(header);
+        for (uint32_t s = 0; s < SECTION_COUNT; ++s) {
+            static const char padding[8] = {};
+            out.write(padding, static_cast<std::streamsize>(header.sections[s].offset - written));
+            out.write(bytes[s].data(), static_cast<std::streamsize>(bytes[s].size()));
+            written = header.sections[s].offset + header.sections[s].size;
+        }
+        if (!out) {
+            throw std::runtime_error("Error: Could not write file " + filename);
+        }
+    }
+    if (std::rename(temp_name.c_str(), filename.c_str()) != 0) {
+        std::remove(temp_name.c_str());
+        throw std::runtime_error("Error: Could not write file " + filename);
+    }
+}
+
+// --- 読み込み ---
+
+bool KnowledgeBase::isImage(std::string_view buffer) {
+    return buffer.size() >= sizeof(MAGIC) && std::memcmp(buffer.data(), MAGIC, sizeof(MAGIC)) == 0;
+}
+
+[[noreturn]] static void corruptImage(const std::string& detail) {
+    throw std::runtime_error("Error: Corrupt knowledge base image (" + detail + ")");
+}
+
+// 読み込んだイメージの配列の範囲の検査 (壊れたイメージで範囲外を読まないよう、添字として使う値はすべて確かめる)
+static void checkBelow(const uint32_t* values, size_t count, size_t limit, const char* what) {
+    for (size_t i = 0; i < count; ++i) {
+        if (values[i] >= limit) corruptImage(what);
+    }
+}
+
+// CSR 形式の開始位置 (count 個の番号 + 番兵) が values_size 個の要素の中で単調に並んでいるか
+static void checkOffsets(const uint32_t* offsets, size_t offset_count, size_t count, size_t values_size, const char* what) {
+    if (offset_count != count + 1) corruptImage(what);
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) corruptImage(what);
+    }
+    if (offsets[count] > values_size) corruptImage(what);
+}
+
+void KnowledgeBase::loadImage(std::shared_ptr<const MappedFile> file) {
+    // 配列はマップした領域を指すため、途中で例外を投げても領域が先に解放されないよう最初に保持する
+    RuleBase::image = std::move(file);
+    const std::string_view image = RuleBase::image->view();
+    ImageHeader header;
+    if (image.size() < sizeof(header)) corruptImage("truncated header");
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (header.version != VERSION) {
+        throw std::runtime_error("Error: Unsupported knowledge base image version " + std::to_string(header.version) +
+                                 " (expected " + std::to_string(VERSION) + ")");
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Error: Knowledge base image was written with a different byte order");
+    }
+    if (reinterpret_cast<uintptr_t>(image.data()) % 8 != 0) corruptImage("unaligned mapping");
+
+    // 各セクションは 8 バイト境界に配置済みなので、マップした領域をそのまま配列として指す
+    for (uint32_t s = 0; s < SECTION_COUNT; ++s) {
+        const SectionEntry& section = header.sections[s];
+        if (section.offset % 8 != 0 || section.offset > image.size() || section.size > image.size() - section.offset) {
+            corruptImage("section " + std::to_string(s));
+        }
+    }
+    size_t count[SECTION_COUNT] = {};
+    auto section = [&](Section s, auto* element) {
+        using T = std::remove_pointer_t<decltype(element)>;
+        if (header.sections[s].size % sizeof(T) != 0) corruptImage("section " + std::to_string(s));
+        count[s] = header.sections[s].size / sizeof(T);
+        return reinterpret_cast<const T*>(image.data() + header.sections[s].offset);
+    };
+    auto words = [&](Section s) { return section(s, static_cast<uint32_t*>(nullptr)); };
+
+    // 識別子の表 (ハッシュ表ごと指すので再登録しない)
+    const char* text = section(SYMBOL_TEXT, static_cast<char*>(nullptr));
+    const uint32_t* symbol_offsets = words(SYMBOL_OFFSETS);
+    const uint32_t* symbol_slots = words(SYMBOL_SLOTS);
+    const uint32_t* symbol_hashes = words(SYMBOL_HASHES);
+    if (count[SYMBOL_OFFSETS] == 0) corruptImage("symbols");
+    const size_t fact_count = count[SYMBOL_OFFSETS] - 1;
+    checkOffsets(symbol_offsets, count[SYMBOL_OFFSETS], fact_count, count[SYMBOL_TEXT], "symbols");
+    if (count[SYMBOL_SLOTS] != count[SYMBOL_HASHES] || count[SYMBOL_SLOTS] < fact_count * 2 ||
+        (count[SYMBOL_SLOTS] & (count[SYMBOL_SLOTS] - 1)) != 0) {
+        corruptImage("symbols");
+    }
+    for (size_t i = 0; i < count[SYMBOL_SLOTS]; ++i) {
+        if (symbol_slots[i] != SymbolTable::NOT_FOUND && symbol_slots[i] >= fact_count) corruptImage("symbols");
+    }
+    // 成分などの事実ごとの配列は成分を求めたときの事実の数だけある (その後に初期事実やクエリで登録した事実は含まない)
+    words(FACT_COMPONENT);
+    const size_t indexed_count = count[FACT_COMPONENT];
+    if (indexed_count > fact_count) corruptImage("components");
+
+    SymbolTable symbols;
+    symbols.mapRaw(std::string_view(text, count[SYMBOL_TEXT]), symbol_offsets, fact_count, symbol_slots, symbol_hashes,
+                   count[SYMBOL_SLOTS]);
+    facts.assignSymbols(std::move(symbols));
+
+    // 式の DAG (子が親より前にあることを確かめ、評価が節点の順に閉じるようにする) と事実リスト
+    const ExprNode* nodes = section(EXPRESSIONS, static_cast<ExprNode*>(nullptr));
+    const uint8_t* monotone = section(EXPRESSION_MONOTONE, static_cast<uint8_t*>(nullptr));
+    const ExprId* expression_table = words(EXPRESSION_TABLE);
+    const size_t node_count = count[EXPRESSIONS];
+    for (size_t i = 0; i < node_count; ++i) {
+        const char* raw = reinterpret_cast<const char*>(nodes + i);
+        uint8_t op;
+        std::memcpy(&op, raw + offsetof(ExprNode, op), sizeof(op));
+        if (op > static_cast<uint8_t>(ExprNode::OpCode::XOR)) corruptImage("expressions");
+        const ExprNode& node = nodes[i];
+        if (node.op <= ExprNode::OpCode::LOAD_NOT ? (node.left >= fact_count || node.right != 0)
+                                                  : (node.left >= i || node.right >= i)) {
+            corruptImage("expressions");
+        }
+    }
+    if (count[EXPRESSION_MONOTONE] != node_count || count[EXPRESSION_TABLE] < node_count * 2 ||
+        (count[EXPRESSION_TABLE] & (count[EXPRESSION_TABLE] - 1)) != 0) {
+        corruptImage("expressions");
+    }
+    for (size_t i = 0; i < count[EXPRESSION_TABLE]; ++i) {
+        if (expression_table[i] != NO_EXPR && expression_table[i] >= node_count) corruptImage("expressions");
+    }
+    expressions.mapRaw(nodes, monotone, node_count, expression_table, count[EXPRESSION_TABLE]);
+    const FactId* pool = words(FACT_POOL);
+    checkBelow(pool, count[FACT_POOL], indexed_count, "fact pool");
+    fact_pool.map(pool, count[FACT_POOL]);
+
+    // ルール (bool のメンバーは 0 か 1 であることを確かめてから Rule として読む)
+    const Rule* rule_data = section(RULES, static_cast<Rule*>(nullptr));
+    for (size_t r = 0; r < count[RULES]; ++r) {
+        const char* raw = reinterpret_cast<const char*>(rule_data + r);
+        for (size_t offset : {offsetof(Rule, disjunctive_conclusion), offsetof(Rule, negated_conclusion), offsetof(Rule, removed)}) {
+            if (static_cast<uint8_t>(raw[offset]) > 1) corruptImage("rules");
+        }
+        const Rule& rule = rule_data[r];
+        if (rule.premise >= node_count || rule.conclusion >= node_count ||
+            rule.premise_facts_begin > rule.premise_facts_end || rule.premise_facts_end > count[FACT_POOL] ||
+            rule.conclusion_facts_begin > rule.conclusion_facts_end || rule.conclusion_facts_end > count[FACT_POOL] ||
+            (rule.negated_conclusion && rule.conclusion_facts_begin == rule.conclusion_facts_end)) {
+            corruptImage("rules");
+        }
+    }
+    rules.map(rule_data, count[RULES]);
+    const size_t rule_count = count[RULES];
+
+    // ルールの索引
+    auto mapIndex = [&](Section offsets_section, Section values_section, size_t id_count, size_t limit, FlatIndex& index,
+                        const char* what) {
+        const uint32_t* offsets = words(offsets_section);
+        const uint32_t* values = words(values_section);
+        checkOffsets(offsets, count[offsets_section], id_count, count[values_section], what);
+        checkBelow(values, count[values_section], limit, what);
+        index.map(offsets, id_count, values);
+    };
+    mapIndex(CONCLUSION_INDEX_OFFSETS, CONCLUSION_INDEX, fact_count, rule_count, rules_by_conclusion, "index");
+    mapIndex(PREMISE_INDEX_OFFSETS, PREMISE_INDEX, fact_count, rule_count, rules_by_premise, "index");
+    const uint32_t* disjunctive = words(DISJUNCTIVE_RULES);
+    checkBelow(disjunctive, count[DISJUNCTIVE_RULES], rule_count, "index");
+    disjunctive_rules.map(disjunctive, count[DISJUNCTIVE_RULES]);
+
+    // 成分と差分評価の索引 (範囲 [begin, end) の配列は番号ごとに範囲を確かめる)
+    auto mapArray = [&](Section s, size_t expected, size_t limit, FlatArray<uint32_t>& array, const char* what) {
+        const uint32_t* values = words(s);
+        if (expected != SIZE_MAX && count[s] != expected) corruptImage(what);
+        checkBelow(values, count[s], limit, what);
+        array.map(values, count[s]);
+    };
+    auto mapRanges = [&](Section begin_section, Section end_section, Section values_section, size_t id_count, size_t limit,
+                         FlatArray<uint32_t>& begin, FlatArray<uint32_t>& end, FlatArray<uint32_t>& values, const char* what) {
+        mapArray(values_section, SIZE_MAX, limit, values, what);
+        mapArray(begin_section, id_count, values.size() + 1, begin, what);
+        mapArray(end_section, id_count, values.size() + 1, end, what);
+        for (size_t id = 0; id < id_count; ++id) {
+            if (begin[id] > end[id]) corruptImage(what);
+        }
+    };
+    mapRanges(NEGATION_BEGIN, NEGATION_END, NEGATED_RULES, indexed_count, rule_count, negation_begin, negation_end,
+              negated_rules, "negation index");
+
+    const uint32_t* component_offsets = words(COMPONENT_BEGIN);
+    if (count[COMPONENT_BEGIN] == 0 && indexed_count != 0) corruptImage("components");
+    const size_t component_count = count[COMPONENT_BEGIN] == 0 ? 0 : count[COMPONENT_BEGIN] - 1;
+    mapArray(FACT_COMPONENT, indexed_count, component_count, fact_component, "components");
+    mapArray(COMPONENT_FACTS, SIZE_MAX, indexed_count, component_facts, "components");
+    if (component_count > 0) {
+        checkOffsets(component_offsets, count[COMPONENT_BEGIN], component_count, component_facts.size(), "components");
+    }
+    component_begin.map(component_offsets, count[COMPONENT_BEGIN]);
+    mapRanges(DEPENDENCY_BEGIN, DEPENDENCY_END, COMPONENT_DEPENDENCIES, component_count, component_count, dependency_begin,
+              dependency_end, component_dependencies, "components");
+    mapRanges(ELIMINATION_BEGIN, ELIMINATION_END, COMPONENT_ELIMINATIONS, component_count, rule_count, elimination_begin,
+              elimination_end, component_eliminations, "components");
+    const uint64_t* cyclic = section(CYCLIC_COMPONENTS, static_cast<uint64_t*>(nullptr));
+    if (count[CYCLIC_COMPONENTS] != (component_count + 63) / 64) corruptImage("components");
+    cyclic_components.words.assign(cyclic, cyclic + count[CYCLIC_COMPONENTS]);
+    cyclic_components.bit_count = component_count;
+
+    mapRanges(DEPENDENT_BEGIN, DEPENDENT_END, FACT_DEPENDENTS, indexed_count, component_facts.size(), dependent_begin,
+              dependent_end, fact_dependents, "dependents");
+    mapRanges(PREMISE_WATCH_BEGIN, PREMISE_WATCH_END, PREMISE_WATCHES, indexed_count, component_eliminations.size(),
+              premise_watch_begin, premise_watch_end, premise_watches, "watches");
+    mapRanges(DISJUNCT_BEGIN, DISJUNCT_END, DISJUNCT_WATCHES, indexed_count, component_eliminations.size(), disjunct_begin,
+              disjunct_end, disjunct_watches, "watches");
+
+    // 独立部分 (partOf が必ず根に着くよう、union-find の親をたどって循環がないことも確かめる)
+    words(PART_PARENT);
+    const size_t part_count = count[PART_PARENT];
+    mapArray(COMPONENT_PART, component_count, part_count, component_part, "parts");
+    mapArray(PART_PARENT, part_count, part_count, part_parent, "parts");
+    std::vector<uint8_t> part_state(part_count, 0); // 0: 未確認, 1: たどっている途中, 2: 根に着く
+    std::vector<uint32_t> path;
+    for (uint32_t part = 0; part < part_count; ++part) {
+        uint32_t p = part;
+        while (part_state[p] == 0 && part_parent[p] != p) {
+            part_state[p] = 1;
+            path.push_back(p);
+            p = part_parent[p];
+        }
+        if (part_state[p] == 1) corruptImage("parts");
+        part_state[p] = 2;
+        for (uint32_t q : path) part_state[q] = 2;
+        path.clear();
+    }
+    mapIndex(PART_INDEX_OFFSETS, PART_INDEX, part_count, rule_count, rules_by_part, "parts");
+    const uint32_t* stale = words(STALE_ENTRIES);
+    if (count[STALE_ENTRIES] != 1) corruptImage("index");
+    stale_entries = stale[0];
+
+    // クエリと初期事実
+    const uint32_t* query_ids = words(QUERIES);
+    checkBelow(query_ids, count[QUERIES], fact_count, "queries");
+    queries.assign(query_ids, query_ids + count[QUERIES]);
+    const uint32_t* known = words(KNOWN_FACTS);
+    checkBelow(known, count[KNOWN_FACTS], fact_count, "initial facts");
+    for (size_t i = 0; i < count[KNOWN_FACTS]; ++i) facts.setKnown(known[i], true);
+}
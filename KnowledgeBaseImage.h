@@ -0,0 +1,79 @@
+#ifndef KNOWLEDGEBASEIMAGE_H
+#define KNOWLEDGEBASEIMAGE_H
+
+#include <cstdint>
+
+// コンパイル済み知識ベースのバイナリイメージ (--compile で出力し、loadFromFile が自動判別して読み込む)
+//
+// [ImageHeader][セクション 0][セクション 1]...
+// 各セクションは 8 バイト境界から始まり、RuleBase・ExpressionArena・SymbolTable の配列をホストのバイト順・メモリ上の配置のまま
+// 並べたもの。読み込みは範囲を確かめてからマップした領域を直接指すだけで、配列の複製も成分の分解 (buildComponents) もしない
+// (領域を書き換えるのは実行時にルールを変更したときだけで、そのときに初めて自前の領域に写す)
+namespace kb_image {
+
+constexpr char MAGIC[8] = {'E', 'X', 'S', 'Y', 'S', 'K', 'B', '\0'};
+constexpr uint32_t VERSION = 4; // 形式を変更したら上げる (古いイメージは読み込みを拒否する)
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+enum Section : uint32_t {
+    SYMBOL_TEXT, // 識別子を連結した文字列
+    SYMBOL_OFFSETS, // ID -> SYMBOL_TEXT 上の開始位置 (末尾に番兵)
+    SYMBOL_SLOTS, // SymbolTable のハッシュ表
+    SYMBOL_HASHES,
+    EXPRESSIONS, // ExprNode の配列 (子は親より前)
+    EXPRESSION_MONOTONE, // 節点ごとの isMonotone (1 バイトずつ)
+    EXPRESSION_TABLE, // ExpressionArena のハッシュ表
+    FACT_POOL,
+    RULES, // Rule の配列 (実行時に取り除いたルールも removed のまま残す)
+    CONCLUSION_INDEX_OFFSETS, // rules_by_conclusion (CSR 形式: 事実ごとの開始位置 + 番兵)
+    CONCLUSION_INDEX,
+    PREMISE_INDEX_OFFSETS, // rules_by_premise (CSR 形式)
+    PREMISE_INDEX,
+    DISJUNCTIVE_RULES,
+    NEGATION_BEGIN, // 以下 RuleBase の同名の配列 (範囲 [begin, end) の索引は参照されなくなった要素も含めてそのまま)
+    NEGATION_END,
+    NEGATED_RULES,
+    FACT_COMPONENT,
+    COMPONENT_BEGIN,
+    COMPONENT_FACTS,
+    DEPENDENCY_BEGIN,
+    DEPENDENCY_END,
+    COMPONENT_DEPENDENCIES,
+    ELIMINATION_BEGIN,
+    ELIMINATION_END,
+    COMPONENT_ELIMINATIONS,
+    CYCLIC_COMPONENTS, // Bitset の語 (uint64_t)
+    DEPENDENT_BEGIN,
+    DEPENDENT_END,
+    FACT_DEPENDENTS,
+    PREMISE_WATCH_BEGIN,
+    PREMISE_WATCH_END,
+    PREMISE_WATCHES,
+    DISJUNCT_BEGIN,
+    DISJUNCT_END,
+    DISJUNCT_WATCHES,
+    COMPONENT_PART,
+    PART_PARENT,
+    PART_INDEX_OFFSETS, // rules_by_part (CSR 形式: 部分ごとの開始位置 + 番兵)
+    PART_INDEX,
+    STALE_ENTRIES, // 索引の配列のうち参照されなくなった要素の数 (1 語)
+    QUERIES,
+    KNOWN_FACTS, // 初期事実の ID
+    SECTION_COUNT
+};
+
+struct SectionEntry {
+    uint64_t offset; // ファイル先頭からのバイト位置
+    uint64_t size; // バイト数
+};
+
+struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    SectionEntry sections[SECTION_COUNT];
+};
+
+} // namespace kb_image
+
+#endif
@@ -0,0 +1,46 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not open file " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            mapping = p;
+            data = static_cast<const char*>(p);
+            length = static_cast<size_t>(st.st_size);
+        }
+    }
+    close(fd);
+
+    if (mapping == nullptr) {
+        // 空ファイルやパイプなど mmap できないものは通常の読み込みで代用
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Error: Could not open file " + filename);
+        }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        fallback = contents.str();
+        data = fallback.data();
+        length = fallback.size();
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (mapping != nullptr) {
+        munmap(mapping, length);
+    }
+}
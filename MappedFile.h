@@ -0,0 +1,26 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// 読み取り専用でメモリにマップしたファイル (mmap できない場合は読み込んだ内容を保持)
+class MappedFile {
+    public:
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::string_view view() const { return std::string_view(data, length); }
+
+    private:
+        const char* data = nullptr;
+        size_t length = 0;
+        void* mapping = nullptr;
+        std::string fallback;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include "QueryServer.h"
+#include "RuleParser.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void onStopSignal(int) {
+    stop_requested = 1;
+}
+
+static std::runtime_error systemError(const std::string& what) {
+    return std::runtime_error("Error: " + what + ": " + std::strerror(errno));
+}
+
+static void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+QueryServer::QueryServer(KnowledgeBase& kb, size_t threads, RuleFileWatcher* watcher)
+    : kb(kb), runner(kb, threads), watcher(watcher) {}
+
+QueryServer::~QueryServer() {
+    for (const Client& client : clients) close(client.fd);
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+}
+
+void QueryServer::listen(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Error: Invalid socket path " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // 前回のサーバーが残したソケットファイルは置き換える (接続できるなら別のサーバーが使用中)
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) throw std::runtime_error("Error: " + path + " exists and is not a socket");
+        const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool in_use = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        if (probe >= 0) close(probe);
+        if (in_use) throw std::runtime_error("Error: Another server is listening on " + path);
+        unlink(path.c_str());
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) throw systemError("Could not create socket");
+    setNonBlocking(listen_fd);
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        const std::runtime_error error = systemError("Could not bind " + path);
+        close(listen_fd);
+        listen_fd = -1;
+        throw error;
+    }
+    socket_path = path;
+    if (::listen(listen_fd, SOMAXCONN) < 0) throw systemError("Could not listen on " + path);
+}
+
+size_t QueryServer::run() {
+    // SIGINT / SIGTERM で poll を中断して終了する (SA_RESTART を付けない)。切断したクライアントへの送信は EPIPE で扱う
+    stop_requested = 0;
+    struct sigaction action{};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    handled = 0;
+    std::vector<pollfd> fds;
+    while (!stop_requested) {
+        fds.clear();
+        fds.push_back({listen_fd, POLLIN, 0});
+        for (const Client& client : clients) {
+            // 送信待ちがあれば (応答を読まないクライアントの要求を溜めないよう) 送り終えるまで受信しない
+            const bool readable = !client.closing && client.output.empty();
+            const short events = static_cast<short>((readable ? POLLIN : 0) | (client.output.empty() ? 0 : POLLOUT));
+            fds.push_back({client.fd, events, 0});
+        }
+        if (watcher) fds.push_back({watcher->fd(), POLLIN, 0});
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            throw systemError("poll failed");
+        }
+
+        // 1. 届いた要求を全クライアントから集める (acceptClients で clients が増える前に fds と対応させる)
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) receive(i);
+        }
+        if (fds[0].revents & POLLIN) acceptClients();
+
+        // 2. まとめて評価し、応答を送る (ルールファイルの変更はこの待ちで届いた要求の評価の後に反映する)
+        respond();
+        if (watcher && (fds.back().revents & POLLIN)) reloadRules();
+        for (Client& client : clients) {
+            if (!client.output.empty()) flush(client);
+        }
+
+        // 3. 送信を終えた切断待ちのクライアントを閉じる
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const Client& client) {
+            if (!client.closing || !client.output.empty()) return false;
+            close(client.fd);
+            return true;
+        }), clients.end());
+    }
+    return handled;
+}
+
+void QueryServer::acceptClients() {
+    while (true) {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return; // EAGAIN (待ちの接続がない) や一時的な資源不足は次の poll で再び試す
+        }
+        setNonBlocking(fd);
+        clients.emplace_back();
+        clients.back().fd = fd;
+    }
+}
+
+void QueryServer::receive(size_t index) {
+    Client& client = clients[index];
+    if (client.closing) return;
+
+    // 未処理のバイト列は MAX_INPUT_BYTES まで (完結した要求を取り出した後、次の poll で続きを読む)
+    char buffer[64 * 1024];
+    while (client.input.size() < MAX_INPUT_BYTES) {
+        const size_t room = std::min(sizeof(buffer), MAX_INPUT_BYTES - client.input.size());
+        const ssize_t n = read(client.fd, buffer, room);
+        if (n > 0) {
+            client.input.append(buffer, static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        // 0 (相手が送信を終えた) やエラーなら、受信済みの要求に答えてから切断する
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) client.closing = true;
+        break;
+    }
+
+    // 完結した要求 (4 バイトの長さ + 本文) を取り出す
+    size_t pos = 0;
+    while (client.input.size() - pos >= 4) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(client.input.data() + pos);
+        const uint32_t length = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) |
+                                (uint32_t(header[2]) << 8) | uint32_t(header[3]);
+        if (length > MAX_REQUEST_BYTES) {
+            pending.push_back({index, false, "{\"error\":\"request too large\"}"});
+            client.closing = true;
+            pos = client.input.size();
+            break;
+        }
+        if (client.input.size() - pos - 4 < length) break;
+
+        const std::string_view body(client.input.data() + pos + 4, length);
+        pos += 4 + length;
+        client.requests++;
+        if (!body.empty() && (body.front() == '+' || body.front() == '-')) {
+            // 先に届いた要求を変更前のルールで評価してから変更する
+            respond();
+            pending.push_back({index, false, editRules(body)});
+        } else if (runner.addScenario(body, client.requests)) {
+            pending.push_back({index, true, std::string()});
+        } else {
+            pending.push_back({index, false, "{\"error\":\"empty request\"}"});
+        }
+        if (pending.size() >= MAX_PENDING_REQUESTS) {
+            respond();
+            if (client.dropped) {
+                pos = client.input.size();
+                break;
+            }
+        }
+    }
+    client.input.erase(0, pos);
+}
+
+void QueryServer::respond() {
+    if (pending.empty()) return;
+    runner.evaluatePending(replies);
+    size_t next = 0;
+    for (const Pending& request : pending) {
+        Client& client = clients[request.client];
+        const std::string& body = request.evaluated ? replies[next++] : request.error;
+        if (client.dropped) continue;
+        if (client.output.size() + 4 + body.size() > MAX_OUTPUT_BYTES) {
+            // 応答を読まずに要求を送り続けるクライアントは、送信待ちを捨てて切断する
+            client.output.clear();
+            client.closing = true;
+            client.dropped = true;
+            continue;
+        }
+        appendFrame(client.output, body);
+    }
+    handled += pending.size();
+    pending.clear();
+}
+
+// エラーメッセージを JSON の文字列にする
+static std::string jsonString(std::string_view text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out.push_back(' ');
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+    return out;
+}
+
+std::string QueryServer::editRules(std::string_view body) {
+    std::string_view rule_line = body.substr(1);
+    trimLine(rule_line);
+    std::vector<size_t> removed;
+    std::vector<std::string_view> added;
+    RuleUpdate update;
+    try {
+        if (body.front() == '+') {
+            added.push_back(rule_line);
+        } else {
+            kb.findRules(rule_line, removed);
+        }
+        kb.updateRules(removed, added, update);
+    } catch (const std::exception& e) {
+        return "{\"error\":" + jsonString(e.what()) + "}";
+    }
+    runner.rulesChanged(update);
+    return body.front() == '+' ? "{\"added\":" + std::to_string(update.added_rules) + "}"
+                               : "{\"removed\":" + std::to_string(update.removed_rules) + "}";
+}
+
+void QueryServer::reloadRules() {
+    try {
+        RuleUpdate update;
+        if (!watcher->poll(kb, update)) return;
+        runner.rulesChanged(update);
+        std::cerr << "Rules reloaded: " << update.added_rules << " added, " << update.removed_rules << " removed" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+void QueryServer::flush(Client& client) {
+    size_t sent = 0;
+    while (sent < client.output.size()) {
+        const ssize_t n = ::send(client.fd, client.output.data() + sent, client.output.size() - sent, 0);
+        if (n > 0) {
+            sent += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        // 相手が切断した: 残りの応答は捨てる
+        client.closing = true;
+        sent = client.output.size();
+    }
+    client.output.erase(0, sent);
+}
+
+void QueryServer::appendFrame(std::string& out, std::string_view body) {
+    const uint32_t length = static_cast<uint32_t>(body.size());
+    const char header[4] = {static_cast<char>(length >> 24), static_cast<char>(length >> 16),
+                            static_cast<char>(length >> 8), static_cast<char>(length)};
+    out.append(header, sizeof(header));
+    out.append(body);
+}
@@ -0,0 +1,85 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include "BatchRunner.h"
+#include "KnowledgeBase.h"
+#include "RuleFileWatcher.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// デーモンモード (--serve): 読み込み済みの知識ベースで、Unix ドメインソケットに接続したクライアントの問い合わせに答える
+// 要求・応答はどちらも 4 バイトの長さ (ビッグエンディアン) に続く本文で、1 要求に 1 応答を要求の順に返す
+//   要求: バッチモードの 1 行と同じ "=<初期事実> ?<クエリ>" (例: "=A B ?C D"、"?" 以降を省略するとファイルのクエリ)
+//   応答: {"scenario":<接続ごとの要求番号>,"results":{"C":"true","D":"undetermined"}} または {"error":"..."}
+// "+ <ルール>" / "- <ルール>" の要求はルールを追加・削除し、{"added":N} / {"removed":N} を返す
+// (それより前に届いた要求は変更前のルールで、後の要求は変更後のルールで評価する)
+// poll によるイベントループで全クライアントを 1 スレッドで扱い、1 回の待ちで届いた要求はクライアントをまたいで
+// BatchRunner でまとめて評価する (後向き連鎖では 64 シナリオずつのブロックをスレッドプールで並列に評価)
+// 送信待ちの応答があるクライアントからは、送り終えるまで次の要求を読まない
+class QueryServer {
+    public:
+        static constexpr uint32_t MAX_REQUEST_BYTES = 1 << 20; // これより長い要求を送ったクライアントは切断する
+        // クライアントごとの受信済み・未処理のバイト数の上限 (これ以上は読まず、残りはカーネルのバッファで待たせる)
+        static constexpr size_t MAX_INPUT_BYTES = MAX_REQUEST_BYTES + 4;
+        // クライアントごとの送信待ちの上限 (超えたクライアントは応答を読んでいないとみなして切断する)
+        static constexpr size_t MAX_OUTPUT_BYTES = 16 << 20;
+
+        // threads == 0 ならハードウェアのスレッド数。watcher があればルールファイルの変更を要求の合間に反映する
+        explicit QueryServer(KnowledgeBase& kb, size_t threads = 0, RuleFileWatcher* watcher = nullptr);
+        ~QueryServer();
+
+        QueryServer(const QueryServer&) = delete;
+        QueryServer& operator=(const QueryServer&) = delete;
+
+        // path にソケットを作って待ち受ける (使われていないソケットファイルが残っていれば置き換える)
+        void listen(const std::string& path);
+
+        // SIGINT / SIGTERM を受けるまで要求に答え、処理した要求の数を返す
+        size_t run();
+
+        // 全クライアントの要求の評価の計測値 (kb.collect_stats が true の場合のみ収集される)
+        InferenceStats stats() const { return runner.stats(); }
+
+    private:
+        struct Client {
+            int fd = -1;
+            std::string input; // 受信済みで未処理のバイト列
+            std::string output; // 送信待ちの応答
+            size_t requests = 0; // 受け付けた要求の数 (応答の "scenario" 番号)
+            bool closing = false; // 送信待ちを送り終えたら切断する
+            bool dropped = false; // 送信待ちが上限を超えた (以降の応答は捨て、すぐに切断する)
+        };
+
+        // 1 回の待ちで受け付けた要求 (受け付けた順に応答する)
+        struct Pending {
+            size_t client; // clients の位置
+            bool evaluated; // BatchRunner で評価する (false なら error をそのまま返す)
+            std::string error;
+        };
+
+        // 1 回の受信で溜まった要求がこれを超えたら、その場で評価して送信待ちに移す (応答の本文を溜めすぎない)
+        static constexpr size_t MAX_PENDING_REQUESTS = 4096;
+
+        KnowledgeBase& kb;
+        BatchRunner runner;
+        RuleFileWatcher* watcher;
+        int listen_fd = -1;
+        std::string socket_path;
+        std::vector<Client> clients;
+        std::vector<Pending> pending;
+        std::vector<std::string> replies; // evaluatePending の結果
+        size_t handled = 0; // 応答した要求の数
+
+        void acceptClients();
+        void receive(size_t index); // 届いたバイト列を読み、完結した要求を pending に加える
+        void respond(); // pending の要求を評価し、応答をクライアントの送信待ちに加える
+        std::string editRules(std::string_view body); // ルールの追加・削除の要求を反映し、応答の本文を返す
+        void reloadRules(); // watcher が知らせたルールファイルの変更を反映する
+        void flush(Client& client); // 送信待ちを送れるだけ送る
+        static void appendFrame(std::string& out, std::string_view body);
+};
+
+#endif
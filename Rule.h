@@ -0,0 +1,19 @@
+#ifndef RULE_H
+#define RULE_H
+
+#include <cstdint>
+
+// コンパイル済みルール (RuleBase::expressions の節点と fact_pool 上の範囲)
+// 解析時のチャンクごとの式はコンパイル後に破棄し、評価・表示ともにこちらを使う
+class Rule {
+    public:
+        uint32_t premise = 0; // 前提部の式 (AND 分解や <=> で同じ前提部を持つルールは同じ節点を指す)
+        uint32_t conclusion = 0; // 結論部の式 (表示と SAT モードの符号化に使う)
+        uint32_t premise_facts_begin = 0, premise_facts_end = 0; // 前提部が参照する事実 (重複なし)
+        uint32_t conclusion_facts_begin = 0, conclusion_facts_end = 0; // 結論部の事実 (出現順)
+        bool disjunctive_conclusion = false; // 結論部が OR/XOR
+        bool negated_conclusion = false; // 結論部が否定された単一の事実 (例: !V)
+        bool removed = false; // 実行時に取り除いたルール (番号を保つため領域は残し、どの索引からも外す)
+};
+
+#endif
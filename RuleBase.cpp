@@ -0,0 +1,358 @@
+#include "RuleBase.h"
+#include <algorithm>
+
+// (事実, 値) の組を事実 ID 順の隣接リスト (CSR) にする。unique なら同じ組を 1 つにまとめる
+static void buildIndex(size_t fact_count, std::vector<std::pair<FactId, uint32_t>>& pairs, bool unique,
+                       FlatArray<uint32_t>& begin, FlatArray<uint32_t>& end, FlatArray<uint32_t>& values) {
+    std::sort(pairs.begin(), pairs.end());
+    if (unique) pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    begin.assign(fact_count, 0);
+    end.assign(fact_count, 0);
+    values.clear();
+    for (const std::pair<FactId, uint32_t>& pair : pairs) {
+        end[pair.first]++;
+        values.push_back(pair.second);
+    }
+    uint32_t offset = 0;
+    for (size_t f = 0; f < fact_count; ++f) {
+        begin[f] = offset;
+        offset += end[f];
+        end[f] = offset;
+    }
+}
+
+void RuleBase::indexRule(size_t rule_index, size_t fact_count) {
+    const Rule& rule = rules[rule_index];
+
+    // 前向き連鎖の監視リスト: 前提部が参照する各事実
+    if (rules_by_premise.size() < fact_count) rules_by_premise.resize(fact_count);
+    for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+        rules_by_premise.edit(fact_pool[i]).push_back(static_cast<uint32_t>(rule_index));
+    }
+
+    if (rule.disjunctive_conclusion) disjunctive_rules.push_back(static_cast<uint32_t>(rule_index));
+
+    // 単一の否定されていない事実、または複合結論 (OR/XOR など) に含まれる全事実が対象
+    if (rule.negated_conclusion) return;
+
+    if (rules_by_conclusion.size() < fact_count) rules_by_conclusion.resize(fact_count);
+    for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+        std::vector<uint32_t>& bucket = rules_by_conclusion.edit(fact_pool[i]);
+        // 同じルールが同一事実を複数回結論に持つ場合 (例: X | X) は一度だけ登録
+        if (bucket.empty() || bucket.back() != rule_index) {
+            bucket.push_back(static_cast<uint32_t>(rule_index));
+        }
+    }
+}
+
+void RuleBase::ownArrays() {
+    rules.own();
+    rules_by_conclusion.own();
+    rules_by_premise.own();
+    disjunctive_rules.own();
+    fact_pool.own();
+    for (FlatArray<uint32_t>* array : {&negation_begin, &negation_end, &negated_rules, &fact_component, &component_begin,
+                                       &component_facts, &dependency_begin, &dependency_end, &component_dependencies,
+                                       &elimination_begin, &elimination_end, &component_eliminations, &dependent_begin,
+                                       &dependent_end, &fact_dependents, &premise_watch_begin, &premise_watch_end,
+                                       &premise_watches, &disjunct_begin, &disjunct_end, &disjunct_watches,
+                                       &component_part, &part_parent}) {
+        array->own();
+    }
+    rules_by_part.own();
+}
+
+void RuleBase::buildComponents(size_t fact_count) {
+    ownArrays();
+    // 否定の結論の索引 (事実ごとにルール順)
+    std::vector<std::pair<FactId, uint32_t>> pairs;
+    for (size_t rule_index = 0; rule_index < rules.size(); ++rule_index) {
+        const Rule& rule = rules[rule_index];
+        if (rule.negated_conclusion && !rule.removed) {
+            pairs.emplace_back(fact_pool[rule.conclusion_facts_begin], static_cast<uint32_t>(rule_index));
+        }
+    }
+    buildIndex(fact_count, pairs, false, negation_begin, negation_end, negated_rules);
+
+    // 依存グラフを隣接リスト (CSR) にする: 事実 f -> f を結論 (否定の結論を含む) とするルールの前提部の事実
+    // (OR/XOR 結論の選言肢どうしは依存させない。依存させると循環のない事実が循環を含む成分にまとめられ、
+    // 否定を含む前提部が成分内の確定していない事実を読むことになる)
+    std::vector<uint32_t> edge_begin(fact_count + 1, 0);
+    std::vector<FactId> edges;
+    for (FactId f = 0; f < fact_count; ++f) {
+        edge_begin[f] = static_cast<uint32_t>(edges.size());
+        forEachDependency(f, [&](FactId dependency) { edges.push_back(dependency); });
+    }
+    edge_begin[fact_count] = static_cast<uint32_t>(edges.size());
+
+    // Tarjan の強連結成分分解 (再帰の代わりに明示的なスタックを使う)
+    // 成分は依存先をすべて出力した後に出力されるため、成分番号の昇順がそのまま評価順になる
+    constexpr uint32_t UNVISITED = UINT32_MAX;
+    std::vector<uint32_t> order(fact_count, UNVISITED);
+    std::vector<uint32_t> low(fact_count, 0);
+    std::vector<bool> on_stack(fact_count, false);
+    std::vector<FactId> stack;
+    std::vector<std::pair<FactId, uint32_t>> frames; // (事実, 次に調べる辺)
+    uint32_t next_order = 0;
+
+    fact_component.assign(fact_count, 0);
+    component_begin.clear();
+    component_facts.clear();
+    cyclic_components.clear();
+    std::vector<bool> cyclic;
+
+    for (FactId root = 0; root < fact_count; ++root) {
+        if (order[root] != UNVISITED) continue;
+        frames.emplace_back(root, edge_begin[root]);
+        order[root] = low[root] = next_order++;
+        stack.push_back(root);
+        on_stack[root] = true;
+
+        while (!frames.empty()) {
+            const FactId v = frames.back().first;
+            if (frames.back().second < edge_begin[v + 1]) {
+                const FactId w = edges[frames.back().second++];
+                if (order[w] == UNVISITED) {
+                    order[w] = low[w] = next_order++;
+                    stack.push_back(w);
+                    on_stack[w] = true;
+                    frames.emplace_back(w, edge_begin[w]);
+                } else if (on_stack[w]) {
+                    low[v] = std::min(low[v], order[w]);
+                }
+                continue;
+            }
+
+            frames.pop_back();
+            if (!frames.empty()) {
+                const FactId parent = frames.back().first;
+                low[parent] = std::min(low[parent], low[v]);
+            }
+            if (low[v] != order[v]) continue;
+
+            // v を根とする成分をスタックから取り出す
+            const uint32_t component = static_cast<uint32_t>(component_begin.size());
+            component_begin.push_back(static_cast<uint32_t>(component_facts.size()));
+            FactId member;
+            do {
+                member = stack.back();
+                stack.pop_back();
+                on_stack[member] = false;
+                fact_component[member] = component;
+                component_facts.push_back(member);
+            } while (member != v);
+
+            // 2 つ以上の事実からなる成分、または自己ループを持つ事実は循環
+            bool is_cyclic = component_facts.size() - component_begin.back() > 1;
+            for (uint32_t e = edge_begin[v]; e < edge_begin[v + 1] && !is_cyclic; ++e) is_cyclic = edges[e] == v;
+            cyclic.push_back(is_cyclic);
+        }
+    }
+
+    const size_t component_count = component_begin.size();
+    component_begin.push_back(static_cast<uint32_t>(component_facts.size()));
+    cyclic_components.resize(component_count);
+    for (size_t c = 0; c < component_count; ++c) {
+        if (cyclic[c]) cyclic_components.set(c);
+    }
+
+    // 成分ごとの依存先の成分 (重複なし) と、成分内の事実を結論に持つ OR/XOR ルール
+    dependency_begin.clear();
+    dependency_end.clear();
+    component_dependencies.clear();
+    std::vector<uint32_t> dependencies;
+    for (size_t c = 0; c < component_count; ++c) {
+        dependencies.clear();
+        for (uint32_t m = component_begin[c]; m < component_begin[c + 1]; ++m) {
+            const FactId f = component_facts[m];
+            for (uint32_t e = edge_begin[f]; e < edge_begin[f + 1]; ++e) {
+                if (fact_component[edges[e]] != c) dependencies.push_back(fact_component[edges[e]]);
+            }
+        }
+        std::sort(dependencies.begin(), dependencies.end());
+        dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+        dependency_begin.push_back(static_cast<uint32_t>(component_dependencies.size()));
+        component_dependencies.insert(component_dependencies.end(), dependencies.begin(), dependencies.end());
+        dependency_end.push_back(static_cast<uint32_t>(component_dependencies.size()));
+    }
+
+    // 結論部の先頭の事実の成分に登録する (ルール順を保つ)
+    // 消去法は同じ成分の選言肢だけを数える。他の成分の選言肢は評価順が決まっておらず、前提部が TRUE なら
+    // 結論とするルールによって TRUE になるため、消去法で状態は変わらない
+    std::vector<std::vector<uint32_t>> eliminations(component_count);
+    for (size_t rule_index : disjunctive_rules) {
+        const Rule& rule = rules[rule_index];
+        if (rule.negated_conclusion || rule.conclusion_facts_begin == rule.conclusion_facts_end) continue;
+        eliminations[fact_component[fact_pool[rule.conclusion_facts_begin]]].push_back(static_cast<uint32_t>(rule_index));
+    }
+    elimination_begin.clear();
+    elimination_end.clear();
+    component_eliminations.clear();
+    for (const std::vector<uint32_t>& list : eliminations) {
+        elimination_begin.push_back(static_cast<uint32_t>(component_eliminations.size()));
+        component_eliminations.insert(component_eliminations.end(), list.begin(), list.end());
+        elimination_end.push_back(static_cast<uint32_t>(component_eliminations.size()));
+    }
+
+    // 差分評価の索引: 成分の外の事実は成分の評価中に変化しないため、同じ成分内の参照だけを登録する
+    pairs.clear();
+    for (uint32_t m = 0; m < component_facts.size(); ++m) {
+        const FactId f = component_facts[m];
+        auto watchPremise = [&](const Rule& rule) {
+            for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+                if (fact_component[fact_pool[i]] == fact_component[f]) pairs.emplace_back(fact_pool[i], m);
+            }
+        };
+        for (uint32_t i = negation_begin[f]; i < negation_end[f]; ++i) watchPremise(rules[negated_rules[i]]);
+        if (f >= rules_by_conclusion.size()) continue;
+        for (size_t rule_index : rules_by_conclusion[f]) watchPremise(rules[rule_index]);
+    }
+    buildIndex(fact_count, pairs, true, dependent_begin, dependent_end, fact_dependents);
+
+    pairs.clear();
+    std::vector<std::pair<FactId, uint32_t>> disjuncts;
+    for (size_t c = 0; c < component_count; ++c) {
+        for (uint32_t e = elimination_begin[c]; e < elimination_end[c]; ++e) {
+            const Rule& rule = rules[component_eliminations[e]];
+            for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+                if (fact_component[fact_pool[i]] == c) pairs.emplace_back(fact_pool[i], e);
+            }
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                if (fact_component[fact_pool[i]] == c) disjuncts.emplace_back(fact_pool[i], e);
+            }
+        }
+    }
+    buildIndex(fact_count, pairs, true, premise_watch_begin, premise_watch_end, premise_watches);
+    buildIndex(fact_count, disjuncts, false, disjunct_begin, disjunct_end, disjunct_watches);
+
+    // 独立部分: 依存し合う成分を union-find でまとめ、最初の成分の順に番号を振る
+    std::vector<uint32_t> parent(component_count);
+    for (uint32_t c = 0; c < component_count; ++c) parent[c] = c;
+    auto find = [&](uint32_t c) {
+        while (parent[c] != c) c = parent[c] = parent[parent[c]];
+        return c;
+    };
+    for (uint32_t c = 0; c < component_count; ++c) {
+        for (uint32_t d = dependency_begin[c]; d < dependency_end[c]; ++d) {
+            const uint32_t a = find(c);
+            const uint32_t b = find(component_dependencies[d]);
+            if (a != b) parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+    constexpr uint32_t NO_PART = UINT32_MAX;
+    std::vector<uint32_t> root_part(component_count, NO_PART);
+    component_part.assign(component_count, 0);
+    uint32_t part_count = 0;
+    for (uint32_t c = 0; c < component_count; ++c) {
+        const uint32_t root = find(c);
+        if (root_part[root] == NO_PART) root_part[root] = part_count++;
+        component_part[c] = root_part[root];
+    }
+
+    part_parent.resize(part_count);
+    for (uint32_t part = 0; part < part_count; ++part) part_parent[part] = part;
+    stale_entries = 0;
+
+    // 前提部の事実は結論の事実の依存先なので、ルールは結論の事実の部分に属する
+    rules_by_part.assign(part_count);
+    for (size_t rule_index = 0; rule_index < rules.size(); ++rule_index) {
+        const Rule& rule = rules[rule_index];
+        if (rule.removed || rule.conclusion_facts_begin == rule.conclusion_facts_end) continue;
+        const FactId conclusion = fact_pool[rule.conclusion_facts_begin];
+        rules_by_part.edit(component_part[fact_component[conclusion]]).push_back(static_cast<uint32_t>(rule_index));
+    }
+}
+
+void RuleBase::buildSlice(const std::vector<FactId>& query_ids, QuerySlice& slice) const {
+    slice.queries = query_ids;
+    slice.components.clear();
+    slice.facts.clear();
+    slice.rules.clear();
+    slice.rule_bits.resize(rules.size());
+    slice.rule_bits.clear();
+
+    // クエリの成分から依存先の成分をたどり、帰りがけ順 (依存先が先 = 評価順) に並べる
+    // (実行時のルールの変更で作り直した成分は番号が大きくなるため、成分番号の順は評価順とは限らない)
+    Bitset visited;
+    visited.resize(componentCount());
+    std::vector<std::pair<uint32_t, uint32_t>> stack; // (成分, 次に調べる依存先)
+    for (FactId id : query_ids) {
+        if (id >= fact_component.size()) {
+            slice.facts.push_back(id); // どのルールにも現れないため、初期事実かどうかだけで決まる
+            continue;
+        }
+        if (visited.test(fact_component[id])) continue;
+        visited.set(fact_component[id]);
+        stack.emplace_back(fact_component[id], dependency_begin[fact_component[id]]);
+        while (!stack.empty()) {
+            const uint32_t component = stack.back().first;
+            if (stack.back().second < dependency_end[component]) {
+                const uint32_t dependency = component_dependencies[stack.back().second++];
+                if (visited.test(dependency)) continue;
+                visited.set(dependency);
+                stack.emplace_back(dependency, dependency_begin[dependency]);
+                continue;
+            }
+            stack.pop_back();
+            slice.components.push_back(component);
+        }
+    }
+
+    for (uint32_t component : slice.components) {
+        for (uint32_t m = component_begin[component]; m < component_begin[component + 1]; ++m) {
+            const FactId f = component_facts[m];
+            slice.facts.push_back(f);
+            for (uint32_t i = negation_begin[f]; i < negation_end[f]; ++i) {
+                slice.rule_bits.set(negated_rules[i]);
+                slice.rules.push_back(negated_rules[i]);
+            }
+            if (f >= rules_by_conclusion.size()) continue;
+            for (size_t rule_index : rules_by_conclusion[f]) {
+                if (slice.rule_bits.test(rule_index)) continue;
+                slice.rule_bits.set(rule_index);
+                slice.rules.push_back(rule_index);
+            }
+        }
+    }
+    std::sort(slice.rules.begin(), slice.rules.end());
+}
+
+bool RuleBase::collectCone(const std::vector<FactId>& seeds, Bitset& cone_bits, std::vector<FactId>& cone,
+                           std::vector<size_t>* affected_rules, size_t limit) const {
+    // 事実 -> (前提部で参照する) ルール -> 結論の事実 をたどり、変更の影響が及ぶ事実を集める
+    // (消去法が読む同じ結論部の選言肢は同じ成分にあり、成分の事実は互いに下流にあるため別にたどらない)
+    cone.clear();
+    for (FactId id : seeds) {
+        if (cone_bits.test(id)) continue;
+        cone_bits.set(id);
+        cone.push_back(id);
+    }
+
+    auto visitRule = [&](size_t rule_index) {
+        if (affected_rules) affected_rules->push_back(rule_index);
+        const Rule& rule = rules[rule_index];
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            FactId c = fact_pool[i];
+            if (cone_bits.test(c)) continue;
+            cone_bits.set(c);
+            cone.push_back(c);
+        }
+    };
+
+    for (size_t head = 0; head < cone.size(); ++head) {
+        if (cone.size() > limit) return false;
+        const FactId id = cone[head];
+        if (id < rules_by_premise.size()) {
+            for (size_t rule_index : rules_by_premise[id]) visitRule(rule_index);
+        }
+        if (affected_rules && id < rules_by_conclusion.size()) {
+            // 無効化した事実を結論とするルールは再評価が必要
+            affected_rules->insert(affected_rules->end(), rules_by_conclusion[id].begin(), rules_by_conclusion[id].end());
+        }
+        if (affected_rules && id < negation_begin.size()) {
+            affected_rules->insert(affected_rules->end(), negated_rules.begin() + negation_begin[id],
+                                   negated_rules.begin() + negation_end[id]);
+        }
+    }
+    return true;
+}
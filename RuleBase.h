@@ -0,0 +1,183 @@
+#ifndef RULEBASE_H
+#define RULEBASE_H
+
+#include "Expression.h"
+#include "FlatArray.h"
+#include "Rule.h"
+#include <memory>
+#include <vector>
+
+class MappedFile;
+
+// クエリの影響範囲 (cone of influence): クエリの事実の成分と、その依存先をたどって届く成分すべて
+// 範囲外の事実はクエリの結果に影響しないため、シナリオごとの評価はこの範囲の事実だけをリセット・評価すればよい
+struct QuerySlice {
+    std::vector<FactId> queries; // 範囲を求めたクエリ (同じクエリの間は使い回す)
+    std::vector<uint32_t> components; // 範囲の成分 (昇順 = 評価順)
+    std::vector<FactId> facts; // 範囲の成分の事実 (成分を持たない読み込み後の事実はクエリそのもの)
+    std::vector<size_t> rules; // 範囲の事実を結論 (否定の結論を含む) とするルール (ルール番号順、前向き連鎖の種)
+    Bitset rule_bits; // rules の集合 (前向き連鎖で範囲外のルールを再評価待ちにしないため)
+};
+
+// コンパイル済みのルール集合と索引
+// 推論の状態は持たないため、const 参照を複数のスレッドで共有し、状態は各スレッドの評価器 (BatchEvaluator) が持つ
+// 実行時のルールの追加・削除 (insertRule / removeRule / updateComponents) は、どの評価器も評価していない間に行う
+class RuleBase {
+    public:
+        FlatArray<Rule> rules;
+
+        // 結論部の事実 ID -> その事実を結論とするルール番号 (後向き連鎖の索引)
+        FlatIndex rules_by_conclusion;
+        // 前提部の事実 ID -> その事実を参照するルール番号 (前向き連鎖の監視リスト)
+        FlatIndex rules_by_premise;
+        // OR/XOR 結論を持つルール番号 (消去法の対象、ルール番号順)
+        FlatArray<uint32_t> disjunctive_rules;
+
+        // 全ルールの式 (知識ベース全体でハッシュコンシングした DAG) と事実リストを連続領域にまとめて保持
+        ExpressionArena expressions;
+        FlatArray<FactId> fact_pool;
+
+        // 以下の索引は 1 本の配列に範囲 [begin, end) を並べた形 (CSR) で持つ
+        // 実行時のルールの変更では、書き換える範囲を配列の末尾に追記し直す (古い範囲は参照されなくなるだけで残る)
+
+        // 否定の結論の索引 (事実 ID で引く): f を !f と結論するルール番号は negated_rules[negation_begin[f], negation_end[f])
+        // (rules_by_conclusion は TRUE の rail、こちらは偽の rail を導くルール。ルール番号順)
+        FlatArray<uint32_t> negation_begin;
+        FlatArray<uint32_t> negation_end;
+        FlatArray<uint32_t> negated_rules;
+
+        // 後向き連鎖の評価順: 事実の依存グラフ (事実 -> それを結論 (否定の結論を含む) とするルールの前提部の事実) の
+        // 強連結成分。循環を含む成分は成分内で不動点まで反復する
+        // buildComponents 直後の成分番号は依存先の成分ほど小さい (トポロジカル順)。ルールの変更で作り直した成分は
+        // 末尾に新しい番号で追加し、元の成分はどの事実からも参照されなくなる (評価順は依存先をたどって決める)
+        FlatArray<uint32_t> fact_component; // 事実 ID -> 成分番号
+        FlatArray<uint32_t> component_begin; // 成分 c の事実は component_facts[component_begin[c], component_begin[c + 1])
+        FlatArray<FactId> component_facts;
+        FlatArray<uint32_t> dependency_begin; // 成分 c が直接依存する成分は component_dependencies[dependency_begin[c], dependency_end[c])
+        FlatArray<uint32_t> dependency_end;
+        FlatArray<uint32_t> component_dependencies;
+        FlatArray<uint32_t> elimination_begin; // 結論部の先頭の事実が成分 c にある OR/XOR ルールは
+        FlatArray<uint32_t> elimination_end; // component_eliminations[elimination_begin[c], elimination_end[c]) (ルール順)
+                                             // 実行時に取り除いたルールは作り直すまで removed のまま残る (評価では飛ばす)
+        FlatArray<uint32_t> component_eliminations;
+        Bitset cyclic_components; // 2 つ以上の事実からなる、または自己ループを持つ成分
+
+        // 成分内の差分評価の索引 (事実 ID で引く): 状態が変わった事実から、再評価が必要なものだけをたどる
+        FlatArray<uint32_t> dependent_begin; // 事実 f を前提部で参照する同じ成分の事実の位置 (component_facts の添字) は
+        FlatArray<uint32_t> dependent_end; // fact_dependents[dependent_begin[f], dependent_end[f])
+        FlatArray<uint32_t> fact_dependents;
+        FlatArray<uint32_t> premise_watch_begin; // f を前提部で参照する同じ成分の OR/XOR ルール (component_eliminations の添字)
+        FlatArray<uint32_t> premise_watch_end;
+        FlatArray<uint32_t> premise_watches;
+        FlatArray<uint32_t> disjunct_begin; // f を結論部に含む同じ成分の OR/XOR ルール (f が複数回現れればその回数だけ並ぶ)
+        FlatArray<uint32_t> disjunct_end;
+        FlatArray<uint32_t> disjunct_watches;
+
+        // 独立部分: 成分の依存関係を向きを無視してつないだ連結成分 (部分をまたぐルールはない)
+        // クエリの届かない部分は推論の状態ごと飛ばせるため、前向き連鎖は部分単位で必要になったときに行う
+        // 実行時にルールが 2 つの部分をつないだら union-find でまとめる (取り除いても分けないため、部分は実際より粗くなりうる)
+        FlatArray<uint32_t> component_part; // 成分番号 -> 部分番号 (まとめた部分の番号は partOf で根をたどる)
+        FlatArray<uint32_t> part_parent;
+        FlatIndex rules_by_part; // 部分の事実を結論とするルール番号 (ルール順、否定の結論を含む)
+
+        // バイナリイメージから読み込んだときにマップした領域 (上の配列はこれを直接指す。コピーした RuleBase とも共有する)
+        std::shared_ptr<const MappedFile> image;
+
+        size_t componentCount() const { return component_begin.empty() ? 0 : component_begin.size() - 1; }
+        size_t partCount() const { return rules_by_part.size(); }
+        uint32_t partOf(uint32_t component) const {
+            uint32_t part = component_part[component];
+            while (part_parent[part] != part) part = part_parent[part];
+            return part;
+        }
+
+        // ルールの前提部が成分 component の事実を参照するか
+        bool readsComponent(const Rule& rule, uint32_t component) const {
+            for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+                if (fact_component[fact_pool[i]] == component) return true;
+            }
+            return false;
+        }
+
+        // 追加されたルールを結論・前提部・OR/XOR の索引に登録する (fact_count は事実 ID の上限)
+        void indexRule(size_t rule_index, size_t fact_count);
+
+        // ルールと索引から成分と独立部分を求める (読み込みの最後に呼ぶ。実行時の変更で不要な要素が増えたときも作り直す)
+        void buildComponents(size_t fact_count);
+
+        // query_ids の影響範囲を slice に求める
+        void buildSlice(const std::vector<FactId>& query_ids, QuerySlice& slice) const;
+
+        // seeds の下流 (前提部で状態を読む事実を推移的にたどったもの) を cone に集める
+        // cone_bits には所属の印を付ける (呼び出し元が事実 ID の上限まで確保してクリアしておく)
+        // affected_rules が null でなければ、cone の事実を前提部で参照するルールと結論とするルールを加える (重複あり)
+        // cone が limit 個を超えたらたどるのをやめて false を返す (cone と affected_rules は途中まで)
+        bool collectCone(const std::vector<FactId>& seeds, Bitset& cone_bits, std::vector<FactId>& cone,
+                         std::vector<size_t>* affected_rules, size_t limit = SIZE_MAX) const;
+
+        // --- 実行時のルールの変更 (RuleBaseUpdate.cpp) ---
+        // 1. 取り除くルールは removeRule で、追加したルールは insertRule で索引に反映する
+        //    insertRule はルールがつないだ独立部分をまとめ、(残した部分, 吸収した部分) を merged_parts に加える
+        // 2. 変更したルールの番号を渡して updateComponents を呼び、成分と索引を合わせる
+        //    循環ができた (成分がまとまる) か切れた (成分が分かれうる) ときだけその成分を作り直し、
+        //    それ以外は成分をそのままにして、変更したルールの分だけ依存先・差分評価・消去法の索引を書き換える
+        //    参照されない要素が生きている要素より多くなったときは buildComponents で全体を作り直して true を返す
+        void removeRule(size_t rule_index);
+        void insertRule(size_t rule_index, size_t fact_count, std::vector<std::pair<uint32_t, uint32_t>>& merged_parts);
+        bool updateComponents(size_t fact_count, const std::vector<size_t>& changed_rules);
+
+    protected:
+        size_t stale_entries = 0; // 索引の配列のうち参照されなくなった要素の数
+
+        // イメージの領域を指す配列をすべて自前の領域に写す (索引を書き換える関数の入口で呼ぶ)
+        void ownArrays();
+
+    private:
+
+        // 事実 f が依存する事実 (依存グラフの辺の行き先、重複あり) を visit に渡す
+        template <typename Visit>
+        void forEachDependency(FactId f, Visit visit) const {
+            auto premises = [&](const Rule& rule) {
+                for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) visit(fact_pool[i]);
+            };
+            for (uint32_t i = negation_begin[f]; i < negation_end[f]; ++i) premises(rules[negated_rules[i]]);
+            if (f >= rules_by_conclusion.size()) return;
+            for (size_t rule_index : rules_by_conclusion[f]) premises(rules[rule_index]);
+        }
+
+        // 事実 g に依存する事実 (forEachDependency の辺を逆にたどった行き先、重複あり) を visit に渡す
+        template <typename Visit>
+        void forEachDependent(FactId g, Visit visit) const {
+            if (g >= rules_by_premise.size()) return;
+            for (size_t rule_index : rules_by_premise[g]) {
+                const Rule& rule = rules[rule_index];
+                for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) visit(fact_pool[i]);
+            }
+        }
+
+        // 実行時の変更の作業領域 (事実・成分ごとの配列は変更のたびに確保し直さない)
+        std::vector<uint32_t> update_index; // 事実 ID -> 作り直す事実の中での位置 (範囲外は UINT32_MAX)
+        Bitset retired_bits; // 作り直す (変更前の) 成分
+        Bitset merge_cone_bits; // 成分をまとめる起点の下流
+        std::vector<FactId> merge_cone;
+        std::vector<uint32_t> search_mark; // 事実 ID -> reaches で印を付けた探索の番号 (前向きは偶数、後ろ向きは奇数)
+        uint32_t search_epoch = 0;
+        std::vector<FactId> forward_queue;
+        std::vector<FactId> backward_queue;
+
+        void growFacts(size_t fact_count); // 新しい事実を 1 つずつの成分と独立部分にする
+        uint32_t mergeParts(uint32_t a, uint32_t b); // 2 つの部分をまとめ、残した部分の番号を返す
+        void replaceRange(FlatArray<uint32_t>& begin, FlatArray<uint32_t>& end, FlatArray<uint32_t>& values,
+                          size_t index, const std::vector<uint32_t>& list);
+        // from から依存先をたどって to に届くか (within が UINT32_MAX でなければ成分 within の事実だけを通る)
+        bool reaches(FactId from, FactId to, uint32_t within);
+        // 成分 component が成分 other の事実に直接依存しているか
+        bool dependsOn(uint32_t component, uint32_t other) const;
+        // 成分 component の消去法のルールにルールを加える・外す (list は作業領域)
+        void insertElimination(uint32_t component, size_t rule_index, std::vector<uint32_t>& list);
+        void removeElimination(uint32_t component, size_t rule_index, std::vector<uint32_t>& list);
+        // 成分 component の消去法のルールの事実の監視を求め直す (touched に書き直した事実を入れる)
+        void watchEliminations(uint32_t component, std::vector<FactId>& touched);
+};
+
+#endif
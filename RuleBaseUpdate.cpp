@@ -0,0 +1,665 @@
+#include "RuleBase.h"
+#include <algorithm>
+
+// --- 実行時のルールの変更 ---
+// 成分は形が変わるものだけを作り直し、索引の範囲は書き換えるものだけを置き直すため、
+// 1 回の変更の手間は変更したルールと作り直す成分の大きさだけで決まる
+// (参照されなくなった要素は stale_entries に数え、生きている要素より多くなったら buildComponents で詰め直す)
+
+static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+void RuleBase::replaceRange(FlatArray<uint32_t>& begin, FlatArray<uint32_t>& end, FlatArray<uint32_t>& values,
+                            size_t index, const std::vector<uint32_t>& list) {
+    // 元の範囲とその後ろの空き (NO_INDEX で埋めた要素。索引の値が NO_INDEX になることはない) に収まればその場で書き換え、
+    // 収まらなければ半分の空きを付けて末尾に追記する (大きな範囲に 1 つずつ加えても、追記し直すのはまれになる)
+    // 空の範囲は位置が他の範囲と重なりうるため、その場では伸ばさない
+    const uint32_t old_begin = begin[index];
+    const size_t old_size = end[index] - old_begin;
+    size_t room = old_size;
+    if (old_size > 0) {
+        while (room < list.size() && old_begin + room < values.size() && values[old_begin + room] == NO_INDEX) room++;
+    }
+    if (list.size() <= room) {
+        std::copy(list.begin(), list.end(), values.begin() + old_begin);
+        if (list.size() < old_size) std::fill(values.begin() + old_begin + list.size(), values.begin() + old_begin + old_size, NO_INDEX);
+        end[index] = old_begin + static_cast<uint32_t>(list.size());
+        stale_entries = stale_entries + old_size - list.size();
+        return;
+    }
+    std::fill(values.begin() + old_begin, values.begin() + old_begin + old_size, NO_INDEX);
+    const size_t spare = list.size() / 2;
+    stale_entries += old_size + spare;
+    begin[index] = static_cast<uint32_t>(values.size());
+    values.insert(values.end(), list.begin(), list.end());
+    end[index] = static_cast<uint32_t>(values.size());
+    values.insert(values.end(), spare, NO_INDEX);
+}
+
+void RuleBase::growFacts(size_t fact_count) {
+    // 新しい事実はまだどのルールにも依存しないため、1 つずつの成分と独立部分になる
+    for (FactId f = static_cast<FactId>(fact_component.size()); f < fact_count; ++f) {
+        const uint32_t component = static_cast<uint32_t>(componentCount());
+        const uint32_t part = static_cast<uint32_t>(partCount());
+        fact_component.push_back(component);
+        component_facts.push_back(f);
+        component_begin.push_back(static_cast<uint32_t>(component_facts.size()));
+        cyclic_components.resize(component + 1);
+        dependency_begin.push_back(static_cast<uint32_t>(component_dependencies.size()));
+        dependency_end.push_back(static_cast<uint32_t>(component_dependencies.size()));
+        elimination_begin.push_back(static_cast<uint32_t>(component_eliminations.size()));
+        elimination_end.push_back(static_cast<uint32_t>(component_eliminations.size()));
+        component_part.push_back(part);
+        part_parent.push_back(part);
+        rules_by_part.emplace_back();
+
+        negation_begin.push_back(0);
+        negation_end.push_back(0);
+        dependent_begin.push_back(0);
+        dependent_end.push_back(0);
+        premise_watch_begin.push_back(0);
+        premise_watch_end.push_back(0);
+        disjunct_begin.push_back(0);
+        disjunct_end.push_back(0);
+    }
+}
+
+uint32_t RuleBase::mergeParts(uint32_t a, uint32_t b) {
+    // ルールの多い部分を残し、ルール順を保って吸収した部分のルールを合わせる
+    if (rules_by_part[a].size() < rules_by_part[b].size()) std::swap(a, b);
+    std::vector<uint32_t>& kept = rules_by_part.edit(a);
+    std::vector<uint32_t>& absorbed = rules_by_part.edit(b);
+    if (kept.empty() || absorbed.empty() || absorbed.front() > kept.back()) {
+        // 吸収する部分のルールがすべて後ろにあれば (新しい事実だけの部分など) 末尾に加えるだけ
+        kept.insert(kept.end(), absorbed.begin(), absorbed.end());
+    } else {
+        std::vector<uint32_t> merged;
+        merged.reserve(kept.size() + absorbed.size());
+        std::merge(kept.begin(), kept.end(), absorbed.begin(), absorbed.end(), std::back_inserter(merged));
+        kept.swap(merged);
+    }
+    std::vector<uint32_t>().swap(absorbed);
+    part_parent[b] = a;
+    return a;
+}
+
+void RuleBase::removeRule(size_t rule_index) {
+    ownArrays();
+    Rule& rule = rules[rule_index];
+    // 索引のルール番号は昇順に並んでいる
+    auto erase = [&](auto& list) {
+        auto it = std::lower_bound(list.begin(), list.end(), rule_index);
+        if (it != list.end() && *it == rule_index) list.erase(it);
+    };
+    for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) erase(rules_by_premise.edit(fact_pool[i]));
+    if (rule.disjunctive_conclusion) erase(disjunctive_rules);
+    if (rule.negated_conclusion) {
+        const FactId f = fact_pool[rule.conclusion_facts_begin];
+        std::vector<uint32_t> list;
+        for (uint32_t i = negation_begin[f]; i < negation_end[f]; ++i) {
+            if (negated_rules[i] != rule_index) list.push_back(negated_rules[i]);
+        }
+        replaceRange(negation_begin, negation_end, negated_rules, f, list);
+    } else {
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            erase(rules_by_conclusion.edit(fact_pool[i]));
+        }
+    }
+    if (rule.conclusion_facts_begin != rule.conclusion_facts_end) {
+        erase(rules_by_part.edit(partOf(fact_component[fact_pool[rule.conclusion_facts_begin]])));
+    }
+    rule.removed = true;
+}
+
+void RuleBase::insertRule(size_t rule_index, size_t fact_count, std::vector<std::pair<uint32_t, uint32_t>>& merged_parts) {
+    ownArrays();
+    growFacts(fact_count);
+    indexRule(rule_index, fact_count);
+    const Rule& rule = rules[rule_index];
+    if (rule.conclusion_facts_begin == rule.conclusion_facts_end) return;
+
+    const FactId conclusion = fact_pool[rule.conclusion_facts_begin];
+    if (rule.negated_conclusion) {
+        // 新しいルールの番号は最大なので、末尾に加えればルール順のまま
+        std::vector<uint32_t> list(negated_rules.begin() + negation_begin[conclusion],
+                                   negated_rules.begin() + negation_end[conclusion]);
+        list.push_back(static_cast<uint32_t>(rule_index));
+        replaceRange(negation_begin, negation_end, negated_rules, conclusion, list);
+    }
+
+    // 前提部と結論部の事実はルールでつながるため、同じ独立部分にまとめる
+    uint32_t part = partOf(fact_component[conclusion]);
+    auto join = [&](FactId f) {
+        const uint32_t other = partOf(fact_component[f]);
+        if (other == part) return;
+        const uint32_t kept = mergeParts(part, other);
+        merged_parts.emplace_back(kept, kept == part ? other : part);
+        part = kept;
+    };
+    for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) join(fact_pool[i]);
+    for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) join(fact_pool[i]);
+    rules_by_part.edit(part).push_back(static_cast<uint32_t>(rule_index));
+}
+
+bool RuleBase::reaches(FactId from, FactId to, uint32_t within) {
+    if (from == to) return true;
+    // 両端から 1 段ずつ、前線の小さい方を広げる (どちらかの前線が尽きれば届かない)
+    if (search_mark.size() < fact_component.size()) search_mark.resize(fact_component.size(), 0);
+    if (search_epoch >= UINT32_MAX - 2) {
+        std::fill(search_mark.begin(), search_mark.end(), 0);
+        search_epoch = 0;
+    }
+    search_epoch += 2;
+    const uint32_t forward = search_epoch;
+    const uint32_t backward = search_epoch + 1;
+    search_mark[from] = forward;
+    search_mark[to] = backward;
+    forward_queue.assign(1, from);
+    backward_queue.assign(1, to);
+    size_t forward_head = 0;
+    size_t backward_head = 0;
+    bool met = false;
+    auto expand = [&](std::vector<FactId>& queue, size_t& head, uint32_t mark, uint32_t other, auto neighbours) {
+        const size_t level_end = queue.size();
+        for (; head < level_end && !met; ++head) {
+            neighbours(queue[head], [&](FactId f) {
+                if (met || (within != NO_INDEX && fact_component[f] != within)) return;
+                if (search_mark[f] == other) {
+                    met = true;
+                } else if (search_mark[f] != mark) {
+                    search_mark[f] = mark;
+                    queue.push_back(f);
+                }
+            });
+        }
+    };
+    while (!met && forward_head < forward_queue.size() && backward_head < backward_queue.size()) {
+        if (forward_queue.size() - forward_head <= backward_queue.size() - backward_head) {
+            expand(forward_queue, forward_head, forward, backward, [&](FactId f, auto visit) { forEachDependency(f, visit); });
+        } else {
+            expand(backward_queue, backward_head, backward, forward, [&](FactId f, auto visit) { forEachDependent(f, visit); });
+        }
+    }
+    return met;
+}
+
+bool RuleBase::dependsOn(uint32_t component, uint32_t other) const {
+    // 事実の少ない方の成分から辺をたどる
+    bool found = false;
+    if (component_begin[component + 1] - component_begin[component] <= component_begin[other + 1] - component_begin[other]) {
+        for (uint32_t m = component_begin[component]; m < component_begin[component + 1] && !found; ++m) {
+            forEachDependency(component_facts[m], [&](FactId d) { found |= fact_component[d] == other; });
+        }
+    } else {
+        for (uint32_t m = component_begin[other]; m < component_begin[other + 1] && !found; ++m) {
+            forEachDependent(component_facts[m], [&](FactId f) { found |= fact_component[f] == component; });
+        }
+    }
+    return found;
+}
+
+void RuleBase::watchEliminations(uint32_t component, std::vector<FactId>& touched) {
+    // 成分のルールの、この成分の前提部の事実と結論部の事実の監視を丸ごと求め直す
+    // (それらの事実の監視は同じ成分のルールだけを指すため、成分の並びから求め直せる)
+    std::vector<std::pair<FactId, uint32_t>> watches;
+    std::vector<std::pair<FactId, uint32_t>> disjuncts;
+    touched.clear();
+    for (uint32_t e = elimination_begin[component]; e < elimination_end[component]; ++e) {
+        const Rule& rule = rules[component_eliminations[e]];
+        if (rule.removed) continue;
+        for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+            if (fact_component[fact_pool[i]] != component) continue;
+            watches.emplace_back(fact_pool[i], e);
+            touched.push_back(fact_pool[i]);
+        }
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            if (fact_component[fact_pool[i]] != component) continue;
+            disjuncts.emplace_back(fact_pool[i], e);
+            touched.push_back(fact_pool[i]);
+        }
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    std::sort(watches.begin(), watches.end());
+    watches.erase(std::unique(watches.begin(), watches.end()), watches.end());
+    std::sort(disjuncts.begin(), disjuncts.end());
+    std::vector<uint32_t> slots;
+    auto assign = [&](const std::vector<std::pair<FactId, uint32_t>>& pairs, FlatArray<uint32_t>& begin,
+                      FlatArray<uint32_t>& end, FlatArray<uint32_t>& values) {
+        size_t i = 0;
+        for (FactId f : touched) {
+            slots.clear();
+            for (; i < pairs.size() && pairs[i].first == f; ++i) slots.push_back(pairs[i].second);
+            replaceRange(begin, end, values, f, slots);
+        }
+    };
+    assign(watches, premise_watch_begin, premise_watch_end, premise_watches);
+    assign(disjuncts, disjunct_begin, disjunct_end, disjunct_watches);
+}
+
+void RuleBase::insertElimination(uint32_t component, size_t rule_index, std::vector<uint32_t>& list) {
+    // 新しいルールの番号は最大なので、成分の並びの末尾に加えればルール順のまま
+    const uint32_t old_begin = elimination_begin[component];
+    list.assign(component_eliminations.begin() + old_begin, component_eliminations.begin() + elimination_end[component]);
+    list.push_back(static_cast<uint32_t>(rule_index));
+    replaceRange(elimination_begin, elimination_end, component_eliminations, component, list);
+    if (elimination_begin[component] == old_begin) {
+        // その場に収まれば他のルールの位置は変わらないため、新しいルールの事実の監視に加えるだけ
+        const uint32_t e = elimination_end[component] - 1;
+        const Rule& rule = rules[rule_index];
+        auto watch = [&](FlatArray<uint32_t>& begin, FlatArray<uint32_t>& end, FlatArray<uint32_t>& values, FactId f) {
+            list.assign(values.begin() + begin[f], values.begin() + end[f]);
+            list.push_back(e);
+            replaceRange(begin, end, values, f, list);
+        };
+        for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+            if (fact_component[fact_pool[i]] == component) watch(premise_watch_begin, premise_watch_end, premise_watches, fact_pool[i]);
+        }
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            if (fact_component[fact_pool[i]] == component) watch(disjunct_begin, disjunct_end, disjunct_watches, fact_pool[i]);
+        }
+        return;
+    }
+    // 追記し直したときは全ルールの位置が変わるため、取り除いたルールの位置も詰めて監視を求め直す
+    list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t r) { return rules[r].removed; }), list.end());
+    replaceRange(elimination_begin, elimination_end, component_eliminations, component, list);
+    std::vector<FactId> touched;
+    watchEliminations(component, touched);
+}
+
+void RuleBase::removeElimination(uint32_t component, size_t rule_index, std::vector<uint32_t>& list) {
+    // 位置を詰めると後ろのルールの監視をすべて書き直すことになるため、位置は残して (評価器は removed のルールを飛ばす)
+    // そのルールの事実の監視からだけ外す
+    const auto first = component_eliminations.begin() + elimination_begin[component];
+    const auto last = component_eliminations.begin() + elimination_end[component];
+    const uint32_t e = static_cast<uint32_t>(std::lower_bound(first, last, rule_index) - component_eliminations.begin());
+    const Rule& rule = rules[rule_index];
+    auto unwatch = [&](FlatArray<uint32_t>& begin, FlatArray<uint32_t>& end, FlatArray<uint32_t>& values, FactId f) {
+        list.assign(values.begin() + begin[f], values.begin() + end[f]);
+        list.erase(std::remove(list.begin(), list.end(), e), list.end());
+        replaceRange(begin, end, values, f, list);
+    };
+    for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+        if (fact_component[fact_pool[i]] == component) unwatch(premise_watch_begin, premise_watch_end, premise_watches, fact_pool[i]);
+    }
+    for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+        if (fact_component[fact_pool[i]] == component) unwatch(disjunct_begin, disjunct_end, disjunct_watches, fact_pool[i]);
+    }
+    stale_entries++;
+}
+
+bool RuleBase::updateComponents(size_t fact_count, const std::vector<size_t>& changed_rules) {
+    ownArrays();
+    growFacts(fact_count);
+    if (update_index.size() < fact_count) update_index.resize(fact_count, NO_INDEX);
+    retired_bits.resize(componentCount());
+
+    // ルールが作る依存グラフの辺 (結論部の事実 -> visit に渡す事実) は forEachDependency と同じ
+    auto forEachEdge = [&](const Rule& rule, auto visit) {
+        for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) visit(fact_pool[i]);
+    };
+
+    // 1. 変更したルールの辺 x -> d ごとに、成分の形が変わるかを調べる (索引は変更後のルールのもの)
+    //    追加した辺: d から x に戻れれば新しい循環ができるため、x を起点に成分をまとめ直す
+    //    取り除いた辺: 同じ成分で x から成分内を通って d にもう届かなければ、成分が分かれうるため丸ごと作り直す
+    //    どちらでもない辺は成分を変えないため、6. で索引だけを書き換える
+    std::vector<FactId> seeds;
+    std::vector<uint32_t> split;
+    for (size_t rule_index : changed_rules) {
+        const Rule& rule = rules[rule_index];
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            const FactId x = fact_pool[i];
+            const uint32_t component = fact_component[x];
+            bool restructured = false;
+            forEachEdge(rule, [&](FactId d) {
+                if (restructured || d == x) return;
+                if (!rule.removed) {
+                    restructured = fact_component[d] != component && reaches(d, x, NO_INDEX);
+                    if (restructured) seeds.push_back(x);
+                } else if (fact_component[d] == component && !reaches(x, d, component)) {
+                    restructured = true;
+                    split.push_back(component);
+                }
+            });
+        }
+    }
+
+    // 2. 作り直す事実: 新しい循環は起点を通るため、起点から依存先をたどって起点に戻れる事実 (= 起点の下流) だけが
+    //    起点と同じ成分に入りうる。それらの元の成分と、分かれうる成分を丸ごと作り直す
+    std::vector<FactId> region;
+    std::vector<FactId> stack;
+    if (!seeds.empty()) {
+        merge_cone_bits.resize(fact_count);
+        merge_cone_bits.clear();
+        collectCone(seeds, merge_cone_bits, merge_cone, nullptr);
+    }
+    for (FactId id : seeds) {
+        if (update_index[id] != NO_INDEX) continue;
+        update_index[id] = 0;
+        stack.push_back(id);
+        while (!stack.empty()) {
+            const FactId f = stack.back();
+            stack.pop_back();
+            region.push_back(f);
+            forEachDependency(f, [&](FactId d) {
+                if (update_index[d] != NO_INDEX || !merge_cone_bits.test(d)) return;
+                update_index[d] = 0;
+                stack.push_back(d);
+            });
+        }
+    }
+    std::vector<uint32_t> retired;
+    auto retire = [&](uint32_t component) {
+        if (retired_bits.test(component)) return;
+        retired_bits.set(component);
+        retired.push_back(component);
+        for (uint32_t m = component_begin[component]; m < component_begin[component + 1]; ++m) {
+            const FactId f = component_facts[m];
+            if (update_index[f] != NO_INDEX) continue;
+            update_index[f] = 0;
+            region.push_back(f);
+        }
+    };
+    for (size_t i = 0; i < region.size(); ++i) retire(fact_component[region[i]]);
+    for (uint32_t component : split) retire(component);
+    for (size_t i = 0; i < region.size(); ++i) update_index[region[i]] = static_cast<uint32_t>(i);
+
+    // 3. 作り直す事実の間の辺だけで強連結成分を求める (buildComponents と同じ Tarjan のアルゴリズム)
+    //    範囲の外の事実は範囲の事実に戻れないため、外への辺は成分の依存先になるだけ
+    const uint32_t n = static_cast<uint32_t>(region.size());
+    std::vector<uint32_t> edge_begin(n + 1, 0);
+    std::vector<uint32_t> edges;
+    for (uint32_t i = 0; i < n; ++i) {
+        edge_begin[i] = static_cast<uint32_t>(edges.size());
+        forEachDependency(region[i], [&](FactId d) {
+            if (update_index[d] != NO_INDEX) edges.push_back(update_index[d]);
+        });
+    }
+    edge_begin[n] = static_cast<uint32_t>(edges.size());
+
+    constexpr uint32_t UNVISITED = UINT32_MAX;
+    std::vector<uint32_t> order(n, UNVISITED);
+    std::vector<uint32_t> low(n, 0);
+    std::vector<bool> on_stack(n, false);
+    std::vector<uint32_t> tarjan_stack;
+    std::vector<std::pair<uint32_t, uint32_t>> frames;
+    std::vector<uint32_t> members; // 新しい成分の事実 (範囲内の位置) を依存先の成分から順に並べたもの
+    std::vector<uint32_t> group_begin;
+    std::vector<bool> cyclic;
+    uint32_t next_order = 0;
+    for (uint32_t root = 0; root < n; ++root) {
+        if (order[root] != UNVISITED) continue;
+        frames.emplace_back(root, edge_begin[root]);
+        order[root] = low[root] = next_order++;
+        tarjan_stack.push_back(root);
+        on_stack[root] = true;
+        while (!frames.empty()) {
+            const uint32_t v = frames.back().first;
+            if (frames.back().second < edge_begin[v + 1]) {
+                const uint32_t w = edges[frames.back().second++];
+                if (order[w] == UNVISITED) {
+                    order[w] = low[w] = next_order++;
+                    tarjan_stack.push_back(w);
+                    on_stack[w] = true;
+                    frames.emplace_back(w, edge_begin[w]);
+                } else if (on_stack[w]) {
+                    low[v] = std::min(low[v], order[w]);
+                }
+                continue;
+            }
+            frames.pop_back();
+            if (!frames.empty()) low[frames.back().first] = std::min(low[frames.back().first], low[v]);
+            if (low[v] != order[v]) continue;
+
+            group_begin.push_back(static_cast<uint32_t>(members.size()));
+            uint32_t member;
+            do {
+                member = tarjan_stack.back();
+                tarjan_stack.pop_back();
+                on_stack[member] = false;
+                members.push_back(member);
+            } while (member != v);
+            bool is_cyclic = members.size() - group_begin.back() > 1;
+            for (uint32_t e = edge_begin[v]; e < edge_begin[v + 1] && !is_cyclic; ++e) is_cyclic = edges[e] == v;
+            cyclic.push_back(is_cyclic);
+        }
+    }
+    group_begin.push_back(static_cast<uint32_t>(members.size()));
+
+    // 4. 新しい成分を末尾に追加する (独立部分は元の成分のものを引き継ぐ)
+    const uint32_t first_component = static_cast<uint32_t>(componentCount());
+    const uint32_t group_count = static_cast<uint32_t>(cyclic.size());
+    std::vector<uint32_t> group_part(group_count);
+    for (uint32_t g = 0; g < group_count; ++g) {
+        group_part[g] = partOf(fact_component[region[members[group_begin[g]]]]);
+        for (uint32_t i = group_begin[g]; i < group_begin[g + 1]; ++i) fact_component[region[members[i]]] = first_component + g;
+    }
+    for (uint32_t component : retired) {
+        stale_entries += (component_begin[component + 1] - component_begin[component]) +
+                         (dependency_end[component] - dependency_begin[component]) +
+                         (elimination_end[component] - elimination_begin[component]);
+    }
+    cyclic_components.resize(first_component + group_count);
+    std::vector<uint32_t> dependencies;
+    std::vector<uint32_t> eliminations;
+    for (uint32_t g = 0; g < group_count; ++g) {
+        const uint32_t component = first_component + g;
+        dependencies.clear();
+        eliminations.clear();
+        for (uint32_t i = group_begin[g]; i < group_begin[g + 1]; ++i) {
+            const FactId f = region[members[i]];
+            component_facts.push_back(f);
+            forEachDependency(f, [&](FactId d) {
+                if (fact_component[d] != component) dependencies.push_back(fact_component[d]);
+            });
+            if (f >= rules_by_conclusion.size()) continue;
+            // OR/XOR ルールは結論部の先頭の事実の成分に登録する
+            for (size_t rule_index : rules_by_conclusion[f]) {
+                const Rule& rule = rules[rule_index];
+                if (rule.disjunctive_conclusion && fact_pool[rule.conclusion_facts_begin] == f) {
+                    eliminations.push_back(static_cast<uint32_t>(rule_index));
+                }
+            }
+        }
+        component_begin.push_back(static_cast<uint32_t>(component_facts.size()));
+        if (cyclic[g]) cyclic_components.set(component);
+
+        std::sort(dependencies.begin(), dependencies.end());
+        dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+        dependency_begin.push_back(static_cast<uint32_t>(component_dependencies.size()));
+        component_dependencies.insert(component_dependencies.end(), dependencies.begin(), dependencies.end());
+        dependency_end.push_back(static_cast<uint32_t>(component_dependencies.size()));
+
+        std::sort(eliminations.begin(), eliminations.end());
+        elimination_begin.push_back(static_cast<uint32_t>(component_eliminations.size()));
+        component_eliminations.insert(component_eliminations.end(), eliminations.begin(), eliminations.end());
+        elimination_end.push_back(static_cast<uint32_t>(component_eliminations.size()));
+        component_part.push_back(group_part[g]);
+    }
+
+    // 5. 作り直した事実の差分評価の索引 (buildComponents と同じく、同じ成分内の参照だけを登録する)
+    std::vector<std::pair<FactId, uint32_t>> dependents;
+    std::vector<std::pair<FactId, uint32_t>> watches;
+    std::vector<std::pair<FactId, uint32_t>> disjuncts;
+    for (uint32_t m = component_begin[first_component]; m < component_facts.size(); ++m) {
+        const FactId f = component_facts[m];
+        auto watchPremise = [&](const Rule& rule) {
+            for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+                if (fact_component[fact_pool[i]] == fact_component[f]) dependents.emplace_back(fact_pool[i], m);
+            }
+        };
+        for (uint32_t i = negation_begin[f]; i < negation_end[f]; ++i) watchPremise(rules[negated_rules[i]]);
+        if (f >= rules_by_conclusion.size()) continue;
+        for (size_t rule_index : rules_by_conclusion[f]) watchPremise(rules[rule_index]);
+    }
+    for (uint32_t c = first_component; c < first_component + group_count; ++c) {
+        for (uint32_t e = elimination_begin[c]; e < elimination_end[c]; ++e) {
+            const Rule& rule = rules[component_eliminations[e]];
+            for (uint32_t i = rule.premise_facts_begin; i < rule.premise_facts_end; ++i) {
+                if (fact_component[fact_pool[i]] == c) watches.emplace_back(fact_pool[i], e);
+            }
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                if (fact_component[fact_pool[i]] == c) disjuncts.emplace_back(fact_pool[i], e);
+            }
+        }
+    }
+    auto assignRanges = [&](std::vector<std::pair<FactId, uint32_t>>& pairs, bool unique, FlatArray<uint32_t>& begin,
+                            FlatArray<uint32_t>& end, FlatArray<uint32_t>& values) {
+        std::sort(pairs.begin(), pairs.end());
+        if (unique) pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+        for (FactId f : region) {
+            stale_entries += end[f] - begin[f];
+            begin[f] = end[f] = 0;
+        }
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            const FactId f = pairs[i].first;
+            if (i == 0 || pairs[i - 1].first != f) begin[f] = static_cast<uint32_t>(values.size());
+            values.push_back(pairs[i].second);
+            end[f] = static_cast<uint32_t>(values.size());
+        }
+    };
+    assignRanges(dependents, true, dependent_begin, dependent_end, fact_dependents);
+    assignRanges(watches, true, premise_watch_begin, premise_watch_end, premise_watches);
+    assignRanges(disjuncts, false, disjunct_begin, disjunct_end, disjunct_watches);
+
+    // 6. 範囲の外で作り直した事実に依存する成分の依存先: 元の成分の番号を除き、新しい成分の番号を加える
+    //    (取り除いたルールだけが作り直した事実につないでいた成分も、元の成分の番号を除くために加える)
+    std::vector<std::pair<uint32_t, uint32_t>> outside; // (範囲の外の成分, 依存する新しい成分)
+    //    (OR/XOR 結論の選言肢は別々の成分にありうるため、結論部の事実ごとに調べる)
+    for (FactId f : region) {
+        if (f >= rules_by_premise.size()) continue;
+        for (size_t rule_index : rules_by_premise[f]) {
+            const Rule& rule = rules[rule_index];
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                const FactId conclusion = fact_pool[i];
+                if (update_index[conclusion] == NO_INDEX) outside.emplace_back(fact_component[conclusion], fact_component[f]);
+            }
+        }
+    }
+    for (size_t rule_index : changed_rules) {
+        const Rule& rule = rules[rule_index];
+        if (region.empty() || !rule.removed) continue;
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            const FactId conclusion = fact_pool[i];
+            if (update_index[conclusion] == NO_INDEX) outside.emplace_back(fact_component[conclusion], NO_INDEX);
+        }
+    }
+    std::sort(outside.begin(), outside.end());
+    outside.erase(std::unique(outside.begin(), outside.end()), outside.end());
+    for (size_t i = 0; i < outside.size();) {
+        const uint32_t component = outside[i].first;
+        dependencies.clear();
+        for (uint32_t d = dependency_begin[component]; d < dependency_end[component]; ++d) {
+            if (!retired_bits.test(component_dependencies[d])) dependencies.push_back(component_dependencies[d]);
+        }
+        for (; i < outside.size() && outside[i].first == component; ++i) {
+            if (outside[i].second != NO_INDEX) dependencies.push_back(outside[i].second);
+        }
+        std::sort(dependencies.begin(), dependencies.end());
+        dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+        replaceRange(dependency_begin, dependency_end, component_dependencies, component, dependencies);
+    }
+
+    // 7. 形の変わらない成分では、変更したルールの辺の分だけ索引を書き換える
+    //    (OR/XOR 結論の選言肢は別々の成分にありうるため、結論部の事実の成分ごとに行う)
+    std::vector<uint32_t> list;
+    std::vector<uint32_t> conclusion_components;
+    for (size_t rule_index : changed_rules) {
+        const Rule& rule = rules[rule_index];
+        if (rule.conclusion_facts_begin == rule.conclusion_facts_end) continue;
+        conclusion_components.clear();
+        for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+            const uint32_t component = fact_component[fact_pool[i]];
+            if (component < first_component) conclusion_components.push_back(component); // 作り直した成分の索引は求め直してある
+        }
+        std::sort(conclusion_components.begin(), conclusion_components.end());
+        conclusion_components.erase(std::unique(conclusion_components.begin(), conclusion_components.end()),
+                                    conclusion_components.end());
+
+        for (uint32_t component : conclusion_components) {
+            // 依存先の成分: 追加した辺の成分を加え、取り除いた辺の成分は他の辺が残っていなければ除く
+            list.assign(component_dependencies.begin() + dependency_begin[component],
+                        component_dependencies.begin() + dependency_end[component]);
+            bool changed = false;
+            forEachEdge(rule, [&](FactId d) {
+                const uint32_t other = fact_component[d];
+                if (other == component) return;
+                auto it = std::lower_bound(list.begin(), list.end(), other);
+                const bool listed = it != list.end() && *it == other;
+                if (!rule.removed && !listed) {
+                    list.insert(it, other);
+                    changed = true;
+                } else if (rule.removed && listed && !dependsOn(component, other)) {
+                    list.erase(it);
+                    changed = true;
+                }
+            });
+            if (changed) replaceRange(dependency_begin, dependency_end, component_dependencies, component, list);
+
+            // 差分評価の索引: 同じ成分の前提部の事実から結論部の事実の位置をたどれるようにする
+            // (取り除いたルールでは、同じ事実を結論とする他のルールが同じ事実を前提部で読んでいなければ外す)
+            const uint32_t fact_begin = component_begin[component];
+            const uint32_t fact_end = component_begin[component + 1];
+            for (uint32_t i = rule.conclusion_facts_begin; i < rule.conclusion_facts_end; ++i) {
+                const FactId x = fact_pool[i];
+                if (fact_component[x] != component) continue;
+                const uint32_t m = static_cast<uint32_t>(
+                    std::find(component_facts.begin() + fact_begin, component_facts.begin() + fact_end, x) - component_facts.begin());
+                auto readsPremise = [&](FactId p) {
+                    auto reads = [&](size_t other_rule) {
+                        const Rule& r = rules[other_rule];
+                        return std::binary_search(fact_pool.begin() + r.premise_facts_begin, fact_pool.begin() + r.premise_facts_end, p);
+                    };
+                    for (uint32_t j = negation_begin[x]; j < negation_end[x]; ++j) {
+                        if (reads(negated_rules[j])) return true;
+                    }
+                    if (x >= rules_by_conclusion.size()) return false;
+                    return std::any_of(rules_by_conclusion[x].begin(), rules_by_conclusion[x].end(), reads);
+                };
+                for (uint32_t j = rule.premise_facts_begin; j < rule.premise_facts_end; ++j) {
+                    const FactId p = fact_pool[j];
+                    if (fact_component[p] != component) continue;
+                    list.assign(fact_dependents.begin() + dependent_begin[p], fact_dependents.begin() + dependent_end[p]);
+                    auto it = std::lower_bound(list.begin(), list.end(), m);
+                    const bool listed = it != list.end() && *it == m;
+                    if (!rule.removed && !listed) {
+                        list.insert(it, m);
+                    } else if (rule.removed && listed && !readsPremise(p)) {
+                        list.erase(it);
+                    } else {
+                        continue;
+                    }
+                    replaceRange(dependent_begin, dependent_end, fact_dependents, p, list);
+                }
+            }
+
+            // 事実 1 つの成分は自己ループの有無で循環かどうかが決まる
+            if (fact_end - fact_begin == 1) {
+                const FactId x = component_facts[fact_begin];
+                bool self_loop = false;
+                forEachDependency(x, [&](FactId d) { self_loop |= d == x; });
+                cyclic_components.assign(component, self_loop);
+            }
+        }
+
+        // 消去法のルール (OR/XOR 結論は結論部の先頭の事実の成分に登録してある)
+        const uint32_t component = fact_component[fact_pool[rule.conclusion_facts_begin]];
+        if (!rule.disjunctive_conclusion || rule.negated_conclusion || component >= first_component) continue;
+        if (rule.removed) {
+            removeElimination(component, rule_index, list);
+        } else {
+            insertElimination(component, rule_index, list);
+        }
+    }
+
+    for (FactId f : region) update_index[f] = NO_INDEX;
+    for (uint32_t component : retired) retired_bits.reset(component);
+
+    // 参照されない要素が生きている要素より多くなったら全体を作り直す (変更 1 回あたりの手間は償却で一定)
+    const size_t total = component_facts.size() + component_dependencies.size() + component_eliminations.size() +
+                         negated_rules.size() + fact_dependents.size() + premise_watches.size() + disjunct_watches.size();
+    if (stale_entries * 2 > total) {
+        buildComponents(fact_count);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,136 @@
+#include "RuleFileWatcher.h"
+#include "KnowledgeBaseImage.h"
+#include "MappedFile.h"
+#include "RuleParser.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+RuleFileWatcher::RuleFileWatcher(const std::string& filename, const KnowledgeBase& kb) : filename(filename) {
+    MappedFile file(filename);
+    const std::string_view view = file.view();
+    if (view.size() >= sizeof(kb_image::MAGIC) && std::memcmp(view.data(), kb_image::MAGIC, sizeof(kb_image::MAGIC)) == 0) {
+        throw std::runtime_error("Error: Cannot watch a compiled image " + filename);
+    }
+
+    // 読み込み時のルールはファイルの行の順に並んでいるため、行ごとのルールの数から範囲が決まる
+    std::vector<std::string> texts;
+    readRuleLines(view, texts);
+    size_t rule_index = 0;
+    for (std::string& text : texts) {
+        const size_t count = RuleParser::ruleCount(text);
+        lines.push_back({std::move(text), rule_index, rule_index + count});
+        rule_index += count;
+    }
+    if (rule_index != kb.rules.size()) {
+        throw std::runtime_error("Error: " + filename + " has changed since it was loaded");
+    }
+
+    // エディタは一時ファイルを書いてから rename することが多いため、ファイルではなくディレクトリを監視する
+    const size_t slash = filename.rfind('/');
+    const std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : filename.substr(0, slash));
+    basename = slash == std::string::npos ? filename : filename.substr(slash + 1);
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        const std::string reason = std::strerror(errno);
+        if (inotify_fd >= 0) close(inotify_fd);
+        throw std::runtime_error("Error: Could not watch " + filename + ": " + reason);
+    }
+}
+
+RuleFileWatcher::~RuleFileWatcher() {
+    close(inotify_fd);
+}
+
+void RuleFileWatcher::readRuleLines(std::string_view buffer, std::vector<std::string>& out) {
+    // parseLines と同じ基準でルールの行を選ぶ
+    size_t line_start = 0;
+    while (line_start < buffer.size()) {
+        size_t line_end = buffer.find('\n', line_start);
+        if (line_end == std::string_view::npos) line_end = buffer.size();
+        std::string_view line = buffer.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+        if (!trimLine(line) || line.front() == '?' || line.front() == '=') continue;
+        if (line.find("=>") != std::string_view::npos) out.emplace_back(line);
+    }
+}
+
+bool RuleFileWatcher::poll(KnowledgeBase& kb, RuleUpdate& update) {
+    // 溜まったイベントを読み切り、監視しているファイルへの書き込みがあったかだけを見る
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    ssize_t n;
+    while ((n = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < n;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->len > 0 && basename == event->name) changed = true;
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+    if (!changed) return false;
+
+    std::vector<std::string> texts;
+    {
+        MappedFile file(filename);
+        readRuleLines(file.view(), texts);
+    }
+
+    // 先頭と末尾の共通部分を除き、残りは同じ内容の行どうしを対応させる (行の並べ替えはルールを変更しない)
+    size_t prefix = 0;
+    while (prefix < lines.size() && prefix < texts.size() && lines[prefix].text == texts[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < lines.size() - prefix && suffix < texts.size() - prefix &&
+           lines[lines.size() - 1 - suffix].text == texts[texts.size() - 1 - suffix]) {
+        suffix++;
+    }
+    std::unordered_map<std::string_view, std::vector<size_t>> unmatched; // 内容 -> 前回の行
+    for (size_t i = lines.size() - suffix; i-- > prefix;) unmatched[lines[i].text].push_back(i);
+
+    const size_t no_line = SIZE_MAX;
+    std::vector<size_t> old_line(texts.size(), no_line); // 新しい行 -> 同じ内容の前回の行
+    std::vector<std::string_view> added_lines;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        if (i < prefix) {
+            old_line[i] = i;
+        } else if (i >= texts.size() - suffix) {
+            old_line[i] = i - texts.size() + lines.size();
+        } else {
+            auto it = unmatched.find(texts[i]);
+            if (it != unmatched.end() && !it->second.empty()) {
+                old_line[i] = it->second.back();
+                it->second.pop_back();
+            } else {
+                added_lines.push_back(texts[i]);
+            }
+        }
+    }
+    // 対応のない前回の行のルールを取り除く (インタラクティブモードなどで取り除き済みのものは除く)
+    std::vector<size_t> removed;
+    for (const auto& entry : unmatched) {
+        for (size_t i : entry.second) {
+            for (size_t rule_index = lines[i].rule_begin; rule_index < lines[i].rule_end; ++rule_index) {
+                if (!kb.rules[rule_index].removed) removed.push_back(rule_index);
+            }
+        }
+    }
+    const bool edited = !added_lines.empty() || !removed.empty();
+    if (edited) kb.updateRules(removed, added_lines, update);
+
+    std::vector<RuleLine> next;
+    next.reserve(texts.size());
+    size_t added = 0;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        if (old_line[i] != no_line) {
+            next.push_back(std::move(lines[old_line[i]]));
+        } else {
+            next.push_back({std::move(texts[i]), update.rule_begin[added], update.rule_begin[added + 1]});
+            added++;
+        }
+    }
+    lines = std::move(next);
+    return edited;
+}
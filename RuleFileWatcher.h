@@ -0,0 +1,43 @@
+#ifndef RULEFILEWATCHER_H
+#define RULEFILEWATCHER_H
+
+#include "KnowledgeBase.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// --watch: 読み込んだルールファイルを inotify で監視し、書き換えられたら変わった行のルールだけを知識ベースに反映する
+// 前回のファイルのルール行 (=> / <=> の行) と各行から作られたルールの範囲を覚えておき、新しい内容と行単位で比べる
+// 初期事実 ('=') とクエリ ('?') の行の変更は反映しない (インタラクティブモードのコマンドやサーバーの要求で指定する)
+class RuleFileWatcher {
+    public:
+        // kb は filename のテキストを読み込んだ直後であること (バイナリイメージは監視できない)
+        RuleFileWatcher(const std::string& filename, const KnowledgeBase& kb);
+        ~RuleFileWatcher();
+
+        RuleFileWatcher(const RuleFileWatcher&) = delete;
+        RuleFileWatcher& operator=(const RuleFileWatcher&) = delete;
+
+        // poll / select で待つためのファイル記述子 (ファイルが書き換えられると読み込み可能になる)
+        int fd() const { return inotify_fd; }
+
+        // ファイルが書き換えられていれば差分を kb に反映して true を返す (変更がなければ何もせず false)
+        // 新しい内容に構文エラーがあれば例外を投げ、知識ベースと前回の内容はそのまま残す
+        bool poll(KnowledgeBase& kb, RuleUpdate& update);
+
+    private:
+        struct RuleLine {
+            std::string text; // コメントと前後の空白を除いた行
+            size_t rule_begin; // この行から作られたルールの範囲 (kb.rules への添字)
+            size_t rule_end;
+        };
+
+        std::string filename;
+        std::string basename; // 監視するディレクトリの中でのファイル名
+        int inotify_fd = -1;
+        std::vector<RuleLine> lines;
+
+        static void readRuleLines(std::string_view buffer, std::vector<std::string>& out);
+};
+
+#endif
@@ -0,0 +1,291 @@
+#include "RuleParser.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+void RuleParser::skipWhitespace() {
+    while (current_pos < input_str.length() &&
+           (input_str[current_pos] == ' ' || input_str[current_pos] == '\t')) {
+        current_pos++;
+    }
+}
+
+char RuleParser::peek() const {
+    return (current_pos < input_str.length()) ? input_str[current_pos] : '\0';
+}
+
+void RuleParser::consume() {
+    if (current_pos < input_str.length()) current_pos++;
+}
+
+void RuleParser::syntaxError(const std::string& message) {
+    throw std::runtime_error("Syntax Error at position " + std::to_string(current_pos) + " ('" + std::string(input_str) + "'): " + message);
+}
+
+
+// --- 論理式パーサー (再帰下降) ---
+
+ExprId RuleParser::parse_Factor() {
+    skipWhitespace();
+    char current_char = peek();
+
+    if (current_char == '(') {
+        consume(); // '(' を消費
+        ExprId expr = parse_XOR();
+        skipWhitespace();
+        if (peek() != ')') {
+            syntaxError("Expected ')'");
+        }
+        consume(); // ')' を消費
+        return expr;
+    }
+    else if (isIdentifierStart(current_char)) {
+        // 事実の識別子を消費 (例: A, sensor_42_overheat)
+        size_t start = current_pos;
+        while (isIdentifierChar(peek())) consume();
+        std::string_view name = input_str.substr(start, current_pos - start);
+        FactId id = symbols.intern(name);
+        return expressions.fact(id, false);
+    }
+    else {
+        syntaxError("Expected a fact identifier or '('");
+    }
+}
+
+ExprId RuleParser::parse_NOT() {
+    skipWhitespace();
+
+    if (peek() == '!') {
+        consume(); // '!' を消費
+        // NOT の右側が事実の場合、否定を反転した事実の節点に置き換える
+        ExprId operand = parse_Factor();
+        if (expressions.isFact(operand)) {
+            const ExprNode& fact = expressions[operand];
+            return expressions.fact(fact.left, fact.op == ExprNode::OpCode::LOAD); // NOTのネストを考慮 (!!A -> A)
+        }
+        // TODO: !(A+B) のような複雑な否定は、UnaryOperatorノードが必要だが、ここでは簡単化
+        // 課題の例 "not B" (!B) のみをサポート
+        syntaxError("Complex negation like !(A+B) is not fully supported.");
+    }
+
+    return parse_Factor();
+}
+
+ExprId RuleParser::parse_AND() {
+    ExprId left = parse_NOT();
+
+    while (true) {
+        skipWhitespace();
+        if (peek() == '+') {
+            consume();
+            ExprId right = parse_NOT();
+            left = expressions.binary(ExprNode::OpCode::AND, left, right);
+        } else {
+            break;
+        }
+    }
+    return left;
+}
+
+ExprId RuleParser::parse_OR() {
+    ExprId left = parse_AND();
+
+    while (true) {
+        skipWhitespace();
+        if (peek() == '|') {
+            consume();
+            ExprId right = parse_AND();
+            left = expressions.binary(ExprNode::OpCode::OR, left, right);
+        } else {
+            break;
+        }
+    }
+    return left;
+}
+
+ExprId RuleParser::parse_XOR() {
+    ExprId left = parse_OR();
+
+    while (true) {
+        skipWhitespace();
+        if (peek() == '^') {
+            consume();
+            ExprId right = parse_OR();
+            left = expressions.binary(ExprNode::OpCode::XOR, left, right);
+        } else {
+            break;
+        }
+    }
+    return left;
+}
+
+ExprId RuleParser::parseExpression(std::string_view str) {
+    this->input_str = str;
+    this->current_pos = 0;
+
+    ExprId root = parse_XOR();
+
+    skipWhitespace();
+    if (peek() != '\0') {
+        syntaxError("Unexpected token at end of expression");
+    }
+
+    return root;
+}
+
+
+// --- ルールと行の解析 ---
+
+// 結論の AND 分解 (例: B+C)。'+' を含まなければ分解しない (false を返す)
+// 従来どおり空白を取り除いてから '+' で分割する (分解する場合のみ compact にコピーを作り、segments はそれを参照する)
+static bool splitConclusion(std::string_view consequent_str, std::string& compact, std::vector<std::string_view>& segments) {
+    if (consequent_str.find('+') == std::string_view::npos) return false;
+
+    compact.reserve(consequent_str.size());
+    for (char c : consequent_str) {
+        if (c != ' ') compact.push_back(c);
+    }
+
+    std::string_view rest = compact;
+    while (!rest.empty()) {
+        size_t end = rest.find('+');
+        std::string_view segment = rest.substr(0, end);
+        if (!segment.empty()) segments.push_back(segment);
+        if (end == std::string_view::npos) break;
+        rest.remove_prefix(end + 1);
+    }
+    return true;
+}
+
+void RuleParser::addImpliesRule(std::string_view antecedent_str, std::string_view consequent_str, std::vector<ParsedRule>& out) {
+    // 前提部は一度だけ解析し、AND 分解で複数のルールになる場合も同じ節点を共有する
+    ExprId antecedent = parseExpression(antecedent_str);
+
+    std::string compact;
+    std::vector<std::string_view> segments;
+    if (!splitConclusion(consequent_str, compact, segments)) {
+        // 通常のルール、または OR/XOR 結論 (分解しない)
+        out.push_back(ParsedRule{antecedent, parseExpression(consequent_str)});
+        return;
+    }
+
+    // AND分解された各部分を個別のルールとして追加
+    for (std::string_view segment : segments) {
+        out.push_back(ParsedRule{antecedent, parseExpression(segment)});
+    }
+}
+
+void RuleParser::parseRule(std::string_view rule_str, std::vector<ParsedRule>& out) {
+    // 1. <=> の検出と分解 (ボーナス)
+    size_t biconditional_pos = rule_str.find("<=>");
+    if (biconditional_pos != std::string_view::npos) {
+        std::string_view left_side = rule_str.substr(0, biconditional_pos);
+        std::string_view right_side = rule_str.substr(biconditional_pos + 3);
+
+        addImpliesRule(left_side, right_side, out);
+        addImpliesRule(right_side, left_side, out);
+        return;
+    }
+
+    // 2. => の検出 (必須)
+    size_t implies_pos = rule_str.find("=>");
+    if (implies_pos != std::string_view::npos) {
+        addImpliesRule(rule_str.substr(0, implies_pos), rule_str.substr(implies_pos + 2), out);
+        return;
+    }
+
+    // エラー処理
+    input_str = rule_str;
+    current_pos = 0;
+    syntaxError("Invalid rule format: expected '=>' or '<=>'");
+}
+
+size_t RuleParser::ruleCount(std::string_view rule_str) {
+    // parseRule と同じ分解で数える
+    auto implies = [](std::string_view consequent_str) {
+        std::string compact;
+        std::vector<std::string_view> segments;
+        return splitConclusion(consequent_str, compact, segments) ? segments.size() : size_t(1);
+    };
+    size_t biconditional_pos = rule_str.find("<=>");
+    if (biconditional_pos != std::string_view::npos) {
+        return implies(rule_str.substr(biconditional_pos + 3)) + implies(rule_str.substr(0, biconditional_pos));
+    }
+    size_t implies_pos = rule_str.find("=>");
+    return implies_pos == std::string_view::npos ? 0 : implies(rule_str.substr(implies_pos + 2));
+}
+
+bool trimLine(std::string_view& line) {
+    size_t non_comment_start = line.find_first_not_of(" \t");
+    if (non_comment_start == std::string_view::npos || line[non_comment_start] == '#') {
+        return false;
+    }
+    line.remove_prefix(non_comment_start);
+
+    size_t inline_comment_pos = line.find('#');
+    if (inline_comment_pos != std::string_view::npos) {
+        line = line.substr(0, inline_comment_pos);
+    }
+    size_t last_char = line.find_last_not_of(" \t\n\r");
+    if (last_char == std::string_view::npos) return false; // 行が空になった場合
+    line = line.substr(0, last_char + 1);
+    return true;
+}
+
+void RuleParser::parseLines(std::string_view buffer, ParsedChunk& out) {
+    size_t line_start = 0;
+    try {
+        while (line_start < buffer.size()) {
+            size_t line_end = buffer.find('\n', line_start);
+            if (line_end == std::string_view::npos) line_end = buffer.size();
+            std::string_view line = buffer.substr(line_start, line_end - line_start);
+            line_start = line_end + 1;
+            if (!trimLine(line)) continue;
+
+            if (line.front() == '?' || line.front() == '=') {
+                out.fact_lines.push_back({line.front(), line.substr(1), out.rules.size()});
+            } else if (line.find("=>") != std::string_view::npos) { // "<=>" も含む
+                size_t first = out.rules.size();
+                parseRule(line, out.rules);
+                out.rule_symbol_counts.resize(out.rules.size(), 0);
+                std::fill(out.rule_symbol_counts.begin() + first, out.rule_symbol_counts.end(),
+                          static_cast<uint32_t>(symbols.size()));
+            }
+        }
+    } catch (const std::exception& e) {
+        // 途中までに解析したルールは残し、エラーは結合時にファイル順で報告する
+        out.rule_symbol_counts.resize(out.rules.size(), static_cast<uint32_t>(symbols.size()));
+        out.error = e.what();
+    }
+}
+
+void parseBuffer(std::string_view buffer, std::vector<ParsedChunk>& chunks, size_t workers) {
+    // 小さな入力はスレッドを起こさずに 1 チャンクで解析
+    const size_t min_chunk_size = 1 << 20;
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t count = std::max<size_t>(1, std::min(workers, buffer.size() / min_chunk_size));
+
+    // 行の途中で切らないよう、各境界を次の改行の直後まで進める
+    std::vector<size_t> bounds = {0};
+    for (size_t i = 1; i < count; ++i) {
+        size_t pos = std::max(bounds.back(), buffer.size() * i / count);
+        size_t newline = buffer.find('\n', pos);
+        bounds.push_back(newline == std::string_view::npos ? buffer.size() : newline + 1);
+    }
+    bounds.push_back(buffer.size());
+
+    chunks.clear();
+    chunks.resize(count);
+    auto work = [&](size_t i) {
+        RuleParser parser(chunks[i].symbols, chunks[i].expressions);
+        parser.parseLines(buffer.substr(bounds[i], bounds[i + 1] - bounds[i]), chunks[i]);
+    };
+
+    if (count == 1) {
+        work(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < count; ++i) threads.emplace_back(work, i);
+    for (std::thread& t : threads) t.join();
+}
@@ -0,0 +1,88 @@
+#ifndef RULEPARSER_H
+#define RULEPARSER_H
+
+#include "Expression.h"
+#include "SymbolTable.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 解析したルール 1 件 (KnowledgeBase::compileRule で Rule に変換する)
+struct ParsedRule {
+    ExprId antecedent; // 前提部 (ParsedChunk::expressions の節点)
+    ExprId consequent; // 結論部
+};
+
+// '=' / '?' 行 (直前までのルール数を記録し、ルールとの順序を保つ)
+struct FactListLine {
+    char kind; // '=' または '?'
+    std::string_view text; // 記号の後ろ (入力バッファを参照)
+    size_t rules_before;
+};
+
+// 入力の一部 (行境界で区切ったチャンク) の解析結果
+// 事実 ID はチャンク内の symbols に対するローカル ID、式はチャンク内の expressions の節点
+struct ParsedChunk {
+    SymbolTable symbols;
+    ExpressionArena expressions;
+    std::vector<ParsedRule> rules;
+    std::vector<uint32_t> rule_symbol_counts; // 各ルールの行を解析し終えた時点の symbols.size()
+    std::vector<FactListLine> fact_lines;
+    std::string error; // 最初の構文エラー (空ならエラーなし、以降の行は解析しない)
+};
+
+// 入力バッファを直接参照して解析する再帰下降パーサー (文字列のコピーを作らない)
+class RuleParser {
+    public:
+        RuleParser(SymbolTable& symbols, ExpressionArena& expressions) : symbols(symbols), expressions(expressions) {}
+
+        // 行単位の解析 (コメント・空行の除去、ルール / '=' / '?' の振り分け)
+        void parseLines(std::string_view buffer, ParsedChunk& out);
+
+        // ルール 1 行 (=> または <=>) を解析し、AND 分解・<=> 分解したルールを out に追加
+        void parseRule(std::string_view rule_str, std::vector<ParsedRule>& out);
+        // 構文が正しいルール 1 行が parseRule で何件のルールになるか (式は解析しない)
+        static size_t ruleCount(std::string_view rule_str);
+
+        // 論理式パーサー (expressions に節点を追加し、根を返す。同じ部分式は既存の節点を共有する)
+        ExprId parseExpression(std::string_view str);
+
+    private:
+        SymbolTable& symbols;
+        ExpressionArena& expressions;
+
+        // パーサーの状態
+        std::string_view input_str;
+        size_t current_pos = 0;
+
+        void skipWhitespace();
+        char peek() const;
+        void consume();
+        [[noreturn]] void syntaxError(const std::string& message);
+
+        void addImpliesRule(std::string_view antecedent_str, std::string_view consequent_str, std::vector<ParsedRule>& out);
+
+        ExprId parse_XOR();
+        ExprId parse_OR();
+        ExprId parse_AND();
+        ExprId parse_NOT();
+        ExprId parse_Factor();
+};
+
+// 識別子: 英字または '_' で始まり、英数字と '_' が続く
+inline bool isIdentifierStart(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+inline bool isIdentifierChar(char c) {
+    return isIdentifierStart(c) || (c >= '0' && c <= '9');
+}
+
+// 入力の 1 行からコメントと前後の空白を取り除く (空行・コメント行なら false)
+bool trimLine(std::string_view& line);
+
+// バッファ全体を解析する。大きな入力は行境界でチャンクに分けて複数スレッドで解析し、
+// chunks にはファイル中の順序で結果を並べる (workers はスレッド数の上限、0 ならハードウェアのスレッド数)
+void parseBuffer(std::string_view buffer, std::vector<ParsedChunk>& chunks, size_t workers = 0);
+
+#endif
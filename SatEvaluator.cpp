@@ -0,0 +1,131 @@
+#include "SatEvaluator.h"
+
+static constexpr Lit NO_LIT = UINT32_MAX;
+
+SatEvaluator::SatEvaluator(const RuleBase& rule_base, size_t fact_count)
+    : rule_base(rule_base), fact_count(fact_count) {
+    // 変数 0..fact_count-1 が x_f、fact_count..2*fact_count-1 が k_f、以降は Tseitin 変換の補助変数
+    for (size_t i = 0; i < 2 * fact_count; ++i) solver.newVar();
+    assumptions.resize(fact_count);
+    for (FactId f = 0; f < fact_count; ++f) {
+        assumptions[f] = makeLit(static_cast<uint32_t>(fact_count + f), true);
+        solver.addClause({makeLit(static_cast<uint32_t>(fact_count + f), true), makeLit(f)}); // k_f -> x_f
+    }
+    seen_true.resize(fact_count);
+    seen_false.resize(fact_count);
+
+    // ルールごとに P -> C。前提部のリテラルは完備化で再利用する
+    node_lits.assign(rule_base.expressions.size(), NO_LIT);
+    std::vector<Lit> premises(rule_base.rules.size());
+    for (size_t r = 0; r < rule_base.rules.size(); ++r) {
+        const Rule& rule = rule_base.rules[r];
+        if (rule.removed) continue; // 取り除いたルールは結論の索引にも現れない
+        premises[r] = encodeExpression(rule.premise);
+        const Lit conclusion = encodeExpression(rule.conclusion);
+        solver.addClause({negateLit(premises[r]), conclusion});
+    }
+
+    // 完備化: x_f -> k_f | (f を結論に持つルールの前提部)
+    std::vector<Lit> support;
+    for (FactId f = 0; f < fact_count; ++f) {
+        support.assign({makeLit(f, true), makeLit(static_cast<uint32_t>(fact_count + f))});
+        if (f < rule_base.rules_by_conclusion.size()) {
+            for (size_t r : rule_base.rules_by_conclusion[f]) support.push_back(premises[r]);
+        }
+        solver.addClause(support);
+    }
+}
+
+Lit SatEvaluator::nodeLit(ExprId id) const {
+    const ExprNode& node = rule_base.expressions[id];
+    if (node.op == ExprNode::OpCode::LOAD) return makeLit(node.left);
+    if (node.op == ExprNode::OpCode::LOAD_NOT) return makeLit(node.left, true);
+    return node_lits[id];
+}
+
+Lit SatEvaluator::encodeExpression(ExprId root) {
+    // 二項演算の節点ごとに補助変数を置く (符号化済みの節点はそのリテラルを使う)
+    rule_base.expressions.evaluate(root, expression_stack,
+                                   [&](ExprId id) { return node_lits[id] != NO_LIT; },
+                                   [&](ExprId id) {
+                                       const ExprNode& node = rule_base.expressions[id];
+                                       node_lits[id] = encodeGate(node.op, nodeLit(node.left), nodeLit(node.right));
+                                   });
+    return nodeLit(root);
+}
+
+Lit SatEvaluator::encodeGate(ExprNode::OpCode op, Lit left, Lit right) {
+    if (op != ExprNode::OpCode::XOR && left == right) return left;
+
+    const Lit t = makeLit(solver.newVar());
+    const Lit nt = negateLit(t);
+    const Lit nl = negateLit(left);
+    const Lit nr = negateLit(right);
+    if (op == ExprNode::OpCode::AND) {
+        solver.addClause({nt, left});
+        solver.addClause({nt, right});
+        solver.addClause({t, nl, nr});
+    } else if (op == ExprNode::OpCode::OR) {
+        solver.addClause({t, nl});
+        solver.addClause({t, nr});
+        solver.addClause({nt, left, right});
+    } else {
+        solver.addClause({nt, left, right});
+        solver.addClause({nt, nl, nr});
+        solver.addClause({t, nl, right});
+        solver.addClause({t, left, nr});
+    }
+    return t;
+}
+
+void SatEvaluator::setInitial(FactId id, bool value) {
+    if (id >= fact_count) return;
+    const Lit lit = makeLit(static_cast<uint32_t>(fact_count + id), !value);
+    if (assumptions[id] == lit) return;
+    assumptions[id] = lit;
+    models_valid = false;
+}
+
+bool SatEvaluator::solveWith(Lit extra, InferenceStats* stats) {
+    const uint64_t conflicts_before = solver.conflicts;
+    const uint64_t decisions_before = solver.decisions;
+    if (extra != NO_LIT) assumptions.push_back(extra);
+    const bool satisfiable = solver.solve(assumptions);
+    if (extra != NO_LIT) assumptions.pop_back();
+    if (satisfiable) recordModel();
+
+    if (stats != nullptr) {
+        stats->sat_solves++;
+        stats->sat_conflicts += solver.conflicts - conflicts_before;
+        stats->sat_decisions += solver.decisions - decisions_before;
+    }
+    return satisfiable;
+}
+
+void SatEvaluator::recordModel() {
+    // モデルで TRUE の事実は FALSE に、FALSE の事実は TRUE に決まらないことが分かる
+    for (FactId f = 0; f < fact_count; ++f) {
+        if (solver.modelValue(makeLit(f))) {
+            seen_true.set(f);
+        } else {
+            seen_false.set(f);
+        }
+    }
+}
+
+bool SatEvaluator::consistent(InferenceStats* stats) {
+    if (!models_valid) {
+        seen_true.clear();
+        seen_false.clear();
+        is_consistent = solveWith(NO_LIT, stats);
+        models_valid = true;
+    }
+    return is_consistent;
+}
+
+FactState SatEvaluator::decide(FactId id, InferenceStats* stats) {
+    if (!consistent(stats)) return FactState::UNDETERMINED;
+    if (!seen_true.test(id) && !solveWith(makeLit(id), stats)) return FactState::FALSE;
+    if (!seen_false.test(id) && !solveWith(makeLit(id, true), stats)) return FactState::TRUE;
+    return FactState::UNDETERMINED;
+}
@@ -0,0 +1,62 @@
+#ifndef SATEVALUATOR_H
+#define SATEVALUATOR_H
+
+#include "Fact.h"
+#include "InferenceStats.h"
+#include "RuleBase.h"
+#include "SatSolver.h"
+#include <vector>
+
+// ルール集合を CNF に符号化し、クエリが初期事実から論理的に TRUE / FALSE に決まるか、どちらでもないかを
+// 組み込みの CDCL ソルバで厳密に判定する評価器 (--sat)
+//
+// 符号化: 事実 f ごとに変数 x_f (f の真偽) と k_f (f が初期事実か) を置き、
+//   - ルール P => C ごとに P -> C (前提部・結論部は Tseitin 変換で補助変数に置き換える)
+//   - 初期事実は真: k_f -> x_f
+//   - 初期事実でない事実は、それを結論に持つルールの前提部のどれかが真のときだけ真: x_f -> k_f | P_1 | ... | P_n
+//     (Clark の完備化。導出されない事実は FALSE とみなす閉世界仮説に対応する)
+// 初期事実は k_f の仮定として与えるため CNF はシナリオによらず、学習節はシナリオやクエリをまたいで再利用される
+// q が TRUE に決まる <=> 仮定と ~x_q が充足不能、FALSE に決まる <=> 仮定と x_q が充足不能
+// 循環する事実どうしが互いだけを根拠にするモデルも許すため、外部からの根拠がない循環は UNDETERMINED になる
+class SatEvaluator {
+    public:
+        // fact_count は符号化する事実 ID の上限 (KnowledgeBase::facts.size())
+        SatEvaluator(const RuleBase& rule_base, size_t fact_count);
+
+        size_t factCount() const { return fact_count; }
+
+        // 初期事実を変更する (次の判定で仮定に反映する)
+        void setInitial(FactId id, bool value);
+
+        // id の状態を判定する。stats が null でなければソルバの計測値を加える
+        FactState decide(FactId id, InferenceStats* stats);
+
+        // ルールと現在の初期事実が矛盾しないか (矛盾する場合 decide は UNDETERMINED を返す)
+        bool consistent(InferenceStats* stats);
+
+    private:
+        const RuleBase& rule_base;
+        const size_t fact_count;
+        SatSolver solver;
+
+        // k_f の仮定 (事実 ID で引く)
+        std::vector<Lit> assumptions;
+
+        // 現在の仮定の下で見つかったモデルで TRUE / FALSE だった事実 (その値は強制されていない)
+        bool models_valid = false;
+        bool is_consistent = true;
+        Bitset seen_true;
+        Bitset seen_false;
+
+        // 式の節点ごとのリテラル (共有された部分式は 1 度だけ補助変数と節にする)
+        std::vector<Lit> node_lits;
+        std::vector<ExprId> expression_stack;
+
+        Lit encodeExpression(ExprId root);
+        Lit nodeLit(ExprId id) const;
+        Lit encodeGate(ExprNode::OpCode op, Lit left, Lit right);
+        bool solveWith(Lit extra, InferenceStats* stats); // 仮定に extra を加えて解き、モデルを記録する
+        void recordModel();
+};
+
+#endif
@@ -0,0 +1,413 @@
+#include "SatSolver.h"
+#include <algorithm>
+
+// 変数活性度の減衰とリスタート間隔の単位 (衝突回数)
+static constexpr double VAR_DECAY = 0.95;
+static constexpr uint64_t RESTART_UNIT = 100;
+// 学習節の上限の初期値 (削減のたびに 1.1 倍にする)
+static constexpr size_t MIN_MAX_LEARNTS = 20000;
+
+// Luby 列 (1, 1, 2, 1, 1, 2, 4, ...) の i 番目
+static uint64_t luby(uint64_t i) {
+    uint64_t size = 1;
+    uint32_t exponent = 0;
+    while (size < i + 1) {
+        exponent++;
+        size = 2 * size + 1;
+    }
+    while (size - 1 != i) {
+        size = (size - 1) >> 1;
+        exponent--;
+        i = i % size;
+    }
+    return uint64_t(1) << exponent;
+}
+
+uint32_t SatSolver::newVar() {
+    const uint32_t var = static_cast<uint32_t>(assigns.size());
+    assigns.push_back(VALUE_UNDEF);
+    levels.push_back(0);
+    reasons.push_back(NO_CLAUSE);
+    activity.push_back(0.0);
+    heap_index.push_back(-1);
+    polarity.push_back(1); // 事実は証明されない限り FALSE とみなすため、否定から試す
+    seen.push_back(0);
+    watches.emplace_back();
+    watches.emplace_back();
+    heapInsert(var);
+    return var;
+}
+
+bool SatSolver::addClause(std::vector<Lit> lits) {
+    if (!ok) return false;
+
+    // 重複を除き、恒真な節とレベル 0 で充足済みの節を捨て、レベル 0 で偽のリテラルを除く
+    std::sort(lits.begin(), lits.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < lits.size(); ++i) {
+        const Lit lit = lits[i];
+        if (value(lit) == VALUE_TRUE || (i > 0 && lit == negateLit(lits[i - 1]))) return true;
+        if (value(lit) == VALUE_FALSE || (kept > 0 && lits[kept - 1] == lit)) continue;
+        lits[kept++] = lit;
+    }
+    lits.resize(kept);
+
+    if (lits.empty()) return ok = false;
+    if (lits.size() == 1) {
+        enqueue(lits[0], NO_CLAUSE);
+        return ok = (propagate() == NO_CLAUSE);
+    }
+    const ClauseRef clause = allocClause(lits, false, 0);
+    clauses.push_back(clause);
+    attachClause(clause);
+    return true;
+}
+
+SatSolver::ClauseRef SatSolver::allocClause(const std::vector<Lit>& lits, bool learnt, uint32_t lbd) {
+    const ClauseRef clause = static_cast<ClauseRef>(arena.size());
+    arena.push_back(static_cast<uint32_t>(lits.size()));
+    arena.push_back((lbd << 1) | (learnt ? 1 : 0));
+    arena.insert(arena.end(), lits.begin(), lits.end());
+    return clause;
+}
+
+void SatSolver::attachClause(ClauseRef clause) {
+    const Lit* lits = &arena[clause + 2];
+    watches[lits[0]].push_back({clause, lits[1]});
+    watches[lits[1]].push_back({clause, lits[0]});
+}
+
+void SatSolver::enqueue(Lit lit, ClauseRef reason) {
+    const uint32_t var = litVar(lit);
+    assigns[var] = (lit & 1) ? VALUE_FALSE : VALUE_TRUE;
+    levels[var] = decisionLevel();
+    reasons[var] = reason;
+    trail.push_back(lit);
+}
+
+SatSolver::ClauseRef SatSolver::propagate() {
+    // 真になったリテラル p ごとに、否定 ~p を監視する節だけを調べる
+    ClauseRef conflict = NO_CLAUSE;
+    while (qhead < trail.size()) {
+        const Lit false_lit = negateLit(trail[qhead++]);
+        std::vector<Watcher>& ws = watches[false_lit];
+        propagations++;
+
+        size_t i = 0;
+        size_t j = 0;
+        while (i < ws.size()) {
+            const Watcher w = ws[i++];
+            if (value(w.blocker) == VALUE_TRUE) {
+                ws[j++] = w;
+                continue;
+            }
+
+            const uint32_t size = arena[w.clause];
+            Lit* lits = &arena[w.clause + 2];
+            if (lits[0] == false_lit) std::swap(lits[0], lits[1]);
+            const Lit first = lits[0];
+            if (first != w.blocker && value(first) == VALUE_TRUE) {
+                ws[j++] = {w.clause, first};
+                continue;
+            }
+
+            // 偽でない別のリテラルに監視を移す
+            bool moved = false;
+            for (uint32_t k = 2; k < size; ++k) {
+                if (value(lits[k]) == VALUE_FALSE) continue;
+                lits[1] = lits[k];
+                lits[k] = false_lit;
+                watches[lits[1]].push_back({w.clause, first});
+                moved = true;
+                break;
+            }
+            if (moved) continue;
+
+            // 単位節か矛盾
+            ws[j++] = {w.clause, first};
+            if (value(first) == VALUE_FALSE) {
+                conflict = w.clause;
+                qhead = trail.size();
+                while (i < ws.size()) ws[j++] = ws[i++];
+            } else {
+                enqueue(first, w.clause);
+            }
+        }
+        ws.resize(j);
+    }
+    return conflict;
+}
+
+void SatSolver::analyze(ClauseRef conflict, std::vector<Lit>& learnt, uint32_t& backtrack_level, uint32_t& lbd) {
+    // 1UIP: 現在の決定レベルのリテラルが 1 つになるまで理由節で矛盾節を解消する
+    learnt.clear();
+    learnt.push_back(0); // 1UIP の否定を後で入れる
+    int path_count = 0;
+    Lit p = 0;
+    bool first = true;
+    size_t index = trail.size();
+
+    do {
+        const uint32_t size = arena[conflict];
+        const Lit* lits = &arena[conflict + 2];
+        for (uint32_t k = first ? 0 : 1; k < size; ++k) {
+            const uint32_t var = litVar(lits[k]);
+            if (seen[var] || levels[var] == 0) continue;
+            seen[var] = 1;
+            bumpVar(var);
+            if (levels[var] >= decisionLevel()) {
+                path_count++;
+            } else {
+                learnt.push_back(lits[k]);
+            }
+        }
+        first = false;
+        while (!seen[litVar(trail[--index])]) {}
+        p = trail[index];
+        conflict = reasons[litVar(p)];
+        seen[litVar(p)] = 0;
+        path_count--;
+    } while (path_count > 0);
+    learnt[0] = negateLit(p);
+
+    // 理由節のリテラルがすべて学習節に含まれる (またはレベル 0) リテラルは冗長なので除く
+    analyze_clear.assign(learnt.begin(), learnt.end());
+    size_t kept = 1;
+    for (size_t i = 1; i < learnt.size(); ++i) {
+        const ClauseRef reason = reasons[litVar(learnt[i])];
+        bool redundant = reason != NO_CLAUSE;
+        if (redundant) {
+            const uint32_t size = arena[reason];
+            const Lit* lits = &arena[reason + 2];
+            for (uint32_t k = 1; k < size && redundant; ++k) {
+                const uint32_t var = litVar(lits[k]);
+                redundant = seen[var] || levels[var] == 0;
+            }
+        }
+        if (!redundant) learnt[kept++] = learnt[i];
+    }
+    learnt.resize(kept);
+    for (Lit lit : analyze_clear) seen[litVar(lit)] = 0;
+
+    // 巻き戻し先は 2 番目に大きい決定レベル (そのリテラルを監視位置の 2 番目に置く)
+    backtrack_level = 0;
+    if (learnt.size() > 1) {
+        size_t max_index = 1;
+        for (size_t i = 2; i < learnt.size(); ++i) {
+            if (levels[litVar(learnt[i])] > levels[litVar(learnt[max_index])]) max_index = i;
+        }
+        std::swap(learnt[1], learnt[max_index]);
+        backtrack_level = levels[litVar(learnt[1])];
+    }
+
+    // LBD: 学習節に現れる決定レベルの種類数 (小さいほど有用)
+    if (level_stamp.size() <= decisionLevel()) level_stamp.resize(decisionLevel() + 1, 0);
+    stamp++;
+    lbd = 0;
+    for (Lit lit : learnt) {
+        const uint32_t level = levels[litVar(lit)];
+        if (level_stamp[level] == stamp) continue;
+        level_stamp[level] = stamp;
+        lbd++;
+    }
+}
+
+void SatSolver::cancelUntil(uint32_t level) {
+    if (decisionLevel() <= level) return;
+    for (size_t i = trail.size(); i-- > trail_lim[level];) {
+        const uint32_t var = litVar(trail[i]);
+        assigns[var] = VALUE_UNDEF;
+        reasons[var] = NO_CLAUSE;
+        polarity[var] = trail[i] & 1;
+        if (heap_index[var] < 0) heapInsert(var);
+    }
+    trail.resize(trail_lim[level]);
+    qhead = trail.size();
+    trail_lim.resize(level);
+}
+
+bool SatSolver::solve(const std::vector<Lit>& assumptions) {
+    solves++;
+    if (!ok) return false;
+    if (max_learnts == 0) max_learnts = std::max(MIN_MAX_LEARNTS, clauses.size() / 3);
+
+    int status;
+    do {
+        status = search(luby(restarts++) * RESTART_UNIT, assumptions);
+    } while (status < 0);
+
+    if (status > 0) model.assign(assigns.begin(), assigns.end());
+    cancelUntil(0);
+    return status > 0;
+}
+
+// 1: 充足 (モデルは assigns)、0: 仮定の下で充足不能、-1: 衝突回数が上限に達した (リスタート)
+int SatSolver::search(uint64_t conflict_limit, const std::vector<Lit>& assumptions) {
+    std::vector<Lit> learnt;
+    uint64_t conflict_count = 0;
+
+    while (true) {
+        const ClauseRef conflict = propagate();
+        if (conflict != NO_CLAUSE) {
+            conflicts++;
+            conflict_count++;
+            if (decisionLevel() == 0) {
+                ok = false;
+                return 0;
+            }
+
+            uint32_t backtrack_level;
+            uint32_t lbd;
+            analyze(conflict, learnt, backtrack_level, lbd);
+            cancelUntil(backtrack_level);
+            if (learnt.size() == 1) {
+                enqueue(learnt[0], NO_CLAUSE);
+            } else {
+                const ClauseRef clause = allocClause(learnt, true, lbd);
+                learnts.push_back(clause);
+                attachClause(clause);
+                enqueue(learnt[0], clause);
+            }
+            var_inc /= VAR_DECAY;
+            continue;
+        }
+
+        if (conflict_count >= conflict_limit) {
+            cancelUntil(0);
+            return -1;
+        }
+        if (decisionLevel() == 0 && learnts.size() >= max_learnts) reduceLearnts();
+
+        // 仮定を 1 つずつ決定レベルとして積み、すべて積んだら活性度の高い変数を選ぶ
+        Lit next = 0;
+        bool has_next = false;
+        while (decisionLevel() < assumptions.size()) {
+            const Lit assumption = assumptions[decisionLevel()];
+            if (value(assumption) == VALUE_TRUE) {
+                trail_lim.push_back(static_cast<uint32_t>(trail.size())); // 既に真: 空の決定レベル
+            } else if (value(assumption) == VALUE_FALSE) {
+                return 0;
+            } else {
+                next = assumption;
+                has_next = true;
+                break;
+            }
+        }
+        if (!has_next) {
+            while (!heap.empty()) {
+                const uint32_t var = heapPop();
+                if (assigns[var] != VALUE_UNDEF) continue;
+                next = makeLit(var, polarity[var] != 0);
+                has_next = true;
+                decisions++;
+                break;
+            }
+            if (!has_next) return 1; // 全変数が矛盾なく割り当て済み
+        }
+
+        trail_lim.push_back(static_cast<uint32_t>(trail.size()));
+        enqueue(next, NO_CLAUSE);
+    }
+}
+
+void SatSolver::reduceLearnts() {
+    // レベル 0 でのみ呼ぶ: レベル 0 の割り当ては矛盾解析で読まないため理由節を外し、
+    // LBD の大きい学習節の半分と、レベル 0 で充足済みの節を捨てて arena を詰め直す
+    for (Lit lit : trail) reasons[litVar(lit)] = NO_CLAUSE;
+
+    std::vector<ClauseRef> candidates;
+    for (ClauseRef clause : learnts) {
+        if ((arena[clause + 1] >> 1) > 2) candidates.push_back(clause);
+    }
+    std::sort(candidates.begin(), candidates.end(), [&](ClauseRef a, ClauseRef b) {
+        return (arena[a + 1] >> 1) > (arena[b + 1] >> 1);
+    });
+    std::vector<ClauseRef> removed(candidates.begin(), candidates.begin() + candidates.size() / 2);
+    std::sort(removed.begin(), removed.end());
+
+    auto satisfied = [&](ClauseRef clause) {
+        const uint32_t size = arena[clause];
+        for (uint32_t k = 0; k < size; ++k) {
+            if (value(arena[clause + 2 + k]) == VALUE_TRUE) return true;
+        }
+        return false;
+    };
+
+    std::vector<uint32_t> compacted;
+    compacted.reserve(arena.size());
+    auto relocate = [&](std::vector<ClauseRef>& list, bool learnt) {
+        size_t kept = 0;
+        for (ClauseRef clause : list) {
+            if (learnt && std::binary_search(removed.begin(), removed.end(), clause)) continue;
+            if (satisfied(clause)) continue;
+            const uint32_t length = arena[clause] + 2;
+            list[kept++] = static_cast<ClauseRef>(compacted.size());
+            compacted.insert(compacted.end(), arena.begin() + clause, arena.begin() + clause + length);
+        }
+        list.resize(kept);
+    };
+    relocate(clauses, false);
+    relocate(learnts, true);
+    arena.swap(compacted);
+
+    for (std::vector<Watcher>& ws : watches) ws.clear();
+    for (ClauseRef clause : clauses) attachClause(clause);
+    for (ClauseRef clause : learnts) attachClause(clause);
+    max_learnts += max_learnts / 10;
+}
+
+// --- VSIDS (活性度の最大ヒープ) ---
+
+void SatSolver::bumpVar(uint32_t var) {
+    if ((activity[var] += var_inc) > 1e100) {
+        for (double& a : activity) a *= 1e-100;
+        var_inc *= 1e-100;
+    }
+    if (heap_index[var] >= 0) heapUp(static_cast<size_t>(heap_index[var]));
+}
+
+void SatSolver::heapInsert(uint32_t var) {
+    heap_index[var] = static_cast<int32_t>(heap.size());
+    heap.push_back(var);
+    heapUp(heap.size() - 1);
+}
+
+void SatSolver::heapUp(size_t pos) {
+    const uint32_t var = heap[pos];
+    while (pos > 0) {
+        const size_t parent = (pos - 1) / 2;
+        if (activity[heap[parent]] >= activity[var]) break;
+        heap[pos] = heap[parent];
+        heap_index[heap[pos]] = static_cast<int32_t>(pos);
+        pos = parent;
+    }
+    heap[pos] = var;
+    heap_index[var] = static_cast<int32_t>(pos);
+}
+
+void SatSolver::heapDown(size_t pos) {
+    const uint32_t var = heap[pos];
+    while (true) {
+        size_t child = 2 * pos + 1;
+        if (child >= heap.size()) break;
+        if (child + 1 < heap.size() && activity[heap[child + 1]] > activity[heap[child]]) child++;
+        if (activity[heap[child]] <= activity[var]) break;
+        heap[pos] = heap[child];
+        heap_index[heap[pos]] = static_cast<int32_t>(pos);
+        pos = child;
+    }
+    heap[pos] = var;
+    heap_index[var] = static_cast<int32_t>(pos);
+}
+
+uint32_t SatSolver::heapPop() {
+    const uint32_t top = heap[0];
+    heap_index[top] = -1;
+    heap[0] = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+        heap_index[heap[0]] = 0;
+        heapDown(0);
+    }
+    return top;
+}
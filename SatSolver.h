@@ -0,0 +1,101 @@
+#ifndef SATSOLVER_H
+#define SATSOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 変数 v のリテラル: 肯定は 2v、否定は 2v + 1
+using Lit = uint32_t;
+inline Lit makeLit(uint32_t var, bool negated = false) { return var * 2 + (negated ? 1 : 0); }
+inline Lit negateLit(Lit lit) { return lit ^ 1; }
+inline uint32_t litVar(Lit lit) { return lit >> 1; }
+
+// 外部ライブラリに依存しない CDCL (Conflict-Driven Clause Learning) SAT ソルバ
+// 2 リテラル監視による単位伝播、1UIP の節学習、VSIDS による変数選択、位相の保存、
+// Luby 列によるリスタートと LBD による学習節の削減を行う
+// 仮定 (assumptions) の下で何度でも解くことができ、学習節は CNF 自体から導かれるため次の呼び出しでもそのまま使う
+class SatSolver {
+    public:
+        uint32_t newVar();
+        size_t varCount() const { return assigns.size(); }
+
+        // 節を追加する (solve の外で呼ぶ)。CNF が充足不能と確定したら false
+        bool addClause(std::vector<Lit> lits);
+
+        // assumptions をすべて真とした下で充足可能か。true のときは modelValue でモデルを読める
+        bool solve(const std::vector<Lit>& assumptions);
+        bool modelValue(Lit lit) const { return model[litVar(lit)] != (lit & 1); }
+        bool okay() const { return ok; } // false なら仮定なしでも充足不能
+
+        // 計測値 (累計)
+        uint64_t solves = 0;
+        uint64_t conflicts = 0;
+        uint64_t decisions = 0;
+        uint64_t propagations = 0;
+
+    private:
+        // 節は arena に [長さ, (LBD << 1) | 学習節, リテラル...] の形で連続して置き、先頭の位置で参照する
+        // 先頭の 2 リテラルを監視し、単位伝播で決まったリテラルは常に先頭に置く
+        using ClauseRef = uint32_t;
+        static constexpr ClauseRef NO_CLAUSE = UINT32_MAX;
+        struct Watcher {
+            ClauseRef clause;
+            Lit blocker; // これが真なら節を読まずに済む
+        };
+
+        static constexpr uint8_t VALUE_FALSE = 0, VALUE_TRUE = 1, VALUE_UNDEF = 2;
+
+        std::vector<uint32_t> arena;
+        std::vector<ClauseRef> clauses; // 元の節
+        std::vector<ClauseRef> learnts; // 学習節
+        std::vector<std::vector<Watcher>> watches; // リテラル -> それを監視する節
+        bool ok = true;
+
+        // 割り当て (変数で引く) と割り当て順の記録
+        std::vector<uint8_t> assigns;
+        std::vector<uint32_t> levels;
+        std::vector<ClauseRef> reasons;
+        std::vector<Lit> trail;
+        std::vector<uint32_t> trail_lim; // 決定レベルごとの trail の開始位置
+        size_t qhead = 0;
+        std::vector<uint8_t> model;
+
+        // VSIDS: 活性度の二分ヒープ (未割り当ての変数を含む) と保存した位相
+        std::vector<double> activity;
+        double var_inc = 1.0;
+        std::vector<uint32_t> heap;
+        std::vector<int32_t> heap_index; // -1 はヒープ外
+        std::vector<uint8_t> polarity; // 1 なら否定を選ぶ
+
+        // 矛盾解析の作業領域
+        std::vector<uint8_t> seen;
+        std::vector<Lit> analyze_clear;
+        std::vector<uint64_t> level_stamp;
+        uint64_t stamp = 0;
+        size_t max_learnts = 0;
+        uint64_t restarts = 0;
+
+        uint32_t decisionLevel() const { return static_cast<uint32_t>(trail_lim.size()); }
+        uint8_t value(Lit lit) const {
+            uint8_t v = assigns[litVar(lit)];
+            return v == VALUE_UNDEF ? VALUE_UNDEF : static_cast<uint8_t>(v ^ (lit & 1));
+        }
+
+        ClauseRef allocClause(const std::vector<Lit>& lits, bool learnt, uint32_t lbd);
+        void attachClause(ClauseRef clause);
+        void enqueue(Lit lit, ClauseRef reason);
+        ClauseRef propagate();
+        void analyze(ClauseRef conflict, std::vector<Lit>& learnt, uint32_t& backtrack_level, uint32_t& lbd);
+        void cancelUntil(uint32_t level);
+        int search(uint64_t conflict_limit, const std::vector<Lit>& assumptions);
+        void reduceLearnts();
+
+        void bumpVar(uint32_t var);
+        void heapInsert(uint32_t var);
+        void heapUp(size_t pos);
+        void heapDown(size_t pos);
+        uint32_t heapPop();
+};
+
+#endif
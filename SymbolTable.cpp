@@ -0,0 +1,84 @@
+#include "SymbolTable.h"
+
+// FNV-1a
+uint32_t SymbolTable::hash(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+size_t SymbolTable::probe(std::string_view name, uint32_t h) const {
+    const size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while (slots[i] != NOT_FOUND) {
+        if (slot_hashes[i] == h && this->name(slots[i]) == name) break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+uint32_t SymbolTable::find(std::string_view name) const {
+    if (slots.empty()) return NOT_FOUND;
+    return slots[probe(name, hash(name))];
+}
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    own();
+    if ((size() + 1) * 2 > slots.size()) {
+        grow(slots.empty() ? 64 : slots.size() * 2);
+    }
+
+    const uint32_t h = hash(name);
+    const size_t i = probe(name, h);
+    if (slots[i] != NOT_FOUND) return slots[i];
+
+    const uint32_t id = static_cast<uint32_t>(size());
+    text.insert(text.end(), name.begin(), name.end());
+    offsets.push_back(static_cast<uint32_t>(text.size()));
+    slots[i] = id;
+    slot_hashes[i] = h;
+    return id;
+}
+
+void SymbolTable::reserve(size_t symbols) {
+    own();
+    offsets.reserve(symbols + 1);
+    size_t capacity = slots.empty() ? 64 : slots.size();
+    while (capacity < symbols * 2) capacity *= 2;
+    if (capacity > slots.size()) grow(capacity);
+}
+
+void SymbolTable::grow(size_t capacity) {
+    const FlatArray<uint32_t> old_slots = std::move(slots);
+    const FlatArray<uint32_t> old_hashes = std::move(slot_hashes);
+    slots.assign(capacity, NOT_FOUND);
+    slot_hashes.assign(capacity, 0);
+
+    // 保存済みのハッシュ値で再配置する (名前は読み直さない)
+    const size_t mask = capacity - 1;
+    for (size_t j = 0; j < old_slots.size(); ++j) {
+        if (old_slots[j] == NOT_FOUND) continue;
+        size_t i = old_hashes[j] & mask;
+        while (slots[i] != NOT_FOUND) i = (i + 1) & mask;
+        slots[i] = old_slots[j];
+        slot_hashes[i] = old_hashes[j];
+    }
+}
+
+void SymbolTable::own() {
+    text.own();
+    offsets.own();
+    slots.own();
+    slot_hashes.own();
+}
+
+void SymbolTable::mapRaw(std::string_view raw_text, const uint32_t* raw_offsets, size_t symbol_count,
+                         const uint32_t* raw_slots, const uint32_t* raw_slot_hashes, size_t slot_count) {
+    text.map(raw_text.data(), raw_text.size());
+    offsets.map(raw_offsets, symbol_count + 1);
+    slots.map(raw_slots, slot_count);
+    slot_hashes.map(raw_slot_hashes, slot_count);
+}
@@ -0,0 +1,51 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include "FlatArray.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 事実の識別子 (例: A, sensor_42_overheat) を密な 32 ビット ID に変換する表
+// 名前は 1 本の文字列領域に連結して保持し、検索はオープンアドレス法 (線形探索) のハッシュ表で行う
+class SymbolTable {
+    public:
+        static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+        // 名前を ID に変換 (未登録なら新しい ID を割り当てる)
+        uint32_t intern(std::string_view name);
+        // 登録済みなら ID、未登録なら NOT_FOUND
+        uint32_t find(std::string_view name) const;
+
+        std::string_view name(uint32_t id) const {
+            return std::string_view(text.data() + offsets[id], offsets[id + 1] - offsets[id]);
+        }
+        size_t size() const { return offsets.size() - 1; }
+
+        void reserve(size_t symbols);
+
+        // バイナリイメージとの相互変換用に内部配列をそのまま読み書きする (再ハッシュしない)
+        std::string_view rawText() const { return std::string_view(text.data(), text.size()); }
+        const FlatArray<uint32_t>& rawOffsets() const { return offsets; }
+        const FlatArray<uint32_t>& rawSlots() const { return slots; }
+        const FlatArray<uint32_t>& rawSlotHashes() const { return slot_hashes; }
+        // 読み込んだイメージの領域をそのまま指す (領域は呼び出し元が保持し続ける)
+        void mapRaw(std::string_view raw_text, const uint32_t* raw_offsets, size_t symbol_count,
+                    const uint32_t* raw_slots, const uint32_t* raw_slot_hashes, size_t slot_count);
+
+    private:
+        FlatArray<char> text; // 全ての名前を連結したもの
+        FlatArray<uint32_t> offsets = {0}; // ID -> text 上の開始位置 (末尾に番兵)
+
+        // ハッシュ表 (容量は 2 のべき乗、使用率は 1/2 以下)
+        FlatArray<uint32_t> slots; // ID (空きは NOT_FOUND)
+        FlatArray<uint32_t> slot_hashes; // 比較を省くためのハッシュ値
+
+        static uint32_t hash(std::string_view name);
+        size_t probe(std::string_view name, uint32_t h) const; // 名前のある位置、または空きスロット
+        void grow(size_t capacity);
+        void own();
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_cv.notify_all();
+    for (std::thread& t : workers) t.join();
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t, size_t)>& task) {
+    if (count == 0) return;
+
+    // タスク番号を連続した範囲に分けて各ワーカーに割り当てる
+    const size_t n = workers.size();
+    for (size_t w = 0; w < n; ++w) {
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        queues[w]->begin = count * w / n;
+        queues[w]->end = count * (w + 1) / n;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    current_task = &task;
+    finished_workers = 0;
+    error = nullptr;
+    generation++;
+    start_cv.notify_all();
+    done_cv.wait(lock, [&] { return finished_workers == workers.size(); });
+    current_task = nullptr;
+
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+bool ThreadPool::nextTask(size_t worker, size_t& index) {
+    Queue& own = *queues[worker];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end) {
+            index = own.begin++;
+            return true;
+        }
+    }
+
+    // 自分の範囲が空なら、残りの多いワーカーから後半を奪う
+    const size_t n = queues.size();
+    for (size_t offset = 1; offset < n; ++offset) {
+        Queue& victim = *queues[(worker + offset) % n];
+        size_t stolen_begin, stolen_end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin >= victim.end) continue;
+            stolen_end = victim.end;
+            stolen_begin = victim.begin + (victim.end - victim.begin) / 2;
+            victim.end = stolen_begin;
+        }
+
+        index = stolen_begin;
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = stolen_begin + 1;
+        own.end = stolen_end;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+    size_t seen_generation = 0;
+    while (true) {
+        const std::function<void(size_t, size_t)>* task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&] { return stopping || generation != seen_generation; });
+            if (stopping) return;
+            seen_generation = generation;
+            task = current_task;
+        }
+
+        // 範囲は自分で奪ったもの以外増えないため、取り出せなくなった時点で今回の全タスクは処理済みか処理中
+        size_t index;
+        while (nextTask(worker, index)) {
+            try {
+                (*task)(index, worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++finished_workers == workers.size()) done_cv.notify_all();
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ワークスティーリング方式のスレッドプール
+// run() はタスク番号の範囲を各ワーカーに均等に割り当て、自分の範囲を使い切ったワーカーは
+// 他のワーカーの残りの後半を奪って処理する (タスクの重さが偏っていても全コアを使い切る)
+class ThreadPool {
+    public:
+        // threads == 0 ならハードウェアのスレッド数
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        size_t size() const { return workers.size(); }
+
+        // task(index, worker) を index = 0 .. count - 1 について実行し、全て終わるまで待つ
+        // worker はワーカー番号 (0 .. size() - 1) で、ワーカーごとの作業領域の選択に使う
+        // タスクが例外を投げた場合は全タスクの終了後に最初の例外を投げ直す
+        void run(size_t count, const std::function<void(size_t, size_t)>& task);
+
+    private:
+        // ワーカーごとの未処理タスク範囲 [begin, end)
+        struct Queue {
+            std::mutex mutex;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue>> queues;
+
+        std::mutex mutex;
+        std::condition_variable start_cv; // 新しい run() の開始 (または終了) をワーカーに通知
+        std::condition_variable done_cv; // 全ワーカーの終了を run() に通知
+        const std::function<void(size_t, size_t)>* current_task = nullptr;
+        size_t generation = 0; // run() ごとに増やす
+        // 今回の run() を終えたワーカー数 (前回のタスクを持ったワーカーが次の run() に紛れ込まないよう全員を待つ)
+        size_t finished_workers = 0;
+        std::exception_ptr error;
+        bool stopping = false;
+
+        void workerLoop(size_t worker);
+        bool nextTask(size_t worker, size_t& index); // 自分の範囲から取り出し、なければ他から奪う
+};
+
+#endif
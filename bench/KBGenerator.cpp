@@ -0,0 +1,92 @@
+#include "KBGenerator.h"
+#include <algorithm>
+#include <random>
+
+namespace {
+
+// 標準ライブラリの分布は実装ごとに結果が異なるため、乱数列から直接値を作る
+class Random {
+    public:
+        explicit Random(uint64_t seed) : engine(seed) {}
+
+        size_t below(size_t n) { return n == 0 ? 0 : static_cast<size_t>(engine() % n); }
+        double unit() { return static_cast<double>(engine() >> 11) * (1.0 / 9007199254740992.0); }
+        bool chance(double p) { return unit() < p; }
+
+    private:
+        std::mt19937_64 engine;
+};
+
+std::string factName(size_t index) {
+    return "f" + std::to_string(index);
+}
+
+} // namespace
+
+GeneratedKB generateKB(const GeneratorConfig& config) {
+    Random rng(config.seed);
+    GeneratedKB kb;
+
+    // 事実を層に均等に分ける (layer_begin[l] .. layer_begin[l + 1])
+    const size_t depth = std::max<size_t>(2, config.depth);
+    const size_t fact_count = std::max(config.facts, depth);
+    std::vector<size_t> layer_begin(depth + 1);
+    for (size_t l = 0; l <= depth; ++l) layer_begin[l] = fact_count * l / depth;
+
+    auto pickFromLayers = [&](size_t first_layer, size_t last_layer) {
+        size_t begin = layer_begin[first_layer];
+        size_t end = layer_begin[last_layer + 1];
+        return begin + rng.below(end - begin);
+    };
+
+    std::string& text = kb.text;
+    text.reserve(config.rules * 32);
+    kb.antecedents.reserve(config.rules);
+
+    for (size_t r = 0; r < config.rules; ++r) {
+        const size_t layer = 1 + rng.below(depth - 1);
+
+        // 前提部: 直下の層を中心に fan_in 個の事実を + と | で結ぶ (循環を作る場合は同じ層以上から選ぶ)
+        std::string antecedent;
+        for (size_t i = 0; i < std::max<size_t>(1, config.fan_in); ++i) {
+            size_t fact;
+            if (rng.chance(config.cycle_density)) {
+                fact = pickFromLayers(layer, depth - 1);
+            } else if (i == 0 || rng.chance(0.5)) {
+                fact = pickFromLayers(layer - 1, layer - 1);
+            } else {
+                fact = pickFromLayers(0, layer - 1);
+            }
+            if (i > 0) antecedent += rng.chance(0.8) ? " + " : " | ";
+            if (rng.chance(config.negation_ratio)) antecedent += '!';
+            antecedent += factName(fact);
+        }
+
+        // 結論部: 単一の事実、または同じ層の 2 つの事実の OR/XOR
+        std::string consequent = factName(pickFromLayers(layer, layer));
+        if (rng.chance(config.disjunctive_ratio)) {
+            consequent += rng.chance(0.5) ? " | " : " ^ ";
+            consequent += factName(pickFromLayers(layer, layer));
+        }
+
+        text += antecedent;
+        text += " => ";
+        text += consequent;
+        text += '\n';
+        kb.antecedents.push_back(std::move(antecedent));
+    }
+
+    // 初期事実とクエリ
+    std::string initial_line = "=";
+    for (size_t f = layer_begin[0]; f < layer_begin[1]; ++f) {
+        kb.base_facts.push_back(factName(f));
+        if (rng.chance(config.initial_ratio)) initial_line += " " + factName(f);
+    }
+    std::string query_line = "?";
+    for (size_t q = 0; q < config.queries; ++q) {
+        kb.queries.push_back(factName(pickFromLayers(depth - 1, depth - 1)));
+        query_line += " " + kb.queries.back();
+    }
+    text += initial_line + "\n" + query_line + "\n";
+    return kb;
+}
@@ -0,0 +1,34 @@
+#ifndef KBGENERATOR_H
+#define KBGENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 合成知識ベースの生成パラメータ
+// 事実を depth 層に分け、各ルールは下の層の事実から上の層の事実を導く (層の数 = 推論の連鎖の深さ)
+struct GeneratorConfig {
+    uint64_t seed = 1;
+    size_t facts = 1000;
+    size_t rules = 2000;
+    size_t depth = 8; // 層の数 (2 以上)
+    size_t fan_in = 2; // 前提部の事実の数
+    double cycle_density = 0.0; // 前提部の事実を同じ層以上から選ぶ (循環を作る) 確率
+    double disjunctive_ratio = 0.1; // 結論部が OR/XOR になるルールの割合
+    double negation_ratio = 0.1; // 前提部の事実を否定する確率
+    double initial_ratio = 0.3; // 最下層の事実を初期事実にする確率
+    size_t queries = 16; // 最上層から選ぶクエリの数
+};
+
+struct GeneratedKB {
+    std::string text; // 入力ファイルの形式 (ルール、'=' 行、'?' 行)
+    std::vector<std::string> antecedents; // 各ルールの前提部 (parseExpression のベンチマーク用)
+    std::vector<std::string> base_facts; // 最下層の事実 (シナリオの初期事実の候補)
+    std::vector<std::string> queries;
+};
+
+// 同じ config からは常に同じ知識ベースを生成する (乱数は標準で出力列が規定された mt19937_64 のみを使う)
+GeneratedKB generateKB(const GeneratorConfig& config);
+
+#endif
@@ -0,0 +1,165 @@
+#include "KBGenerator.h"
+#include "KnowledgeBase.h"
+#include "RuleParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// ベンチマーク: 固定のシードで生成した合成知識ベースに対して各処理の所要時間を測り、分布を表示する
+// 生成される知識ベース・シナリオ・操作の順序は毎回同じなので、ビルド間の結果をそのまま比較できる
+//
+// 使い方: make bench  (または ./bench/expert_system_bench [--suite <名前>])
+
+namespace {
+
+struct Suite {
+    const char* name;
+    size_t scenarios; // シナリオ数 (インタラクティブ操作の回数も同じ)
+    GeneratorConfig config;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMicros(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// 最近傍順位法によるパーセンタイル (samples は整列済み)
+double percentile(const std::vector<double>& samples, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * samples.size() + 0.999999);
+    return samples[std::min(samples.size(), std::max<size_t>(1, rank)) - 1];
+}
+
+void report(const char* name, std::vector<double> samples) {
+    if (samples.empty()) return;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples) sum += s;
+    std::printf("  %-24s %8zu %10.2f %10.2f %10.2f %10.2f %10.2f\n", name, samples.size(),
+                sum / samples.size(), percentile(samples, 50), percentile(samples, 90),
+                percentile(samples, 99), samples.back());
+}
+
+// シナリオ用の初期事実 (最下層の事実から約 3 割を選ぶ)
+std::vector<std::vector<FactId>> makeScenarios(const KnowledgeBase& kb, const GeneratedKB& generated,
+                                               size_t count, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<std::vector<FactId>> scenarios(count);
+    for (std::vector<FactId>& initial : scenarios) {
+        for (const std::string& name : generated.base_facts) {
+            FactId id = kb.facts.find(name);
+            if (id != NO_FACT && rng() % 10 < 3) initial.push_back(id);
+        }
+    }
+    return scenarios;
+}
+
+void runSuite(const Suite& suite) {
+    const GeneratorConfig& c = suite.config;
+    const GeneratedKB generated = generateKB(c);
+    std::printf("suite: %s (facts=%zu rules=%zu depth=%zu fan_in=%zu cycles=%.2f disjunctive=%.2f negation=%.2f seed=%llu)\n",
+                suite.name, c.facts, c.rules, c.depth, c.fan_in, c.cycle_density, c.disjunctive_ratio,
+                c.negation_ratio, static_cast<unsigned long long>(c.seed));
+    std::printf("  %-24s %8s %10s %10s %10s %10s %10s  (us)\n", "benchmark", "samples", "mean", "p50", "p90", "p99", "max");
+
+    // 1. 読み込み (解析 + コンパイル + 索引)
+    std::vector<double> samples;
+    const size_t load_runs = std::max<size_t>(3, 200000 / std::max<size_t>(1, c.rules));
+    for (size_t i = 0; i < std::min<size_t>(load_runs, 20); ++i) {
+        KnowledgeBase kb;
+        auto start = Clock::now();
+        kb.loadFromBuffer(generated.text);
+        samples.push_back(elapsedMicros(start));
+    }
+    report("load", samples);
+
+    // 2. parseExpression (32 式ずつ測り、1 式あたりに換算)
+    samples.clear();
+    {
+        SymbolTable symbols;
+        ExpressionArena expressions;
+        RuleParser parser(symbols, expressions);
+        const size_t batch = 32;
+        for (size_t first = 0; first + batch <= generated.antecedents.size(); first += batch) {
+            auto start = Clock::now();
+            for (size_t i = first; i < first + batch; ++i) parser.parseExpression(generated.antecedents[i]);
+            samples.push_back(elapsedMicros(start) / batch);
+        }
+    }
+    report("parseExpression", samples);
+
+    KnowledgeBase kb;
+    kb.loadFromBuffer(generated.text);
+    const std::vector<std::vector<FactId>> scenarios = makeScenarios(kb, generated, suite.scenarios, c.seed + 1);
+
+    // 3. シナリオの評価 (クエリの影響範囲だけをリセットし、後向き連鎖で必要な成分だけを評価する)
+    //    4. クエリ 1 つあたり (評価済みの成分を読むだけのクエリも含む)
+    std::vector<double> scenario_samples;
+    std::vector<double> query_samples;
+    std::vector<FactState> results;
+    for (const std::vector<FactId>& initial : scenarios) {
+        auto start = Clock::now();
+        kb.evaluateScenario(initial, kb.queries, results);
+        const double elapsed = elapsedMicros(start);
+        scenario_samples.push_back(elapsed);
+        if (!kb.queries.empty()) query_samples.push_back(elapsed / kb.queries.size());
+    }
+    report("scenario", scenario_samples);
+    report("per query", query_samples);
+
+    // 5. インタラクティブモード相当の操作 (初期事実を 1 つ切り替えて全クエリを再評価)
+    samples.clear();
+    {
+        KnowledgeBase interactive;
+        interactive.loadFromBuffer(generated.text);
+        interactive.evaluateQueries(results);
+        std::mt19937_64 rng(c.seed + 2);
+        for (size_t i = 0; i < suite.scenarios && !generated.base_facts.empty(); ++i) {
+            FactId id = interactive.facts.find(generated.base_facts[rng() % generated.base_facts.size()]);
+            if (id == NO_FACT) continue;
+            auto start = Clock::now();
+            interactive.setInitialFact(id, !interactive.facts.isKnown(id));
+            interactive.evaluateQueries(results);
+            samples.push_back(elapsedMicros(start));
+        }
+    }
+    report("toggle+requery", samples);
+    std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string only;
+    if (argc == 3 && std::string(argv[1]) == "--suite") {
+        only = argv[2];
+    } else if (argc != 1) {
+        std::cerr << "Usage: " << argv[0] << " [--suite <name>]" << std::endl;
+        return 1;
+    }
+
+    // {name, scenarios, {seed, facts, rules, depth, fan_in, cycle_density, disjunctive_ratio, negation_ratio, initial_ratio, queries}}
+    const Suite suites[] = {
+        {"chain",       200, {1, 2000, 4000, 16, 2, 0.0, 0.05, 0.05, 0.3, 16}},
+        {"wide",        200, {2, 5000, 20000, 6, 4, 0.0, 0.10, 0.10, 0.3, 32}},
+        {"cyclic",      200, {3, 1000, 2000, 8, 2, 0.02, 0.05, 0.10, 0.3, 16}},
+        {"disjunctive", 200, {4, 2000, 4000, 8, 2, 0.0, 0.40, 0.10, 0.3, 16}},
+        {"large",       50, {5, 50000, 200000, 20, 2, 0.0, 0.05, 0.05, 0.3, 64}},
+    };
+
+    bool ran = false;
+    for (const Suite& suite : suites) {
+        if (!only.empty() && only != suite.name) continue;
+        runSuite(suite);
+        ran = true;
+    }
+    if (!ran) {
+        std::cerr << "Unknown suite: " << only << std::endl;
+        return 1;
+    }
+    return 0;
+}
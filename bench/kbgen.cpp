@@ -0,0 +1,50 @@
+#include "KBGenerator.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// 合成知識ベースを標準出力に書き出す
+// 例: ./bench/kbgen --facts 5000 --rules 20000 --depth 12 --fan-in 3 --cycles 0.05 --disjunctive 0.2 > kb.txt
+static void printUsage(std::ostream& out, const char* program) {
+    out << "Usage: " << program << " [--seed N] [--facts N] [--rules N] [--depth N] [--fan-in N]"
+        << " [--cycles P] [--disjunctive P] [--negation P] [--initial P] [--queries N]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage(std::cout, argv[0]);
+            return 0;
+        }
+        const bool known = arg == "--seed" || arg == "--facts" || arg == "--rules" || arg == "--depth" || arg == "--fan-in" ||
+                           arg == "--cycles" || arg == "--disjunctive" || arg == "--negation" || arg == "--initial" ||
+                           arg == "--queries";
+        if (!known) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(std::cerr, argv[0]);
+            return 1;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            printUsage(std::cerr, argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        if (arg == "--seed") config.seed = std::strtoull(value, nullptr, 10);
+        else if (arg == "--facts") config.facts = std::strtoull(value, nullptr, 10);
+        else if (arg == "--rules") config.rules = std::strtoull(value, nullptr, 10);
+        else if (arg == "--depth") config.depth = std::strtoull(value, nullptr, 10);
+        else if (arg == "--fan-in") config.fan_in = std::strtoull(value, nullptr, 10);
+        else if (arg == "--cycles") config.cycle_density = std::strtod(value, nullptr);
+        else if (arg == "--disjunctive") config.disjunctive_ratio = std::strtod(value, nullptr);
+        else if (arg == "--negation") config.negation_ratio = std::strtod(value, nullptr);
+        else if (arg == "--initial") config.initial_ratio = std::strtod(value, nullptr);
+        else config.queries = std::strtoull(value, nullptr, 10);
+    }
+
+    std::cout << generateKB(config).text;
+    return 0;
+}
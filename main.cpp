@@ -1,19 +1,138 @@
-#include "KnowledgeBase.h"
+#include "BatchRunner.h"
+#include "ExpertSystem.h"
+#include "QueryServer.h"
+#include "RuleFileWatcher.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 
+// コマンドライン版: 引数を解釈し、libexpert_system の API で読み込んだ知識ベースを各モードに渡す
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <input_file.txt>" << std::endl;
+    ExpertSystem expert_system;
+    KnowledgeBase& kb = expert_system.knowledgeBase();
+    std::string filename;
+    std::string image_filename; // --compile の出力先
+    std::string cpp_filename; // --emit-cpp の出力先
+    std::string batch_filename; // --batch の入力 ("-" は標準入力)
+    std::string socket_path; // --serve で待ち受ける Unix ドメインソケット
+    size_t threads = 0; // 解析と --batch / --serve の評価のスレッド数 (0 はハードウェアのスレッド数)
+    bool watch = false; // --watch: インタラクティブモード / --serve でルールファイルの変更を反映する
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--forward") {
+            kb.mode = InferenceMode::FORWARD;
+        } else if (arg == "--sat") {
+            kb.mode = InferenceMode::SAT;
+        } else if (arg == "--bdd") {
+            kb.mode = InferenceMode::BDD;
+        } else if (arg == "--bdd-order" && i + 1 < argc) {
+            std::string order = argv[++i];
+            if (order == "dfs") {
+                kb.bdd_order = BddOrder::DEPTH_FIRST;
+            } else if (order == "file") {
+                kb.bdd_order = BddOrder::DECLARATION;
+            } else if (order == "frequency") {
+                kb.bdd_order = BddOrder::FREQUENCY;
+            } else {
+                filename.clear();
+                break;
+            }
+        } else if (arg == "--bdd-nodes" && i + 1 < argc) {
+            char* end = nullptr;
+            kb.bdd_node_limit = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || kb.bdd_node_limit == 0) {
+                filename.clear();
+                break;
+            }
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--stats") {
+            kb.collect_stats = true;
+        } else if (arg == "--compile" && i + 1 < argc) {
+            image_filename = argv[++i];
+        } else if (arg == "--emit-cpp" && i + 1 < argc) {
+            cpp_filename = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_filename = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            char* end = nullptr;
+            threads = std::strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || threads == 0) {
+                filename.clear();
+                break;
+            }
+            kb.parse_threads = threads;
+        } else if (filename.empty()) {
+            filename = arg;
+        } else {
+            filename.clear();
+            break;
+        }
+    }
+    if (filename.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--forward | --sat | --bdd [--bdd-order dfs|file|frequency] [--bdd-nodes N]] [--stats] [--watch] [--threads N] [--compile <output.kbi> | --emit-cpp <output.h> | --batch <scenarios.txt|-> | --serve <socket>] <input_file>" << std::endl;
         return 1;
     }
 
-    KnowledgeBase kb;
-    std::string filename = argv[1];
-
     try {
-        kb.loadFromFile(filename);
-        kb.runInteractiveMode();
+        expert_system.loadFile(filename);
+        if (!image_filename.empty()) {
+            // 解析・コンパイル済みの知識ベースをイメージとして保存して終了
+            kb.saveImage(image_filename);
+            std::cout << "Compiled " << kb.rules.size() << " rules and " << kb.facts.size()
+                      << " facts into " << image_filename << std::endl;
+            return 0;
+        }
+        if (!cpp_filename.empty()) {
+            // クエリの評価関数を C++ のヘッダとして生成して終了
+            kb.emitCpp(cpp_filename);
+            std::cout << "Generated " << kb.queries.size() << " queries over " << kb.rules.size()
+                      << " rules into " << cpp_filename << std::endl;
+            return 0;
+        }
+        if (!batch_filename.empty()) {
+            // 非対話のバッチモード: 結果は標準出力に JSON Lines で、処理速度は標準エラー出力に
+            std::ifstream batch_file;
+            if (batch_filename != "-") {
+                batch_file.open(batch_filename);
+                if (!batch_file.is_open()) {
+                    throw std::runtime_error("Error: Could not open file " + batch_filename);
+                }
+            }
+            std::ios::sync_with_stdio(false);
+            BatchRunner runner(kb, threads);
+            auto start = std::chrono::steady_clock::now();
+            size_t count = runner.run(batch_filename == "-" ? std::cin : batch_file, std::cout);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::cerr << count << " scenarios in " << elapsed.count() << " s ("
+                      << (elapsed.count() > 0 ? count / elapsed.count() : 0.0) << " scenarios/sec)" << std::endl;
+            if (kb.collect_stats) {
+                // 機械可読な計測値 (1 行の JSON)
+                std::cerr << "{\"stats\":" << runner.stats().toJson() << "}" << std::endl;
+            }
+            return 0;
+        }
+        std::unique_ptr<RuleFileWatcher> watcher;
+        if (watch) watcher = std::make_unique<RuleFileWatcher>(filename, kb);
+        if (!socket_path.empty()) {
+            // デーモンモード: SIGINT / SIGTERM を受けるまでソケットの要求に答える
+            QueryServer server(kb, threads, watcher.get());
+            server.listen(socket_path);
+            std::cerr << "Serving " << filename << " on " << socket_path << std::endl;
+            size_t count = server.run();
+            std::cerr << count << " requests served" << std::endl;
+            if (kb.collect_stats) {
+                std::cerr << "{\"stats\":" << server.stats().toJson() << "}" << std::endl;
+            }
+            return 0;
+        }
+        kb.runInteractiveMode(watcher.get());
 
     } catch (const std::exception& e) {
         std::cerr << "An error occurred: " << e.what() << std::endl;
@@ -0,0 +1,229 @@
+// libexpert_system の API (ExpertSystem.h) のテスト: ./tests/library_test [cases のディレクトリ]
+// 読み込み・クエリ・初期事実の切り替え・ルールの追加と削除の結果を確かめ、API が標準出力に何も書かないことを確かめる
+#include "BatchRunner.h"
+#include "ExpertSystem.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failed = 0;
+
+void expect(bool condition, const std::string& label) {
+    if (condition) {
+        std::cerr << "ok   " << label << std::endl;
+    } else {
+        std::cerr << "FAIL " << label << std::endl;
+        failed++;
+    }
+}
+
+FactState query(ExpertSystem& system, const char* name) {
+    FactId id = system.findFact(name);
+    if (id == NO_FACT) throw std::runtime_error(std::string("unknown fact: ") + name);
+    FactState result = FactState::UNDETERMINED;
+    system.evaluate(&id, 1, &result);
+    return result;
+}
+
+const char* RULES =
+    "A + B => C\n"
+    "C | D => E\n"
+    "E + !F => G\n"
+    "=AB\n"
+    "?CEG\n";
+
+void testBuffer(InferenceMode mode, const std::string& label) {
+    ExpertSystem system(mode);
+    system.loadBuffer(RULES);
+    expect(system.factCount() == 7, label + " load: fact count");
+    expect(system.findFact("G") != NO_FACT && system.factName(system.findFact("G")) == "G", label + " load: fact names");
+    expect(system.findFact("Z") == NO_FACT, label + " load: unknown fact");
+    expect(system.queries().size() == 3, label + " load: file queries");
+
+    std::vector<FactState> results(system.queries().size());
+    system.evaluateQueries(results.data());
+    expect(results == std::vector<FactState>{FactState::TRUE, FactState::TRUE, FactState::TRUE}, label + " query: file facts");
+
+    // 初期事実の切り替え (変更の下流だけを再計算した結果が読み込み直した場合と同じになる)
+    FactId b = system.findFact("B");
+    FactId f = system.findFact("F");
+    system.setFact(f, true);
+    expect(system.isFactSet(f), label + " toggle: F set");
+    expect(query(system, "G") == FactState::FALSE, label + " toggle: !F blocks G");
+    system.setFact(b, false);
+    expect(!system.isFactSet(b), label + " toggle: B cleared");
+    expect(query(system, "C") == FactState::FALSE && query(system, "E") == FactState::FALSE, label + " toggle: C and E follow B");
+    system.setFact(f, false);
+    system.setFact(b, true);
+    expect(query(system, "G") == FactState::TRUE, label + " toggle: restored");
+    system.clearFacts();
+    expect(!system.isFactSet(system.findFact("A")) && query(system, "C") == FactState::FALSE, label + " toggle: clearFacts");
+
+    // ルールの追加と削除
+    system.setFact(system.findFact("D"), true);
+    expect(query(system, "G") == FactState::TRUE, label + " edit: D derives G");
+    expect(system.addRule("D => F") == 1, label + " edit: addRule count");
+    expect(query(system, "G") == FactState::FALSE, label + " edit: added rule blocks G");
+    expect(system.removeRule("D => F") == 1, label + " edit: removeRule count");
+    expect(query(system, "G") == FactState::TRUE, label + " edit: removed rule no longer blocks G");
+    bool threw = false;
+    try {
+        system.removeRule("D => F");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    expect(threw, label + " edit: removing a missing rule is an error");
+    expect(system.addRule("G => H") == 1 && system.findFact("H") != NO_FACT, label + " edit: new fact registered");
+    expect(query(system, "H") == FactState::TRUE, label + " edit: new fact derived");
+
+    threw = false;
+    try {
+        system.loadBuffer(RULES);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    expect(threw, label + " load: second load is an error");
+}
+
+void testFile(const std::string& cases) {
+    ExpertSystem system;
+    system.loadFile(cases + "/identifiers.txt");
+    std::vector<FactState> results(system.queries().size());
+    system.evaluateQueries(results.data());
+    expect(query(system, "Done_1") == FactState::TRUE && query(system, "shutdown_required") == FactState::FALSE,
+           "file: multi-character identifiers");
+
+    bool threw = false;
+    try {
+        ExpertSystem missing;
+        missing.loadFile(cases + "/does_not_exist.txt");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    expect(threw, "file: missing file is an error");
+}
+
+// 式の DAG のハッシュコンシング: AND 分解・<=>・ルール間で同じ前提部や部分式は 1 つの節点を共有する
+void testSharing() {
+    ExpertSystem system;
+    system.loadBuffer("A + B => C\n"
+                      "(A + B) | E => D\n"
+                      "A + B <=> F\n"
+                      "A + B => G + H\n"
+                      "E ^ (A + B) => I\n"
+                      "=A B\n"
+                      "?CDFGHI\n");
+    const KnowledgeBase& kb = system.knowledgeBase();
+    const ExprId shared = kb.rules[0].premise;
+    bool same = kb.expressions[shared].op == ExprNode::OpCode::AND;
+    for (size_t r = 0; r < kb.rules.size(); ++r) {
+        const ExprNode& node = kb.expressions[kb.rules[r].premise];
+        const bool uses_shared = kb.rules[r].premise == shared ||
+                                 (!kb.expressions.isFact(kb.rules[r].premise) && (node.left == shared || node.right == shared));
+        // <=> の逆向き (F => A, F => B) だけは前提部が事実 F そのもの
+        same &= uses_shared || kb.expressions[kb.rules[r].premise].op == ExprNode::OpCode::LOAD;
+    }
+    expect(same, "sharing: A + B is one node across rules");
+
+    const size_t nodes = kb.expressions.size();
+    system.addRule("A + B => C");
+    system.addRule("(A + B) | E => D");
+    expect(kb.expressions.size() == nodes, "sharing: duplicate rules add no nodes");
+
+    std::vector<FactState> results(system.queries().size());
+    system.evaluateQueries(results.data());
+    expect(results == std::vector<FactState>(6, FactState::TRUE), "sharing: shared premises evaluate once per scenario");
+    system.setFact(system.findFact("B"), false);
+    system.setFact(system.findFact("E"), true);
+    system.evaluateQueries(results.data());
+    expect(results == std::vector<FactState>{FactState::FALSE, FactState::TRUE, FactState::FALSE, FactState::FALSE,
+                                             FactState::FALSE, FactState::TRUE},
+           "sharing: memoized values follow a fact change");
+}
+
+const char* stateName(FactState state) {
+    switch (state) {
+        case FactState::TRUE: return "true";
+        case FactState::FALSE: return "false";
+        default: return "undetermined";
+    }
+}
+
+// バッチモード (64 シナリオを 1 語に詰めたレーン) の結果が、1 シナリオずつ evaluate した結果と一致する
+void testLanes(const std::string& cases, InferenceMode mode, const std::string& label) {
+    ExpertSystem system(mode);
+    system.loadFile(cases + "/lanes.txt");
+    std::ifstream file(cases + "/lanes.scenarios");
+    std::vector<std::string> scenarios;
+    std::string line;
+    while (std::getline(file, line)) scenarios.push_back(line);
+
+    std::istringstream in;
+    {
+        std::string all;
+        for (const std::string& scenario : scenarios) all += scenario + "\n";
+        in.str(all);
+    }
+    std::ostringstream out;
+    BatchRunner runner(system.knowledgeBase(), 2);
+    runner.run(in, out);
+    std::istringstream batch(out.str());
+
+    std::vector<FactState> results(system.queries().size());
+    size_t mismatches = 0;
+    for (size_t number = 1; number <= scenarios.size(); ++number) {
+        system.clearFacts();
+        std::istringstream facts(scenarios[number - 1].substr(1));
+        std::string name;
+        while (facts >> name) system.setFact(system.findFact(name), true);
+        system.evaluateQueries(results.data());
+
+        std::string expected = "{\"scenario\":" + std::to_string(number) + ",\"results\":{";
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (i != 0) expected += ",";
+            expected += "\"" + std::string(system.factName(system.queries()[i])) + "\":\"" +
+                        stateName(results[i]) + "\"";
+        }
+        expected += "}}";
+        std::getline(batch, line);
+        if (line != expected) mismatches++;
+    }
+    expect(scenarios.size() > 64 && mismatches == 0, label + " batch lanes match scalar evaluation");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    const std::string cases = argc > 1 ? argv[1] : "tests/cases";
+    std::ostringstream captured;
+    std::streambuf* stdout_buffer = std::cout.rdbuf(captured.rdbuf());
+    try {
+        testBuffer(InferenceMode::BACKWARD, "backward");
+        testBuffer(InferenceMode::FORWARD, "forward");
+        testBuffer(InferenceMode::SAT, "sat");
+        testBuffer(InferenceMode::BDD, "bdd");
+        testFile(cases);
+        testSharing();
+        testLanes(cases, InferenceMode::BACKWARD, "backward");
+        testLanes(cases, InferenceMode::FORWARD, "forward");
+        testLanes(cases, InferenceMode::BDD, "bdd");
+    } catch (const std::exception& e) {
+        std::cout.rdbuf(stdout_buffer);
+        std::cerr << "FAIL " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout.rdbuf(stdout_buffer);
+    expect(captured.str().empty(), "nothing written to standard output");
+
+    if (failed != 0) {
+        std::cerr << failed << " library test(s) failed" << std::endl;
+        return 1;
+    }
+    std::cerr << "all library tests passed" << std::endl;
+    return 0;
+}
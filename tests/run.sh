@@ -0,0 +1,299 @@
+#!/bin/bash
+# 回帰テスト: ./tests/run.sh [expert_system のパス] [kbgen のパス]
+# cases/<名前>.txt のルールファイルごとに
+#   <名前>.scenarios があれば、--batch の出力を各モードで 1 スレッドと 4 スレッドのそれぞれについて <名前>.expected と比較する
+#   (後向き連鎖ではシナリオを標準入力から読んだ場合も比較する)
+#   <名前>.sat.expected があれば、--sat --batch の出力 (SAT モードは他のモードと結果が異なりうる) をそれと比較する
+#   <名前>.stats があれば、--stats --batch が標準エラー出力に書く計測値の JSON (時間を除く) をそれと比較する
+#   <名前>.in があれば、それを標準入力としたインタラクティブモードの出力 (コマンド一覧を除く) を <名前>.out と比較する
+#   <名前>.requests があれば、--serve で起動したデーモンに 1 行 1 要求で (1 つの接続と、ルールの変更を含まなければ
+#   4 つの接続から交互に) 送り、応答の本文を <名前>.replies と比較する
+#   --compile で出力したイメージを後向き・前向き連鎖で読み込み、テキストから読み込んだときの出力と比較する
+#   --emit-cpp で出力したヘッダを検証用の main 付きで警告なしにコンパイルし、クエリを指定しないシナリオ (なければファイルの初期事実) を
+#   評価した出力を --batch の出力と比較する
+# 最後に、大きなルールファイルを複数スレッドで解析した結果が逐次解析と同じになること、ベンチマークの生成器 (kbgen) の
+# 出力が再現でき全モードで同じ結果になること、壊れたイメージの読み込みがエラーで終了することを確かめる
+BIN=$(realpath "${1:-$(dirname "$0")/../expert_system}")
+KBGEN=$(realpath "${2:-$(dirname "$0")/../bench/kbgen}")
+cd "$(dirname "$0")" || exit 1
+# BDD モードは各変数順序と、一部のクエリが後向き連鎖に切り替わる小さなノード数の上限でも評価する
+MODES=("" "--forward" "--bdd" "--bdd --bdd-order file" "--bdd --bdd-order frequency" "--bdd --bdd-nodes 64")
+CXX=${CXX:-c++}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+OUTPUT=$WORK/output
+
+failed=0
+# check <表示名> <期待する出力> <コマンド...>
+check() {
+    local label=$1 expected=$2
+    shift 2
+    "$@" > "$OUTPUT" 2>/dev/null
+    if diff -u "$expected" "$OUTPUT"; then
+        echo "ok   $label"
+    else
+        echo "FAIL $label"
+        failed=$((failed + 1))
+    fi
+}
+
+# 計測の時間 (stats コマンドの "... time : <秒> s"、--stats の "..._seconds") は実行ごとに変わるため伏せる
+interactive() {
+    "$BIN" "$1" < "$2" | sed -e '1,/^---*$/d' -e 's/\(time *: \)[0-9.]* s$/\1- s/'
+}
+
+batch_stats() {
+    "$BIN" --stats --threads 1 --batch "$2" "$1" 2>&1 > /dev/null | tail -n 1 | sed 's/\("[a-z_]*_seconds":\)[0-9.e+-]*/\1-/g'
+}
+
+# シナリオを標準入力から読むバッチモード (--batch -): <ルールファイル> <シナリオ>
+batch_stdin() {
+    "$BIN" --threads 1 --batch - "$1" < "$2"
+}
+
+# ルールファイルの初期事実とクエリだけを評価する (標準入力を閉じてインタラクティブモードに入らないようにする)
+evaluate() {
+    "$BIN" "$@" < /dev/null
+}
+
+# デーモンの要求・応答 (4 バイトの長さ + 本文) を送受信するクライアント: <ソケット> <要求のファイル> [接続数]
+# 複数の接続では、要求を 1 つずつ全ての接続に交互に送ってから、接続ごとに応答を順に表示する
+CLIENT='
+import socket, struct, sys, time
+path, requests = sys.argv[1], open(sys.argv[2], "rb").read().splitlines()
+count = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+def connect():
+    for attempt in range(100):
+        try:
+            s = socket.socket(socket.AF_UNIX)
+            s.connect(path)
+            return s
+        except OSError:
+            time.sleep(0.05)
+clients = [connect() for i in range(count)]
+for r in requests:
+    for s in clients:
+        s.sendall(struct.pack(">I", len(r)) + r)
+for s in clients:
+    replies = s.makefile("rb")
+    for r in requests:
+        n, = struct.unpack(">I", replies.read(4))
+        print(replies.read(n).decode())
+'
+
+# 上限 (1 MiB) を超える長さの要求はエラーを返して切断し、他のクライアントには答え続ける
+OVERSIZE='
+import socket, struct, sys, time
+path = sys.argv[1]
+for attempt in range(100):
+    try:
+        s = socket.socket(socket.AF_UNIX)
+        s.connect(path)
+        break
+    except OSError:
+        time.sleep(0.05)
+s.sendall(struct.pack(">I", 2 << 20) + b"=A")
+replies = s.makefile("rb")
+n, = struct.unpack(">I", replies.read(4))
+print(replies.read(n).decode())
+print("closed" if replies.read() == b"" else "open")
+s = socket.socket(socket.AF_UNIX)
+s.connect(path)
+s.sendall(struct.pack(">I", 7) + b"=A B ?C")
+replies = s.makefile("rb")
+n, = struct.unpack(">I", replies.read(4))
+print(replies.read(n).decode())
+'
+
+# daemon <ルールファイル> <クライアントのスクリプト> <引数...>
+daemon() {
+    local rules=$1 client=$2 socket server
+    shift 2
+    socket=$(mktemp -u /tmp/expert_system_test.XXXXXX)
+    "$BIN" --serve "$socket" --threads 2 "$rules" 2>/dev/null &
+    server=$!
+    python3 -c "$client" "$socket" "$@"
+    kill "$server"
+    wait "$server"
+}
+
+for rules in cases/*.txt; do
+    name=${rules%.txt}
+    if [ -f "$name.scenarios" ]; then
+        for mode in "${MODES[@]}"; do
+            check "$name ${mode:---backward}" "$name.expected" "$BIN" $mode --threads 1 --batch "$name.scenarios" "$rules"
+            check "$name ${mode:---backward} --threads 4" "$name.expected" "$BIN" $mode --threads 4 --batch "$name.scenarios" "$rules"
+        done
+        check "$name --batch -" "$name.expected" batch_stdin "$rules" "$name.scenarios"
+    fi
+    if [ -f "$name.sat.expected" ]; then
+        check "$name --sat" "$name.sat.expected" "$BIN" --sat --batch "$name.scenarios" "$rules"
+    fi
+    if [ -f "$name.stats" ]; then
+        check "$name --stats" "$name.stats" batch_stats "$rules" "$name.scenarios"
+    fi
+    if [ -f "$name.in" ]; then
+        check "$name interactive" "$name.out" interactive "$rules" "$name.in"
+    fi
+    if [ -f "$name.requests" ]; then
+        check "$name daemon" "$name.replies" daemon "$rules" "$CLIENT" "$name.requests"
+        # ルールの変更は全ての接続に及ぶため、複数の接続からは問い合わせだけを送る
+        if ! grep -q '^[-+]' "$name.requests"; then
+            for i in 1 2 3 4; do cat "$name.replies"; done > "$WORK/replies"
+            check "$name daemon (4 clients)" "$WORK/replies" daemon "$rules" "$CLIENT" "$name.requests" 4
+        fi
+    fi
+
+    image=$WORK/$(basename "$name").kbi
+    if ! "$BIN" --compile "$image" "$rules" > /dev/null 2>&1; then
+        echo "FAIL $name image (--compile)"
+        failed=$((failed + 1))
+        continue
+    fi
+    for mode in "" "--forward"; do
+        if [ -f "$name.scenarios" ]; then
+            "$BIN" $mode --threads 1 --batch "$name.scenarios" "$rules" > "$WORK/text" 2>/dev/null
+            check "$name image ${mode:---backward}" "$WORK/text" "$BIN" $mode --threads 1 --batch "$name.scenarios" "$image"
+        else
+            evaluate $mode "$rules" > "$WORK/text" 2>/dev/null
+            check "$name image ${mode:---backward}" "$WORK/text" evaluate $mode "$image"
+        fi
+    done
+    if [ -f "$name.sat.expected" ]; then
+        check "$name image --sat" "$name.sat.expected" "$BIN" --sat --batch "$name.scenarios" "$image"
+    fi
+    if [ -f "$name.in" ]; then
+        check "$name image interactive" "$name.out" interactive "$image" "$name.in"
+    fi
+
+    # 生成したコードが評価するのはファイルのクエリだけなので、クエリを指定したシナリオは除く
+    scenarios=$WORK/scenarios
+    if [ -f "$name.scenarios" ]; then
+        grep -v '?' "$name.scenarios" > "$scenarios"
+    else
+        grep -m 1 '^=' "$rules" > "$scenarios" || echo "=" > "$scenarios"
+    fi
+    if ! "$BIN" --emit-cpp "$WORK/generated.h" "$rules" > /dev/null 2>&1 ||
+       ! "$CXX" -std=c++17 -Wall -Wextra -Werror -DEXPERT_SYSTEM_VERIFY_MAIN -x c++ "$WORK/generated.h" -o "$WORK/verify"; then
+        echo "FAIL $name emit-cpp (generate or compile)"
+        failed=$((failed + 1))
+        continue
+    fi
+    "$BIN" --threads 1 --batch "$scenarios" "$rules" > "$WORK/batch" 2>/dev/null
+    check "$name emit-cpp" "$WORK/batch" "$WORK/verify" < "$scenarios"
+done
+
+cat > "$WORK/oversize.expected" << END
+{"error":"request too large"}
+closed
+{"scenario":1,"results":{"C":"true"}}
+END
+check "daemon oversized request" "$WORK/oversize.expected" daemon cases/serve.txt "$OVERSIZE"
+
+# 大きなルールファイル: 行境界で分けたチャンクを複数スレッドで解析しても、逐次解析と同じ知識ベース (同じイメージ) と
+# 結果になり、最初に報告する構文エラーもファイル順で最初のものになる (CRLF・タブ・行末のコメント・末尾の改行なしを含む)
+LARGE='
+BEGIN {
+    for (i = 0; i < 30000; i++) {
+        if (i % 3 == 0) printf "chain_link_with_a_long_identifier_%d => chain_link_with_a_long_identifier_%d\r\n", i, i + 1
+        else printf "chain_link_with_a_long_identifier_%d\t=>  chain_link_with_a_long_identifier_%d # chain\n", i, i + 1
+        printf "side_input_with_a_long_identifier_%d + !chain_link_with_a_long_identifier_%d => side_output_%d\n", i, i, i
+        if (errors && i == 10000) print "first_error + => X"
+        if (errors && i == 25000) print "second_error | => Y"
+    }
+    print "=chain_link_with_a_long_identifier_0"
+    printf "?chain_link_with_a_long_identifier_30000 side_output_5"
+}
+'
+awk -v errors=0 "$LARGE" > "$WORK/large.txt"
+LINK=chain_link_with_a_long_identifier
+cat > "$WORK/large.scenarios" << END
+=${LINK}_0
+=side_input_with_a_long_identifier_5
+=${LINK}_15000 ?${LINK}_14999 ${LINK}_30000
+END
+cat > "$WORK/large.expected" << END
+{"scenario":1,"results":{"${LINK}_30000":"true","side_output_5":"false"}}
+{"scenario":2,"results":{"${LINK}_30000":"false","side_output_5":"true"}}
+{"scenario":3,"results":{"${LINK}_14999":"false","${LINK}_30000":"true"}}
+END
+for threads in 1 4; do
+    check "large file --threads $threads" "$WORK/large.expected" "$BIN" --threads "$threads" --batch "$WORK/large.scenarios" "$WORK/large.txt"
+    "$BIN" --threads "$threads" --compile "$WORK/large_$threads.kbi" "$WORK/large.txt" > /dev/null 2>&1
+done
+check "large file image --threads 4" "$WORK/large_1.kbi" cat "$WORK/large_4.kbi"
+awk -v errors=1 "$LARGE" > "$WORK/large.txt"
+echo "An error occurred: Syntax Error at position 14 ('first_error + '): Expected a fact identifier or '('" > "$WORK/large.expected"
+for threads in 1 4; do
+    evaluate --threads "$threads" "$WORK/large.txt" > "$WORK/large.error" 2>&1
+    check "large file syntax error --threads $threads" "$WORK/large.expected" cat "$WORK/large.error"
+done
+
+# ベンチマークの生成器: 同じシードからは同じ知識ベースを生成し、指定した数のルールを持ち、どのモードでも同じ結果になる
+if [ -x "$KBGEN" ]; then
+    "$KBGEN" --seed 7 --facts 400 --rules 1500 --cycles 0.1 --disjunctive 0.2 > "$WORK/generated_a.txt"
+    "$KBGEN" --seed 7 --facts 400 --rules 1500 --cycles 0.1 --disjunctive 0.2 > "$WORK/generated.txt"
+    check "kbgen same seed" "$WORK/generated_a.txt" cat "$WORK/generated.txt"
+    "$KBGEN" --seed 8 --facts 400 --rules 1500 --cycles 0.1 --disjunctive 0.2 > "$WORK/generated_b.txt"
+    if cmp -s "$WORK/generated.txt" "$WORK/generated_b.txt"; then
+        echo "FAIL kbgen different seed"
+        failed=$((failed + 1))
+    else
+        echo "ok   kbgen different seed"
+    fi
+    echo 1500 > "$WORK/count"
+    check "kbgen rule count" "$WORK/count" grep -c "=>" "$WORK/generated.txt"
+    awk 'BEGIN { srand(3); for (i = 0; i < 100; i++) { s = "="; for (f = 0; f < 400; f++) if (rand() < 0.05) s = s " f" f; print s } }' > "$WORK/scenarios"
+    "$BIN" --threads 1 --batch "$WORK/scenarios" "$WORK/generated.txt" > "$WORK/batch" 2>/dev/null
+    for mode in --forward --bdd; do
+        check "kbgen $mode" "$WORK/batch" "$BIN" $mode --threads 1 --batch "$WORK/scenarios" "$WORK/generated.txt"
+    done
+    if "$KBGEN" --help | grep -q "^Usage:" && ! "$KBGEN" --no-such-option > /dev/null 2>&1; then
+        echo "ok   kbgen options"
+    else
+        echo "FAIL kbgen options"
+        failed=$((failed + 1))
+    fi
+else
+    echo "skip kbgen (not built: make $KBGEN)"
+fi
+
+# 壊れたイメージ: 範囲を確かめて、シグナルで落ちずにエラーを報告して終了する
+# (ヘッダは magic 8 バイト・版 4 バイト・バイト順 4 バイトの後に、セクションごとの (開始位置, バイト数) が 8 バイトずつ並ぶ)
+CORRUPT='
+import struct, sys
+source, kind, target = sys.argv[1], sys.argv[2], sys.argv[3]
+data = bytearray(open(source, "rb").read())
+FACT_POOL = 7  # kb_image::FACT_POOL
+entry = 16 + FACT_POOL * 16
+offset, size = struct.unpack_from("=QQ", data, entry)
+if kind == "truncated-header":
+    data = data[:40]
+elif kind == "truncated-body":
+    data = data[:len(data) // 2]
+elif kind == "section-offset":
+    struct.pack_into("=Q", data, entry, len(data) + 8)
+elif kind == "fact-id":
+    struct.pack_into("=I", data, offset, 0xFFFFFFFF)
+elif kind == "version":
+    struct.pack_into("=I", data, 8, 0)
+open(target, "wb").write(data)
+'
+for kind in truncated-header truncated-body section-offset fact-id version; do
+    python3 -c "$CORRUPT" "$WORK/rule_edit.kbi" "$kind" "$WORK/corrupt.kbi"
+    evaluate "$WORK/corrupt.kbi" > "$OUTPUT" 2>&1
+    status=$?
+    if [ "$status" -eq 1 ] && grep -q "^An error occurred: Error: .*knowledge base image" "$OUTPUT"; then
+        echo "ok   corrupt image ($kind)"
+    else
+        echo "FAIL corrupt image ($kind): exit status $status"
+        cat "$OUTPUT"
+        failed=$((failed + 1))
+    fi
+done
+
+if [ "$failed" -ne 0 ]; then
+    echo "$failed test(s) failed"
+    exit 1
+fi
+echo "all tests passed"